@@ -0,0 +1,322 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "cpu.hpp"
+#include "ines.hpp"
+#include "memory.hpp"
+#include "ppu.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+#include "workloads.hpp"
+
+namespace {
+    // cpu cycles of an NTSC frame
+    const uint64_t cyclesPerFrame = 29781;
+
+    const char *modeNames[] = {
+        "", "abs", "abs,X", "abs,Y", "A", "#imm", "implied", "(zp,X)", "(ind)", "(zp),Y", "rel", "zp", "zp,X", "zp,Y",
+    };
+
+    // where the synthetic programs are loaded
+    const uint16_t programAddress = 0x0200;
+
+    std::shared_ptr<nestake::Cpu> newCpu() {
+        return std::make_shared<nestake::Cpu>(std::make_shared<nestake::CPUMemory>());
+    }
+
+    void loadProgram(nestake::Cpu &cpu, const uint8_t *code, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            cpu.mem->RAM[programAddress + i] = code[i];
+        }
+        cpu.PC = programAddress;
+    }
+
+    // run whole frames and report emulated cycles and frames per host second,
+    // and the cycles run by each Step() call (higher when fused instructions save dispatches)
+    void runFrames(benchmark::State &state, nestake::Cpu &cpu) {
+        uint64_t start = cpu.Cycles;
+        uint64_t steps = 0;
+        for (auto _ : state) {
+            uint64_t end = cpu.Cycles + cyclesPerFrame;
+            while (cpu.Cycles < end) {
+                cpu.Step();
+                ++steps;
+            }
+        }
+        uint64_t cycles = cpu.Cycles - start;
+        state.counters["cycles_per_second"] = benchmark::Counter(double(cycles), benchmark::Counter::kIsRate);
+        state.counters["frames_per_second"] = benchmark::Counter(double(state.iterations()), benchmark::Counter::kIsRate);
+        state.counters["cycles_per_step"] = steps ? double(cycles) / double(steps) : 0.0;
+    }
+}
+
+// single instruction executed from RAM, one per addressing mode: Arg = opcode
+static void BM_Opcode(benchmark::State &state) {
+    std::shared_ptr<nestake::Cpu> cpu = newCpu();
+    uint8_t opcode = uint8_t(state.range(0));
+    nestake::DecodedInstruction d = cpu->Decode(opcode, 0);
+    if (d.Executor == nullptr) {
+        state.SkipWithError("unsupported opcode");
+        return;
+    }
+    state.SetLabel(cpu->InstructionName(opcode) + " " + modeNames[d.AddressingMode]);
+
+    // operands point at RAM ($0010 / $0310 / ($10) -> $0310); branches and jumps target themselves
+    uint8_t code[3] = {opcode, 0x10, 0x03};
+    if (d.AddressingMode == nestake::Relative) {
+        code[1] = 0xFE;
+    } else if (d.AddressingMode == nestake::Absolute && (d.ID == nestake::JMP || d.ID == nestake::JSR)) {
+        code[1] = programAddress & 0xFF;
+        code[2] = programAddress >> 8;
+    }
+    cpu->mem->RAM[0x10] = 0x10;
+    cpu->mem->RAM[0x11] = 0x03;
+    loadProgram(*cpu, code, sizeof(code));
+
+    for (auto _ : state) {
+        cpu->PC = programAddress;
+        cpu->SP = 0xFD;
+        benchmark::DoNotOptimize(cpu->Step());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Opcode)
+    ->Arg(0xA9)   // LDA #imm
+    ->Arg(0xA5)   // LDA zp
+    ->Arg(0xB5)   // LDA zp,X
+    ->Arg(0xAD)   // LDA abs
+    ->Arg(0xBD)   // LDA abs,X
+    ->Arg(0xB9)   // LDA abs,Y
+    ->Arg(0x21)   // AND (zp,X)
+    ->Arg(0xB1)   // LDA (zp),Y
+    ->Arg(0x85)   // STA zp
+    ->Arg(0xE6)   // INC zp
+    ->Arg(0x0A)   // ASL A
+    ->Arg(0xE8)   // INX
+    ->Arg(0xD0)   // BNE rel
+    ->Arg(0x4C)   // JMP abs
+    ->Arg(0x6C)   // JMP (ind)
+    ->Arg(0x20);  // JSR abs
+
+// CPUMemory::Read by region: Arg = address
+static void BM_MemoryRead(benchmark::State &state) {
+    nestake::CPUMemory mem;
+    mem.Cart = std::make_shared<nestake::Cartridge>(NESTAKE_SAMPLE_ROM);
+    uint16_t address = uint16_t(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mem.Read(address));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryRead)
+    ->Arg(0x0010)   // RAM
+    ->Arg(0x1810)   // RAM mirror
+    ->Arg(0x2002)   // PPU registers
+    ->Arg(0x4016)   // controller
+    ->Arg(0x6000)   // cartridge SRAM
+    ->Arg(0x8000);  // PRG-ROM
+
+// Arg = pointer address (0x02FF wraps within the page)
+static void BM_Read16Bug(benchmark::State &state) {
+    std::shared_ptr<nestake::Cpu> cpu = newCpu();
+    uint16_t address = uint16_t(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cpu->read16Bug(address));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Read16Bug)->Arg(0x0210)->Arg(0x02FF);
+
+// palette RAM round trip over all 32 entries (mirrors of $3F10/$3F14/$3F18/$3F1C included)
+static void BM_Palette(benchmark::State &state) {
+    nestake::PPU ppu;
+    for (auto _ : state) {
+        for (uint16_t i = 0; i < 32; ++i) {
+            ppu.WritePalette(i, uint8_t(i));
+        }
+        uint32_t sum = 0;
+        for (uint16_t i = 0; i < 32; ++i) {
+            sum += ppu.ReadPalette(i);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_Palette);
+
+// a visible frame drawn scanline by scanline: Arg = visible 8x16 sprites (up to 8 per scanline)
+static void BM_RenderFrame(benchmark::State &state) {
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    std::vector<uint8_t> chr(0x2000);
+    for (size_t i = 0; i < chr.size(); ++i) {
+        chr[i] = uint8_t(i * 37);
+    }
+    nestake::PPU ppu;
+    ppu.LoadCartridge(std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr)));
+    for (size_t i = 0; i < ppu.nameTableData.size(); ++i) {
+        ppu.nameTableData[i] = uint8_t(i);
+    }
+    for (int i = 0; i < 64; ++i) {
+        // rows of sprites every 30 lines
+        bool shown = i < state.range(0);
+        ppu.oamData[i*4] = shown ? uint8_t((i % 8) * 30) : 0xF0;
+        ppu.oamData[i*4 + 1] = uint8_t(i);
+        ppu.oamData[i*4 + 2] = uint8_t(i & 0xE3);
+        ppu.oamData[i*4 + 3] = uint8_t(i * 4);
+    }
+    ppu.writeControl(0x20);
+    ppu.writeMask(0x1E);
+    for (auto _ : state) {
+        for (int line = 0; line < 240; ++line) {
+            ppu.RenderScanline(line);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * 256 * 240);
+}
+BENCHMARK(BM_RenderFrame)->Arg(0)->Arg(8)->Arg(64);
+
+// RenderFrame of a static screen: only the dirty scanline checks
+static void BM_StaticFrame(benchmark::State &state) {
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    std::vector<uint8_t> chr(0x2000, 0x55);
+    nestake::PPU ppu;
+    ppu.LoadCartridge(std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr)));
+    ppu.writeMask(0x1E);
+    ppu.RenderFrame();
+    for (auto _ : state) {
+        ppu.RenderFrame();
+        benchmark::DoNotOptimize(ppu.DirtyLines.size());
+    }
+}
+BENCHMARK(BM_StaticFrame);
+
+// SIMD kernels: Arg = SimdLevel (skipped above the host's level)
+static bool simdLevel(benchmark::State &state, nestake::SimdKernels &k) {
+    if (state.range(0) > nestake::DetectSimdLevel()) {
+        state.SkipWithError("not supported by this host");
+        return false;
+    }
+    k = nestake::SimdKernelsFor(nestake::SimdLevel(state.range(0)));
+    return true;
+}
+
+static void BM_HashBytes(benchmark::State &state) {
+    nestake::SimdKernels k;
+    if (!simdLevel(state, k)) {
+        return;
+    }
+    std::vector<uint8_t> ram(0x800, 0x5A);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(k.HashBytes(ram.data(), ram.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * ram.size());
+}
+BENCHMARK(BM_HashBytes)->DenseRange(nestake::SimdScalar, nestake::SimdAVX512);
+
+static void BM_PaletteToRGBA(benchmark::State &state) {
+    nestake::SimdKernels k;
+    if (!simdLevel(state, k)) {
+        return;
+    }
+    std::vector<uint32_t> palette(64, 0xFF808080);
+    std::vector<uint8_t> indices(256 * 240, 0x21);
+    std::vector<uint32_t> image(256 * 240);
+    for (auto _ : state) {
+        k.PaletteToRGBA(indices.data(), indices.size(), palette.data(), image.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * indices.size());
+}
+BENCHMARK(BM_PaletteToRGBA)->DenseRange(nestake::SimdScalar, nestake::SimdAVX512);
+
+static void BM_Downsample2x(benchmark::State &state) {
+    nestake::SimdKernels k;
+    if (!simdLevel(state, k)) {
+        return;
+    }
+    std::vector<uint32_t> image(256 * 240, 0xFF336699);
+    std::vector<uint32_t> small(128 * 120);
+    for (auto _ : state) {
+        k.Downsample2x(image.data(), 256, 240, small.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * image.size());
+}
+BENCHMARK(BM_Downsample2x)->DenseRange(nestake::SimdScalar, nestake::SimdAVX512);
+
+// sample.nes frames: Arg 0 = interpreter, 1 = fused, 2 = recompiler, 3 = cycle accurate,
+// 4 = interpreter appending to a tracer (nestake_bench_trace only: compare it with Arg 0 of the same binary)
+static void BM_SampleFrames(benchmark::State &state) {
+    std::shared_ptr<nestake::Cpu> cpu = newCpu();
+    cpu->IsFusionMode = state.range(0) == 1 || state.range(0) == 2;
+    cpu->IsJITMode = state.range(0) == 2;
+    cpu->IsCycleAccurate = state.range(0) == 3;
+    if (state.range(0) == 4) {
+#ifdef NESTAKE_TRACE
+        cpu->Tracer = std::make_shared<nestake::TraceBuffer>("", 1 << 16);
+#else
+        state.SkipWithError("build with NESTAKE_TRACE (nestake_bench_trace)");
+        return;
+#endif
+    }
+    cpu->LoadCartridge(std::make_shared<nestake::Cartridge>(NESTAKE_SAMPLE_ROM));
+    runFrames(state, *cpu);
+}
+BENCHMARK(BM_SampleFrames)->Arg(0)->Arg(1)->Arg(2)->Arg(3)->Arg(4);
+
+// synthetic program: copy a page with LDA abs,X / STA abs,X / INX / BNE, forever
+static void BM_SyntheticCopy(benchmark::State &state) {
+    std::shared_ptr<nestake::Cpu> cpu = newCpu();
+    const uint8_t code[] = {
+        0xA2, 0x00,        // LDX #$00
+        0xBD, 0x00, 0x03,  // LDA $0300,X
+        0x9D, 0x00, 0x04,  // STA $0400,X
+        0xE8,              // INX
+        0xD0, 0xF7,        // BNE -9
+        0x4C, 0x00, 0x02,  // JMP $0200
+    };
+    loadProgram(*cpu, code, sizeof(code));
+    runFrames(state, *cpu);
+}
+BENCHMARK(BM_SyntheticCopy);
+
+// synthetic program: arithmetic and flag heavy loop
+static void BM_SyntheticALU(benchmark::State &state) {
+    std::shared_ptr<nestake::Cpu> cpu = newCpu();
+    const uint8_t code[] = {
+        0x18,              // CLC
+        0xA5, 0x10,        // LDA $10
+        0x69, 0x03,        // ADC #$03
+        0x85, 0x10,        // STA $10
+        0x4A,              // LSR A
+        0x49, 0x5A,        // EOR #$5A
+        0xC9, 0x80,        // CMP #$80
+        0x26, 0x11,        // ROL $11
+        0x4C, 0x00, 0x02,  // JMP $0200
+    };
+    loadProgram(*cpu, code, sizeof(code));
+    runFrames(state, *cpu);
+}
+BENCHMARK(BM_SyntheticALU);
+
+// synthetic cartridges (see workloads.hpp): Arg 0 = ALU, 1 = copy, 2 = branch, 3 = PPU poll, 4 = bank switch;
+// second Arg = 0 interpreter, 1 fused, 2 recompiler
+static void BM_Workload(benchmark::State &state) {
+    const char *const sources[] = {
+        nestake::workloads::ALU, nestake::workloads::Copy, nestake::workloads::Branch,
+        nestake::workloads::PPUPoll, nestake::workloads::BankSwitch,
+    };
+    const char *const names[] = {"alu", "copy", "branch", "ppu poll", "bank switch"};
+    state.SetLabel(names[state.range(0)]);
+
+    std::shared_ptr<nestake::Cpu> cpu = newCpu();
+    cpu->IsFusionMode = state.range(1) >= 1;
+    cpu->IsJITMode = state.range(1) == 2;
+    cpu->LoadCartridge(nestake::workloads::Build(sources[state.range(0)]));
+    runFrames(state, *cpu);
+}
+BENCHMARK(BM_Workload)->ArgsProduct({{0, 1, 2, 3, 4}, {0, 1, 2}});
@@ -0,0 +1,91 @@
+#ifndef NESTAKE_BENCH_WORKLOADS
+#define NESTAKE_BENCH_WORKLOADS
+
+#include <memory>
+#include <string>
+
+#include "assembler.hpp"
+#include "ines.hpp"
+
+namespace nestake {
+    namespace workloads {
+        // synthetic NROM programs, each one hammering a single interpreter path.
+        // every program starts at `reset` ($C000) and loops forever.
+
+        // flag heavy arithmetic on registers and zero page
+        const char *const ALU =
+            "reset: CLC\n"
+            "loop:  LDA $10\n"
+            "       ADC #$03\n"
+            "       STA $10\n"
+            "       EOR #$5A\n"
+            "       LSR A\n"
+            "       ROL $11\n"
+            "       AND #$7F\n"
+            "       ORA $11\n"
+            "       SBC #$01\n"
+            "       JMP loop\n";
+
+        // page copy through an indirect pointer
+        const char *const Copy =
+            "reset: LDA #$00\n"
+            "       STA $10\n"
+            "       LDA #$03\n"
+            "       STA $11\n"
+            "loop:  LDY #$00\n"
+            "copy:  LDA ($10),Y\n"
+            "       STA $0400,Y\n"
+            "       INY\n"
+            "       BNE copy\n"
+            "       JMP loop\n";
+
+        // compare and branch on every other instruction
+        const char *const Branch =
+            "reset: LDX #$00\n"
+            "loop:  INX\n"
+            "       TXA\n"
+            "       AND #$03\n"
+            "       BEQ zero\n"
+            "       CMP #$02\n"
+            "       BCC one\n"
+            "       BNE three\n"
+            "       JMP loop\n"
+            "zero:  CPX #$80\n"
+            "       BCS loop\n"
+            "       JMP loop\n"
+            "one:   BMI loop\n"
+            "       JMP loop\n"
+            "three: BPL loop\n"
+            "       JMP loop\n";
+
+        // vblank wait on PPUSTATUS, the most common idle loop of games
+        const char *const PPUPoll =
+            "PPUSTATUS = $2002\n"
+            "reset: BIT PPUSTATUS\n"
+            "wait:  BIT PPUSTATUS\n"
+            "       BPL wait\n"
+            "       JMP reset\n";
+
+        // writes to the mapper registers of $8000-$FFFF on every iteration
+        const char *const BankSwitch =
+            "reset: LDX #$00\n"
+            "loop:  STX $8000\n"
+            "       STX $A000\n"
+            "       STX $C000\n"
+            "       STX $E000\n"
+            "       LDA $8000\n"
+            "       INX\n"
+            "       JMP loop\n";
+
+        // 16KB NROM cartridge running the program from $C000
+        inline std::shared_ptr<Cartridge> Build(const char *source) {
+            Assembler as;
+            std::vector<uint8_t> prg = as.Assemble(std::string(source) +
+                                                   "       .org $FFFA\n"
+                                                   "       .word reset, reset, reset\n", 0xC000);
+            return std::make_shared<Cartridge>(MakeINES(prg, std::vector<uint8_t>()));
+        }
+    }
+}
+
+#endif
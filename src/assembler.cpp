@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+#include "assembler.hpp"
+#include "cpu.hpp"
+
+namespace nestake {
+
+    struct opcodeEntry {
+        const char *Mnemonic;
+        uint8_t Mode;
+        uint8_t Opcode;
+    };
+
+    // official opcodes
+    static const opcodeEntry opcodes[] = {
+        {"ADC", Immediate, 0x69}, {"ADC", ZeroPage, 0x65}, {"ADC", ZeroPageX, 0x75}, {"ADC", Absolute, 0x6D},
+        {"ADC", AbsoluteX, 0x7D}, {"ADC", AbsoluteY, 0x79}, {"ADC", IndexedIndirect, 0x61}, {"ADC", IndirectIndexed, 0x71},
+        {"AND", Immediate, 0x29}, {"AND", ZeroPage, 0x25}, {"AND", ZeroPageX, 0x35}, {"AND", Absolute, 0x2D},
+        {"AND", AbsoluteX, 0x3D}, {"AND", AbsoluteY, 0x39}, {"AND", IndexedIndirect, 0x21}, {"AND", IndirectIndexed, 0x31},
+        {"ASL", Accumulator, 0x0A}, {"ASL", ZeroPage, 0x06}, {"ASL", ZeroPageX, 0x16}, {"ASL", Absolute, 0x0E},
+        {"ASL", AbsoluteX, 0x1E},
+        {"BCC", Relative, 0x90}, {"BCS", Relative, 0xB0}, {"BEQ", Relative, 0xF0}, {"BMI", Relative, 0x30},
+        {"BNE", Relative, 0xD0}, {"BPL", Relative, 0x10}, {"BVC", Relative, 0x50}, {"BVS", Relative, 0x70},
+        {"BIT", ZeroPage, 0x24}, {"BIT", Absolute, 0x2C},
+        {"BRK", Implied, 0x00},
+        {"CLC", Implied, 0x18}, {"CLD", Implied, 0xD8}, {"CLI", Implied, 0x58}, {"CLV", Implied, 0xB8},
+        {"CMP", Immediate, 0xC9}, {"CMP", ZeroPage, 0xC5}, {"CMP", ZeroPageX, 0xD5}, {"CMP", Absolute, 0xCD},
+        {"CMP", AbsoluteX, 0xDD}, {"CMP", AbsoluteY, 0xD9}, {"CMP", IndexedIndirect, 0xC1}, {"CMP", IndirectIndexed, 0xD1},
+        {"CPX", Immediate, 0xE0}, {"CPX", ZeroPage, 0xE4}, {"CPX", Absolute, 0xEC},
+        {"CPY", Immediate, 0xC0}, {"CPY", ZeroPage, 0xC4}, {"CPY", Absolute, 0xCC},
+        {"DEC", ZeroPage, 0xC6}, {"DEC", ZeroPageX, 0xD6}, {"DEC", Absolute, 0xCE}, {"DEC", AbsoluteX, 0xDE},
+        {"DEX", Implied, 0xCA}, {"DEY", Implied, 0x88},
+        {"EOR", Immediate, 0x49}, {"EOR", ZeroPage, 0x45}, {"EOR", ZeroPageX, 0x55}, {"EOR", Absolute, 0x4D},
+        {"EOR", AbsoluteX, 0x5D}, {"EOR", AbsoluteY, 0x59}, {"EOR", IndexedIndirect, 0x41}, {"EOR", IndirectIndexed, 0x51},
+        {"INC", ZeroPage, 0xE6}, {"INC", ZeroPageX, 0xF6}, {"INC", Absolute, 0xEE}, {"INC", AbsoluteX, 0xFE},
+        {"INX", Implied, 0xE8}, {"INY", Implied, 0xC8},
+        {"JMP", Absolute, 0x4C}, {"JMP", Indirect, 0x6C}, {"JSR", Absolute, 0x20},
+        {"LDA", Immediate, 0xA9}, {"LDA", ZeroPage, 0xA5}, {"LDA", ZeroPageX, 0xB5}, {"LDA", Absolute, 0xAD},
+        {"LDA", AbsoluteX, 0xBD}, {"LDA", AbsoluteY, 0xB9}, {"LDA", IndexedIndirect, 0xA1}, {"LDA", IndirectIndexed, 0xB1},
+        {"LDX", Immediate, 0xA2}, {"LDX", ZeroPage, 0xA6}, {"LDX", ZeroPageY, 0xB6}, {"LDX", Absolute, 0xAE},
+        {"LDX", AbsoluteY, 0xBE},
+        {"LDY", Immediate, 0xA0}, {"LDY", ZeroPage, 0xA4}, {"LDY", ZeroPageX, 0xB4}, {"LDY", Absolute, 0xAC},
+        {"LDY", AbsoluteX, 0xBC},
+        {"LSR", Accumulator, 0x4A}, {"LSR", ZeroPage, 0x46}, {"LSR", ZeroPageX, 0x56}, {"LSR", Absolute, 0x4E},
+        {"LSR", AbsoluteX, 0x5E},
+        {"NOP", Implied, 0xEA},
+        {"ORA", Immediate, 0x09}, {"ORA", ZeroPage, 0x05}, {"ORA", ZeroPageX, 0x15}, {"ORA", Absolute, 0x0D},
+        {"ORA", AbsoluteX, 0x1D}, {"ORA", AbsoluteY, 0x19}, {"ORA", IndexedIndirect, 0x01}, {"ORA", IndirectIndexed, 0x11},
+        {"PHA", Implied, 0x48}, {"PHP", Implied, 0x08}, {"PLA", Implied, 0x68}, {"PLP", Implied, 0x28},
+        {"ROL", Accumulator, 0x2A}, {"ROL", ZeroPage, 0x26}, {"ROL", ZeroPageX, 0x36}, {"ROL", Absolute, 0x2E},
+        {"ROL", AbsoluteX, 0x3E},
+        {"ROR", Accumulator, 0x6A}, {"ROR", ZeroPage, 0x66}, {"ROR", ZeroPageX, 0x76}, {"ROR", Absolute, 0x6E},
+        {"ROR", AbsoluteX, 0x7E},
+        {"RTI", Implied, 0x40}, {"RTS", Implied, 0x60},
+        {"SBC", Immediate, 0xE9}, {"SBC", ZeroPage, 0xE5}, {"SBC", ZeroPageX, 0xF5}, {"SBC", Absolute, 0xED},
+        {"SBC", AbsoluteX, 0xFD}, {"SBC", AbsoluteY, 0xF9}, {"SBC", IndexedIndirect, 0xE1}, {"SBC", IndirectIndexed, 0xF1},
+        {"SEC", Implied, 0x38}, {"SED", Implied, 0xF8}, {"SEI", Implied, 0x78},
+        {"STA", ZeroPage, 0x85}, {"STA", ZeroPageX, 0x95}, {"STA", Absolute, 0x8D}, {"STA", AbsoluteX, 0x9D},
+        {"STA", AbsoluteY, 0x99}, {"STA", IndexedIndirect, 0x81}, {"STA", IndirectIndexed, 0x91},
+        {"STX", ZeroPage, 0x86}, {"STX", ZeroPageY, 0x96}, {"STX", Absolute, 0x8E},
+        {"STY", ZeroPage, 0x84}, {"STY", ZeroPageX, 0x94}, {"STY", Absolute, 0x8C},
+        {"TAX", Implied, 0xAA}, {"TAY", Implied, 0xA8}, {"TSX", Implied, 0xBA}, {"TXA", Implied, 0x8A},
+        {"TXS", Implied, 0x9A}, {"TYA", Implied, 0x98},
+    };
+
+    // a line of source after the first pass
+    struct Assembler::statement {
+        int Line;
+        uint16_t PC;
+
+        // mnemonic or directive in upper case
+        std::string Op;
+
+        // operand expression(s) without the addressing mode syntax
+        std::string Operand;
+        uint8_t Mode;
+    };
+
+    static bool findOpcode(const std::string &mnemonic, uint8_t mode, uint8_t &opcode) {
+        for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); ++i) {
+            if (mnemonic == opcodes[i].Mnemonic && opcodes[i].Mode == mode) {
+                opcode = opcodes[i].Opcode;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool isMnemonic(const std::string &mnemonic) {
+        for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); ++i) {
+            if (mnemonic == opcodes[i].Mnemonic) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint8_t instructionSize(uint8_t mode) {
+        switch (mode) {
+            case Implied: case Accumulator:
+                return 1;
+            case Absolute: case AbsoluteX: case AbsoluteY: case Indirect:
+                return 3;
+            default:
+                return 2;
+        }
+    }
+
+    static std::string trim(const std::string &s) {
+        size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return "";
+        }
+        size_t end = s.find_last_not_of(" \t\r");
+        return s.substr(begin, end - begin + 1);
+    }
+
+    static std::string upper(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](char c) { return char(std::toupper(c)); });
+        return s;
+    }
+
+    static bool endsWith(const std::string &s, const std::string &suffix) {
+        return s.size() >= suffix.size() && upper(s.substr(s.size() - suffix.size())) == suffix;
+    }
+
+    static std::vector<std::string> splitList(const std::string &s) {
+        std::vector<std::string> items;
+        std::stringstream ss(s);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            items.push_back(trim(item));
+        }
+        return items;
+    }
+
+    static std::runtime_error asmError(int line, const std::string &message) {
+        return std::runtime_error("line " + std::to_string(line) + ": " + message);
+    }
+
+    uint16_t Assembler::evaluate(const std::string &expression, uint16_t pc, bool &known, int line) const {
+        known = true;
+        std::string e = trim(expression);
+        if (e.empty()) {
+            throw asmError(line, "missing operand");
+        }
+
+        // <expr: low byte, >expr: high byte
+        if (e[0] == '<' || e[0] == '>') {
+            uint16_t v = evaluate(e.substr(1), pc, known, line);
+            return e[0] == '<' ? uint16_t(v & 0xFF) : uint16_t(v >> 8);
+        }
+
+        int32_t sum = 0;
+        int sign = 1;
+        size_t i = 0;
+        while (i < e.size()) {
+            size_t j = i;
+            while (j < e.size() && e[j] != '+' && e[j] != '-') {
+                ++j;
+            }
+            std::string term = trim(e.substr(i, j - i));
+            int32_t v = 0;
+            if (term.empty()) {
+                throw asmError(line, "bad expression '" + e + "'");
+            } else if (term == "*") {
+                v = pc;
+            } else if (term[0] == '$' || term[0] == '%' || std::isdigit(term[0])) {
+                int base = term[0] == '$' ? 16 : term[0] == '%' ? 2 : 10;
+                std::string digits = std::isdigit(term[0]) ? term : term.substr(1);
+                size_t used = 0;
+                try {
+                    v = int32_t(std::stol(digits, &used, base));
+                } catch (const std::exception &) {
+                    used = 0;
+                }
+                if (used == 0 || used != digits.size()) {
+                    throw asmError(line, "bad number '" + term + "'");
+                }
+            } else {
+                auto it = labels.find(term);
+                if (it == labels.end()) {
+                    known = false;
+                } else {
+                    v = it->second;
+                }
+            }
+            sum += sign * v;
+            if (j < e.size()) {
+                sign = e[j] == '+' ? 1 : -1;
+            }
+            i = j + 1;
+        }
+        return uint16_t(sum);
+    }
+
+    std::vector<uint8_t> Assembler::Assemble(const std::string &source, uint16_t origin) {
+        labels.clear();
+
+        // first pass: addressing modes, sizes and label addresses
+        std::vector<statement> statements;
+        std::stringstream lines(source);
+        std::string text;
+        uint32_t pc = origin;
+        int line = 0;
+        while (std::getline(lines, text)) {
+            ++line;
+            text = trim(text.substr(0, text.find(';')));
+
+            // label:
+            size_t colon = text.find(':');
+            if (colon != std::string::npos) {
+                std::string name = trim(text.substr(0, colon));
+                if (name.empty() || labels.count(name)) {
+                    throw asmError(line, "bad or duplicate label '" + name + "'");
+                }
+                labels[name] = uint16_t(pc);
+                text = trim(text.substr(colon + 1));
+            }
+            if (text.empty()) {
+                continue;
+            }
+
+            // NAME = expression
+            size_t equal = text.find('=');
+            if (equal != std::string::npos) {
+                std::string name = trim(text.substr(0, equal));
+                bool known;
+                uint16_t v = evaluate(text.substr(equal + 1), uint16_t(pc), known, line);
+                if (!known || name.empty() || labels.count(name)) {
+                    throw asmError(line, "bad constant '" + name + "'");
+                }
+                labels[name] = v;
+                continue;
+            }
+
+            size_t space = text.find_first_of(" \t");
+            statement s;
+            s.Line = line;
+            s.PC = uint16_t(pc);
+            s.Op = upper(text.substr(0, space));
+            s.Operand = space == std::string::npos ? "" : trim(text.substr(space));
+            s.Mode = 0;
+
+            if (s.Op == ".ORG") {
+                bool known;
+                uint16_t target = evaluate(s.Operand, uint16_t(pc), known, line);
+                if (!known || target < pc) {
+                    throw asmError(line, ".org must move forward to a known address");
+                }
+                pc = target;
+            } else if (s.Op == ".BYTE") {
+                pc += splitList(s.Operand).size();
+            } else if (s.Op == ".WORD") {
+                pc += 2 * splitList(s.Operand).size();
+            } else if (!isMnemonic(s.Op)) {
+                throw asmError(line, "unknown instruction '" + s.Op + "'");
+            } else {
+                std::string o = s.Operand;
+                uint8_t opcode;
+                if (findOpcode(s.Op, Relative, opcode)) {
+                    s.Mode = Relative;
+                } else if (o.empty()) {
+                    s.Mode = findOpcode(s.Op, Implied, opcode) ? Implied : Accumulator;
+                } else if (upper(o) == "A") {
+                    s.Mode = Accumulator;
+                    s.Operand = "";
+                } else if (o[0] == '#') {
+                    s.Mode = Immediate;
+                    s.Operand = o.substr(1);
+                } else if (o[0] == '(' && endsWith(o, ",X)")) {
+                    s.Mode = IndexedIndirect;
+                    s.Operand = o.substr(1, o.size() - 4);
+                } else if (o[0] == '(' && endsWith(o, "),Y")) {
+                    s.Mode = IndirectIndexed;
+                    s.Operand = o.substr(1, o.size() - 4);
+                } else if (o[0] == '(' && o[o.size() - 1] == ')') {
+                    s.Mode = Indirect;
+                    s.Operand = o.substr(1, o.size() - 2);
+                } else {
+                    uint8_t index = 0;
+                    if (endsWith(o, ",X") || endsWith(o, ",Y")) {
+                        index = uint8_t(std::toupper(o[o.size() - 1]));
+                        s.Operand = trim(o.substr(0, o.size() - 2));
+                    }
+                    bool known;
+                    uint16_t v = evaluate(s.Operand, uint16_t(pc), known, line);
+                    uint8_t zp = index == 'X' ? ZeroPageX : index == 'Y' ? ZeroPageY : ZeroPage;
+                    uint8_t abs = index == 'X' ? AbsoluteX : index == 'Y' ? AbsoluteY : Absolute;
+                    s.Mode = known && v <= 0xFF && findOpcode(s.Op, zp, opcode) ? zp : abs;
+                }
+                if (!findOpcode(s.Op, s.Mode, opcode)) {
+                    throw asmError(line, "addressing mode not supported by " + s.Op);
+                }
+                pc += instructionSize(s.Mode);
+            }
+            if (pc > 0x10000) {
+                throw asmError(line, "program runs past $FFFF");
+            }
+            statements.push_back(s);
+        }
+
+        // second pass: emit
+        std::vector<uint8_t> out;
+        for (size_t i = 0; i < statements.size(); ++i) {
+            const statement &s = statements[i];
+            bool known;
+            if (s.Op == ".ORG") {
+                out.resize(evaluate(s.Operand, s.PC, known, s.Line) - origin, 0xFF);
+                continue;
+            }
+            if (s.Op == ".BYTE" || s.Op == ".WORD") {
+                std::vector<std::string> items = splitList(s.Operand);
+                for (size_t j = 0; j < items.size(); ++j) {
+                    uint16_t v = evaluate(items[j], s.PC, known, s.Line);
+                    if (!known) {
+                        throw asmError(s.Line, "undefined symbol in '" + items[j] + "'");
+                    }
+                    out.push_back(uint8_t(v & 0xFF));
+                    if (s.Op == ".WORD") {
+                        out.push_back(uint8_t(v >> 8));
+                    }
+                }
+                continue;
+            }
+
+            uint8_t opcode = 0;
+            findOpcode(s.Op, s.Mode, opcode);
+            out.push_back(opcode);
+            uint8_t size = instructionSize(s.Mode);
+            if (size == 1) {
+                continue;
+            }
+
+            uint16_t v = evaluate(s.Operand, s.PC, known, s.Line);
+            if (!known) {
+                throw asmError(s.Line, "undefined symbol in '" + s.Operand + "'");
+            }
+            if (s.Mode == Relative) {
+                int32_t offset = int32_t(v) - int32_t(s.PC + 2);
+                if (offset < -128 || offset > 127) {
+                    throw asmError(s.Line, "branch out of range");
+                }
+                v = uint16_t(offset & 0xFF);
+            } else if (size == 2 && v > 0xFF) {
+                throw asmError(s.Line, "operand does not fit in a byte");
+            }
+            out.push_back(uint8_t(v & 0xFF));
+            if (size == 3) {
+                out.push_back(uint8_t(v >> 8));
+            }
+        }
+        return out;
+    }
+
+    uint16_t Assembler::Label(const std::string &name) const {
+        auto it = labels.find(name);
+        if (it == labels.end()) {
+            throw std::runtime_error("undefined label '" + name + "'");
+        }
+        return it->second;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef NESTAKE_ASSEMBLER
+#define NESTAKE_ASSEMBLER
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace nestake {
+
+    // two-pass assembler for the official 6502 instructions, used to build synthetic programs.
+    //
+    //   PPUSTATUS = $2002      ; constant
+    //   loop:  LDA PPUSTATUS   ; label, operands: #imm zp zp,X abs abs,X (zp,X) (zp),Y (ind) A
+    //          BPL loop
+    //          .org $FFFC      ; skip forward (gap filled with $FF)
+    //          .word loop, $0000
+    //          .byte <loop, >loop, 1, %101
+    //
+    // numbers are decimal, $hex or %binary and expressions are sums/differences of numbers, labels and *.
+    // operands whose value is known when first seen and fits in a byte use zero page addressing.
+    // errors throw std::runtime_error with the line number.
+    class Assembler {
+    private:
+        struct statement;
+
+        std::map<std::string, uint16_t> labels;
+
+        uint16_t evaluate(const std::string &expression, uint16_t pc, bool &known, int line) const;
+    public:
+        // assemble the source to bytes starting at origin
+        std::vector<uint8_t> Assemble(const std::string &source, uint16_t origin);
+
+        // address of the label (or value of the constant) defined by the last assembled source
+        uint16_t Label(const std::string &name) const;
+    };
+}
+
+#endif
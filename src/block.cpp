@@ -0,0 +1,9 @@
+#include "block.hpp"
+
+namespace nestake {
+
+    BlockCache::BlockCache(size_t prgSize) {
+        DecodedInstruction empty = {};
+        Instructions.assign(prgSize, empty);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef NESTAKE_BLOCK
+#define NESTAKE_BLOCK
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace nestake {
+    class Cpu;
+
+    // handler of an instruction: (resolved address, is accumulator mode)
+    typedef void (Cpu::*instructionExecutor)(uint16_t, bool);
+
+    // instruction decoded once from PRG-ROM
+    struct DecodedInstruction {
+        // handler of the instruction (nullptr for unsupported opcodes)
+        instructionExecutor Executor;
+
+        // raw operand bytes (little endian, zero-filled up to 2 bytes)
+        uint16_t Operand;
+
+        // opcode byte
+        uint8_t Opcode;
+
+        // instruction's id
+        uint8_t ID;
+
+        // addressing mode
+        uint8_t AddressingMode;
+
+        // the size of the instruction in byte
+        uint8_t InstructionSizes;
+
+        // the number of cycles used by the instruction
+        uint8_t InstructionCycle;
+
+        // the number of page cycles used by the instruction
+        uint8_t PageCycle;
+
+        // number of instructions (including this one) until the end of its basic block
+        uint8_t BlockLength;
+
+        // sum of InstructionCycle over the rest of the basic block
+        uint16_t BlockCycles;
+
+        // superinstruction formed with the following instruction (see fusion.hpp)
+        uint8_t Fusion;
+    };
+
+    // decoded PRG-ROM indexed by PRG offset, so every bank keeps its own entries.
+    // it is immutable once built and shared by all the consoles running the same cartridge.
+    class BlockCache {
+    public:
+        explicit BlockCache(size_t prgSize);
+
+        // one entry per PRG-ROM byte
+        std::vector<DecodedInstruction> Instructions;
+
+        const DecodedInstruction &At(uint32_t prgOffset) const {
+            return Instructions[prgOffset];
+        }
+    };
+}
+
+#endif
@@ -1,13 +1,172 @@
-#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
 #include "console.hpp"
 
 namespace nestake {
 
+    template <typename Mapper>
+    void Console::bind() {
+        std::shared_ptr<BasicConsole<Mapper>> c = std::make_shared<BasicConsole<Mapper>>(Cartridge);
+        CPU = std::shared_ptr<nestake::Cpu>(c, &c->CPU);
+        basic = c;
+        static const basicOperations operations = {
+            [](void *self) { return static_cast<BasicConsole<Mapper> *>(self)->Step(); },
+            [](void *self) { return static_cast<BasicConsole<Mapper> *>(self)->StepCPU(); },
+            [](void *self, uint64_t cycles) { static_cast<BasicConsole<Mapper> *>(self)->TickPPU(cycles); },
+            [](void *self, const ResetOptions &options) { static_cast<BasicConsole<Mapper> *>(self)->Reset(options); },
+            [](void *self, ConsoleState &state) { static_cast<BasicConsole<Mapper> *>(self)->Save(state); },
+            [](void *self, const Predicate &predicate, uint64_t maxCycles) {
+                return static_cast<BasicConsole<Mapper> *>(self)->RunUntil(predicate, maxCycles);
+            },
+        };
+        ops = &operations;
+    }
+
+    Console::Console(std::shared_ptr<nestake::Cartridge> cartridge):
+        Cartridge(std::move(cartridge)), ops(nullptr) {
+        switch (Cartridge->Mapper) {
+            case NROM::ID:
+                bind<NROM>();
+                break;
+            case CNROM::ID:
+                bind<CNROM>();
+                break;
+            default:
+                throw std::runtime_error("unsupported mapper " + std::to_string(Cartridge->Mapper));
+        }
+#ifdef NESTAKE_COUNTERS
+        counters = CounterSnapshot();
+        cpuBase = CounterSnapshot();
+        published = CounterSnapshot();
+#endif
+    }
+
+#ifdef NESTAKE_COUNTERS
+    // host nanoseconds from the start to the end
+    static uint64_t nanosecondsBetween(std::chrono::steady_clock::time_point start,
+                                       std::chrono::steady_clock::time_point end) {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    // host nanoseconds since the start
+    static uint64_t nanosecondsSince(std::chrono::steady_clock::time_point start) {
+        return nanosecondsBetween(start, std::chrono::steady_clock::now());
+    }
+
+    CounterSnapshot Console::Counters() const {
+        CounterSnapshot s = counters;
+        s.Cycles += CPU->Cycles - cpuBase.Cycles;
+        s.Instructions += CPU->Instructions - cpuBase.Instructions;
+        s.Frames += frame() - cpuBase.Frames;
+        s.DMAStallCycles += CPU->StallCycles - cpuBase.DMAStallCycles;
+        return s;
+    }
+
+    void Console::PublishCounters() {
+        CounterSnapshot current = Counters();
+        GlobalCounters().Add(current - published);
+        published = current;
+    }
+#endif
+
+    uint64_t Console::step() {
+        return ops != nullptr ? ops->Step(basic.get()) : CPU->Step();
+    }
+
     void Console::Step() {
-        uint64_t cpuCycle = CPU->Step();
-        std::cout << "cpu cycle: " << cpuCycle << "\n";
+#ifdef NESTAKE_COUNTERS
+        // reading the clock costs about as much as a step, so only a sample of the steps is timed.
+        // the cpu and the PPU of a BasicConsole are timed apart
+        if (counters.SchedulerEvents % sampleInterval == 0) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (ops != nullptr) {
+                uint64_t cycles = ops->StepCPU(basic.get());
+                std::chrono::steady_clock::time_point ppuStart = std::chrono::steady_clock::now();
+                counters.CPUNanoseconds += nanosecondsBetween(start, ppuStart) * sampleInterval;
+                ops->TickPPU(basic.get(), cycles);
+                counters.PPUNanoseconds += nanosecondsSince(ppuStart) * sampleInterval;
+            } else {
+                CPU->Step();
+                counters.CPUNanoseconds += nanosecondsSince(start) * sampleInterval;
+            }
+        } else {
+            step();
+        }
+        ++counters.SchedulerEvents;
+#else
+        step();
+#endif
+    }
+
+    void Console::Reset(const ResetOptions &options) {
+#ifdef NESTAKE_COUNTERS
+        // the cpu rewinds its counters: keep what they counted so far
+        counters = Counters();
+#endif
+        if (ops != nullptr) {
+            ops->Reset(basic.get(), options);
+        } else {
+            CPUMemory &bus = *CPU->mem;
+            if (bus.SRAM != nullptr) {
+                bus.SRAM->Flush();
+            }
+            if (options.State != nullptr) {
+                bus.LoadState(*options.State);
+                CPU->LoadState(*options.State);
+            } else {
+                bus.PowerOn();
+                CPU->Reset();
+            }
+        }
+#ifdef NESTAKE_COUNTERS
+        cpuBase.Cycles = CPU->Cycles;
+        cpuBase.Instructions = CPU->Instructions;
+        cpuBase.Frames = frame();
+        cpuBase.DMAStallCycles = CPU->StallCycles;
+#endif
+    }
+
+    void Console::Save(ConsoleState &state) {
+        if (ops != nullptr) {
+            ops->Save(basic.get(), state);
+            return;
+        }
+        CPU->mem->SaveState(state);
+        CPU->SaveState(state);
+    }
+
+    bool Console::RunUntil(const Predicate &predicate, uint64_t maxCycles) {
+        if (ops != nullptr) {
+            return ops->RunUntil(basic.get(), predicate, maxCycles);
+        }
+        nestake::Cpu &cpu = *CPU;
+        return nestake::RunUntil(cpu, *cpu.mem, predicate, maxCycles, [&cpu]() { return cpu.Step(); });
+    }
+
+    ConsolePool::ConsolePool(std::shared_ptr<nestake::Cartridge> cartridge, size_t size):
+        cartridge(std::move(cartridge)) {
+        available.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            available.push_back(std::unique_ptr<Console>(new Console(this->cartridge)));
+        }
+    }
+
+    std::unique_ptr<Console> ConsolePool::Acquire(const ResetOptions &options) {
+        std::unique_ptr<Console> console;
+        if (available.empty()) {
+            console.reset(new Console(cartridge));
+        } else {
+            console = std::move(available.back());
+            available.pop_back();
+        }
+        console->Reset(options);
+        return console;
+    }
 
-        // TODO: implement {PPU|Mapper|APU}.Step()
+    void ConsolePool::Release(std::unique_ptr<Console> console) {
+        available.push_back(std::move(console));
     }
 }
@@ -1,25 +1,211 @@
 #ifndef CONSOLE_CPU
 #define CONSOLE_CPU
 
+#include <cstring>
 #include <utility>
+#include <vector>
+#include "counters.hpp"
 #include "cpu.hpp"
 #include "ines.hpp"
+#include "mapper.hpp"
+#include "memory.hpp"
+#include "ppu.hpp"
+#include "predicate.hpp"
+#include "state.hpp"
 
 namespace nestake {
-    class Console {
-        std::shared_ptr<nestake::Cpu> CPU;
+    // how Reset restarts a console
+    struct ResetOptions {
+        // state to restore, power-on state when nullptr
+        const ConsoleState *State = nullptr;
+    };
+
+    // console of a cartridge using the Mapper. the units are members instead of shared
+    // objects, so a console is one allocation and the mapper is called without indirection
+    template <typename Mapper>
+    class BasicConsole {
+    private:
+        static void mapperWrite(void *self, uint16_t address, uint8_t value) {
+            BasicConsole *c = static_cast<BasicConsole *>(self);
+            c->Map.Write(c->Bus, c->PPU.Memory(), address, value);
+        }
+    public:
+        CPUMemory Bus;
+        nestake::PPU PPU;
+        Mapper Map;
+        nestake::Cpu CPU;
         std::shared_ptr<nestake::Cartridge> Cartridge;
-        // PPU
         // APU
         // controller1
         // controller2
-        // Mapper
+
+        // the units reach each other through shared_ptrs that do not own the members
+        explicit BasicConsole(std::shared_ptr<nestake::Cartridge> cartridge):
+            Bus(), CPU(std::shared_ptr<CPUMemory>(std::shared_ptr<CPUMemory>(), &Bus)),
+            Cartridge(std::move(cartridge)) {
+            Bus.PPU = std::shared_ptr<nestake::PPU>(std::shared_ptr<nestake::PPU>(), &PPU);
+            Bus.MapperWrite = mapperWrite;
+            Bus.Mapper = this;
+            PPU.LoadCartridge(Cartridge);
+            Map.Reset(Bus, PPU.Memory());
+            CPU.LoadCartridge(Cartridge);
+        }
+        BasicConsole(const BasicConsole &) = delete;
+        BasicConsole &operator=(const BasicConsole &) = delete;
+
+        // one step forward: the cpu, then the PPU for 3 dots per cpu cycle (there is no APU)
+        uint64_t Step() {
+            uint64_t cycles = StepCPU();
+            TickPPU(cycles);
+            return cycles;
+        }
+
+        // the cpu half of Step. compiled blocks and idle loops end before vblank, so the NMI is not delayed
+        uint64_t StepCPU() {
+            CPU.CycleDeadline = CPU.Cycles + (PPU.DotsToVBlank() + 2)/3;
+            return CPU.Step();
+        }
+
+        // the PPU half of Step, after the cpu ran the cycles
+        void TickPPU(uint64_t cycles) {
+            if (PPU.Tick(3*cycles)) {
+                CPU.TriggerNMI();
+            }
+        }
+
+        // restart in place, keeping the cartridge, its decoded PRG-ROM and compiled code.
+        // the dirty pages of a save file start being written back (see CPUMemory::PowerOn)
+        void Reset(const ResetOptions &options = ResetOptions()) {
+            if (Bus.SRAM != nullptr) {
+                Bus.SRAM->Flush();
+            }
+            if (options.State != nullptr) {
+                Bus.LoadState(*options.State);
+                PPU.LoadState(*options.State);
+                CPU.LoadState(*options.State);
+                return;
+            }
+            Bus.PowerOn();
+            PPU.PowerOn();
+            Map.Reset(Bus, PPU.Memory());
+            CPU.Reset();
+        }
+
+        void Save(ConsoleState &state) {
+            Bus.SaveState(state);
+            PPU.SaveState(state);
+            CPU.SaveState(state);
+        }
+
+        // step until the predicate holds or maxCycles cycles ran (see nestake::RunUntil)
+        bool RunUntil(const Predicate &predicate, uint64_t maxCycles) {
+            return nestake::RunUntil(CPU, Bus, predicate, maxCycles, [this]() { return Step(); });
+        }
+    };
+
+    // console hiding the mapper: a BasicConsole picked by the cartridge's mapper,
+    // or a cpu given by the caller
+    class Console {
+        std::shared_ptr<nestake::Cpu> CPU;
+        std::shared_ptr<nestake::Cartridge> Cartridge;
+
+        // BasicConsole<Mapper> and its operations, nullptr around a given cpu
+        struct basicOperations {
+            uint64_t (*Step)(void *);
+            uint64_t (*StepCPU)(void *);
+            void (*TickPPU)(void *, uint64_t);
+            void (*Reset)(void *, const ResetOptions &);
+            void (*Save)(void *, ConsoleState &);
+            bool (*RunUntil)(void *, const Predicate &, uint64_t);
+        };
+        std::shared_ptr<void> basic;
+        const basicOperations *ops;
+
+        template <typename Mapper>
+        void bind();
+
+        // one cpu step of the BasicConsole or of the given cpu
+        uint64_t step();
+
+#ifdef NESTAKE_COUNTERS
+        // host time and scheduler events, and the emulated work counted before the last Reset;
+        // the work since then is read from the units
+        CounterSnapshot counters;
+
+        // cpu counters and PPU::Frame right after the last Reset, which can rewind them
+        CounterSnapshot cpuBase;
+
+        // PPU::Frame, 0 around a given cpu without a PPU
+        uint64_t frame() const { return CPU->mem->PPU != nullptr ? CPU->mem->PPU->Frame : 0; }
+
+        // counters already added to GlobalCounters()
+        CounterSnapshot published;
+
+        // one Step in sampleInterval is timed, and stands for the others
+        static const uint64_t sampleInterval = 64;
+#endif
     public:
         Console(std::shared_ptr<nestake::Cpu> cpu, std::shared_ptr<nestake::Cartridge> cartridge
-        ): CPU(std::move(cpu)), Cartridge(std::move(cartridge)) {};
+        ): CPU(std::move(cpu)), Cartridge(std::move(cartridge)), ops(nullptr) {
+            CPU->LoadCartridge(Cartridge);
+#ifdef NESTAKE_COUNTERS
+            counters = CounterSnapshot();
+            cpuBase = CounterSnapshot();
+            published = CounterSnapshot();
+#endif
+        };
+
+        // BasicConsole of the cartridge's mapper; throws std::runtime_error for unsupported mappers
+        explicit Console(std::shared_ptr<nestake::Cartridge> cartridge);
+
+        nestake::Cpu &Processor() { return *CPU; }
+
+#ifdef NESTAKE_COUNTERS
+        ~Console() {
+            PublishCounters();
+        }
+
+        // counters of this console
+        CounterSnapshot Counters() const;
+
+        // add what was counted since the last call to GlobalCounters()
+        void PublishCounters();
+#endif
 
         // one step forward
         void Step();
+
+        // restart in place without allocating. around a given cpu only the cpu, RAM and SRAM are restored
+        void Reset(const ResetOptions &options = ResetOptions());
+
+        // state of the console (the cpu, RAM and SRAM around a given cpu)
+        void Save(ConsoleState &state);
+
+        // keep the SRAM of this console in the file, e.g. Cartridge::SavePath (battery cartridges only).
+        // false if the file cannot be mapped
+        bool MapSaveFile(const std::string &path) { return CPU->mem->MapSaveFile(path); }
+
+        // step until the predicate holds or maxCycles cycles ran; whether it holds
+        bool RunUntil(const Predicate &predicate, uint64_t maxCycles);
+    };
+
+    // consoles of one cartridge kept for short runs: Acquire restarts a released console
+    // in place instead of building a new one
+    class ConsolePool {
+        std::shared_ptr<nestake::Cartridge> cartridge;
+        std::vector<std::unique_ptr<Console>> available;
+    public:
+        // build `size` consoles up front
+        explicit ConsolePool(std::shared_ptr<nestake::Cartridge> cartridge, size_t size = 0);
+
+        // a console reset by the options
+        std::unique_ptr<Console> Acquire(const ResetOptions &options = ResetOptions());
+
+        // give a console back for reuse
+        void Release(std::unique_ptr<Console> console);
+
+        // number of consoles ready to be acquired
+        size_t Available() const { return available.size(); }
     };
 }
 
@@ -0,0 +1,63 @@
+#include "counters.hpp"
+
+namespace nestake {
+
+    // fields in the order of CounterAggregate::values
+    static uint64_t CounterSnapshot::* const counterFields[] = {
+        &CounterSnapshot::Cycles,
+        &CounterSnapshot::Instructions,
+        &CounterSnapshot::Frames,
+        &CounterSnapshot::CPUNanoseconds,
+        &CounterSnapshot::PPUNanoseconds,
+        &CounterSnapshot::APUNanoseconds,
+        &CounterSnapshot::MapperNanoseconds,
+        &CounterSnapshot::DMAStallCycles,
+        &CounterSnapshot::SchedulerEvents,
+    };
+
+    static const int numCounterFields = sizeof(counterFields) / sizeof(counterFields[0]);
+
+    CounterSnapshot &CounterSnapshot::operator+=(const CounterSnapshot &other) {
+        for (int i = 0; i < numCounterFields; ++i) {
+            this->*counterFields[i] += other.*counterFields[i];
+        }
+        return *this;
+    }
+
+    CounterSnapshot CounterSnapshot::operator-(const CounterSnapshot &other) const {
+        CounterSnapshot s = *this;
+        for (int i = 0; i < numCounterFields; ++i) {
+            s.*counterFields[i] -= other.*counterFields[i];
+        }
+        return s;
+    }
+
+    CounterAggregate::CounterAggregate() {
+        Clear();
+    }
+
+    void CounterAggregate::Add(const CounterSnapshot &delta) {
+        for (int i = 0; i < fields; ++i) {
+            values[i].fetch_add(delta.*counterFields[i], std::memory_order_relaxed);
+        }
+    }
+
+    CounterSnapshot CounterAggregate::Snapshot() const {
+        CounterSnapshot s = {};
+        for (int i = 0; i < fields; ++i) {
+            s.*counterFields[i] = values[i].load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    void CounterAggregate::Clear() {
+        for (int i = 0; i < fields; ++i) {
+            values[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    CounterAggregate &GlobalCounters() {
+        static CounterAggregate global;
+        return global;
+    }
+}
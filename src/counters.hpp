@@ -0,0 +1,52 @@
+#ifndef NESTAKE_COUNTERS_SNAPSHOT
+#define NESTAKE_COUNTERS_SNAPSHOT
+
+#include <atomic>
+#include <stdint.h>
+
+namespace nestake {
+
+    // host side performance counters of a console, or of all the consoles of the process.
+    // consoles only keep them in builds with NESTAKE_COUNTERS.
+    struct CounterSnapshot {
+        // emulated work
+        uint64_t Cycles;
+        uint64_t Instructions;
+        uint64_t Frames;
+
+        // host time spent in each unit, estimated from a sample of the steps.
+        // there is no APU yet, and the mapper runs within the cpu's bus writes, so
+        // APUNanoseconds and MapperNanoseconds stay 0 and that time is in CPUNanoseconds
+        uint64_t CPUNanoseconds;
+        uint64_t PPUNanoseconds;
+        uint64_t APUNanoseconds;
+        uint64_t MapperNanoseconds;
+
+        // cpu cycles stalled by DMA
+        uint64_t DMAStallCycles;
+
+        // units dispatched by Console::Step
+        uint64_t SchedulerEvents;
+
+        CounterSnapshot &operator+=(const CounterSnapshot &other);
+        CounterSnapshot operator-(const CounterSnapshot &other) const;
+    };
+
+    // sum of the counters published by every console, safe to update and read from any thread
+    class CounterAggregate {
+    private:
+        static const int fields = 9;
+        std::atomic<uint64_t> values[fields];
+    public:
+        CounterAggregate();
+
+        void Add(const CounterSnapshot &delta);
+        CounterSnapshot Snapshot() const;
+        void Clear();
+    };
+
+    // aggregate of the whole process
+    CounterAggregate &GlobalCounters();
+}
+
+#endif
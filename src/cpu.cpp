@@ -1,62 +1,51 @@
-#include <iostream>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
 #include <string>
 
 #include "cpu.hpp"
+#include "fusion.hpp"
+#include "jit.hpp"
+#include "profiler.hpp"
+#include "state.hpp"
+#include "trace.hpp"
 
 using std::array;
-using std::cout;
 using std::map;
 using std::string;
 
 namespace nestake {
-    // addressing mode
-    enum AddressingMode {
-        Absolute = 1, AbsoluteX, AbsoluteY, Accumulator, Immediate,
-        Implied, IndexedIndirect, Indirect, IndirectIndexed, Relative,
-        ZeroPage, ZeroPageX, ZeroPageY
-    };
-
     // type of interruption
     enum InterruptType {
         interruptNone = 1, interruptNMI, interruptIRQ,
     };
 
-    // instructions's identifier supposed to be used in debugging
-    enum InstructionID {
-        ADC = 1, AHX, ALR, ANC, AND, ARR, ASL, AXS, BCC, BCS, BEQ, BIT, BMI,
-        BNE, BPL, BRK, BVC, BVS, CLC, CLD, CLI, CLV, CMP, CPX, CPY, DCP, DEC,
-        DEX, DEY, EOR, INC, INX, INY, ISC, JMP, JSR, KIL, LAS, LAX, LDA, LDX,
-        LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, RLA, ROL, ROR, RRA, RTI, RTS,
-        SAX, SBC, SEC, SED, SEI, SHX, SHY, SLO, SRE, STA, STX, STY, TAS, TAX,
-        TAY, TSX, TXA, TXS, TYA, XAA,
-    };
-
     bool isPageCrossed(uint16_t a, uint16_t b) {
         return (a&0xFF00) != (b&0xFF00);
     }
 
+    // destination of a branch whose next instruction is at pc
+    uint16_t relativeTarget(uint16_t pc, uint16_t offset) {
+        if (offset < 0x80) {
+            return pc + offset;
+        }
+        return pc + offset - uint16_t(0x100);
+    }
+
     // ADC instruction
     void Cpu::ExecADC(uint16_t address, bool){
         uint8_t a = A;
         uint8_t b = mem->Read(address);
-        A = a + b + C;
+        uint8_t c = flagC();
+        A = a + b + c;
 
         // set Z & N flags
         setZN(A);
 
-        // set carry flag
-        if ((int(a) + int(b) + int(C)) > 0xFF) {
-            C = 1;
-        } else {
-            C = 0;
-        }
-
-        // set overflow flag
-        if ((((a^b)&0x80) == 0) && (((a^A)&0x80) != 0)){
-            V = 1;
-        } else {
-            V = 0;
-        }
+        // set carry and overflow flags
+        uint8_t carry = (int(a) + int(b) + int(c)) > 0xFF;
+        uint8_t overflow = (((a^b)&0x80) == 0) && (((a^A)&0x80) != 0);
+        P = uint8_t((P & ~0x41) | carry | overflow << 6);
     }
 
     // AND instruction
@@ -69,12 +58,12 @@ namespace nestake {
     // ASL instruction
     void Cpu::ExecASL(uint16_t address, bool is_accumulator){
         if (is_accumulator) {
-            C = (A >> 7) & uint8_t(1);
+            setFlagC((A >> 7) & uint8_t(1));
             A <<= 1;
             setZN(A);
         } else {
             uint8_t v = mem->Read(address);
-            C = (v >> 7) & uint8_t(1);
+            setFlagC((v >> 7) & uint8_t(1));
             v <<= 1;
             mem->Write(address, v);
             setZN(v);
@@ -83,7 +72,7 @@ namespace nestake {
 
     // BCC instruction
     void Cpu::ExecBCC(uint16_t address, bool){
-        if (C == 0) {
+        if (flagC() == 0) {
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -94,7 +83,7 @@ namespace nestake {
 
     // BCS instruction
     void Cpu::ExecBCS(uint16_t address, bool){
-        if (C != 0) {
+        if (flagC() != 0) {
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -105,7 +94,7 @@ namespace nestake {
 
     // BEQ instruction
     void Cpu::ExecBEQ(uint16_t address, bool){
-        if (Z != 0) {
+        if (flagZ() != 0) {
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -118,13 +107,13 @@ namespace nestake {
     void Cpu::ExecBIT(uint16_t address, bool){
         uint8_t v = mem->Read(address);
         setZ(v & A);
-        V = (v >> 6) & uint8_t(1);
+        setFlagV((v >> 6) & uint8_t(1));
         setN((v >> 7) & uint8_t(1));
     };
 
     // BMI params
     void Cpu::ExecBMI(uint16_t address, bool){
-        if (N != 0){
+        if (flagN() != 0){
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -135,7 +124,7 @@ namespace nestake {
 
     // BNE operation
     void Cpu::ExecBNE(uint16_t address, bool){
-        if (Z == 0) {
+        if (flagZ() == 0) {
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -146,7 +135,7 @@ namespace nestake {
 
     // BPL operation
     void Cpu::ExecBPL(uint16_t address, bool){
-        if (N == 0) {
+        if (flagN() == 0) {
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -165,7 +154,7 @@ namespace nestake {
 
     // BVC instruction
     void Cpu::ExecBVC(uint16_t address, bool){
-        if (V == 0) {
+        if (flagV() == 0) {
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -176,7 +165,7 @@ namespace nestake {
 
     // BVS instruction
     void Cpu::ExecBVS(uint16_t address, bool){
-        if (V != 0) {
+        if (flagV() != 0) {
             if (isPageCrossed(PC, address)) {
                 ++Cycles;
             }
@@ -187,22 +176,22 @@ namespace nestake {
 
     // CLC instruction
     void Cpu::ExecCLC(uint16_t, bool){
-        C = 0;
+        setFlagC(0);
     };
 
     // CLD instruction
     void Cpu::ExecCLD(uint16_t, bool){
-        D = 0;
+        setFlagD(0);
     };
 
     // CLI instruction
     void Cpu::ExecCLI(uint16_t, bool){
-        I = 0;
+        setFlagI(0);
     };
 
     // CLV instruction
     void Cpu::ExecCLV(uint16_t, bool){
-        V = 0;
+        setFlagV(0);
     };
 
     // CMP instruction
@@ -299,18 +288,22 @@ namespace nestake {
     // LSR operation
     void Cpu::ExecLSR(uint16_t address, bool is_accumulator){
         if (is_accumulator) {
-            C = A & uint8_t(1);
+            setFlagC(A & uint8_t(1));
             A >>= 1;
             setZN(A);
         } else {
             uint8_t v = mem->Read(address);
-            C = v & uint8_t(1);
+            setFlagC(v & uint8_t(1));
             v >>= 1;
             mem->Write(address, v);
             setZN(v);
         }
     };
 
+    // NOP operation
+    void Cpu::ExecNOP(uint16_t, bool){
+    };
+
     // ORA operation
     void Cpu::ExecORA(uint16_t address, bool){
         A = A | mem->Read(address);
@@ -341,14 +334,14 @@ namespace nestake {
     // ROL operation
     void Cpu::ExecROL(uint16_t address, bool is_accumulator){
         if (is_accumulator) {
-            uint8_t prev_c = C;
-            C = (A >> 7) & uint8_t(1);
+            uint8_t prev_c = flagC();
+            setFlagC((A >> 7) & uint8_t(1));
             A = (A << 1) | prev_c;
             setZN(A);
         } else {
-            uint8_t prev_c = C;
+            uint8_t prev_c = flagC();
             uint8_t v = mem->Read(address);
-            C = (v >> 7) & uint8_t(1);
+            setFlagC((v >> 7) & uint8_t(1));
             v = (v << 1) | prev_c;
             mem->Write(address, v);
             setZN(v);
@@ -358,14 +351,14 @@ namespace nestake {
     // ROR operation
     void Cpu::ExecROR(uint16_t address, bool is_accumulator){
         if (is_accumulator) {
-            uint8_t prev_c = C;
-            C = A & uint8_t(1);
+            uint8_t prev_c = flagC();
+            setFlagC(A & uint8_t(1));
             A = (A >> 1) | (prev_c << 7);
             setZN(A);
         } else {
-            uint8_t prev_c = C;
+            uint8_t prev_c = flagC();
             uint8_t v = mem->Read(address);
-            C = v & uint8_t(1);
+            setFlagC(v & uint8_t(1));
             v = (v >> 1) | (prev_c << 7);
             mem->Write(address, v);
             setZN(v);
@@ -387,37 +380,29 @@ namespace nestake {
     void Cpu::ExecSBC(uint16_t address, bool){
         uint8_t prev_a = A;
         uint8_t b = mem->Read(address);
-        uint8_t prev_c = C;
+        uint8_t prev_c = flagC();
 
         A = prev_a - b - (uint8_t(1) - prev_c);
         setZN(A);
 
-        if ((int(prev_a) - int(b) - (1 - prev_c)) >= 0) {
-            C = 1;
-        } else {
-            C = 0;
-        }
-
-        if ((((prev_a^b)&uint8_t(0x80)) != 0) && ((prev_a^A)&uint8_t(0x80))!= 0) {
-            V = 1;
-        } else {
-            V = 0;
-        }
+        uint8_t carry = (int(prev_a) - int(b) - (1 - prev_c)) >= 0;
+        uint8_t overflow = (((prev_a^b)&uint8_t(0x80)) != 0) && ((prev_a^A)&uint8_t(0x80))!= 0;
+        P = uint8_t((P & ~0x41) | carry | overflow << 6);
     };
 
     // SEC operation
     void Cpu::ExecSEC(uint16_t, bool){
-        C = 1;
+        setFlagC(1);
     };
 
     // SED operation
     void Cpu::ExecSED(uint16_t, bool){
-        D = 1;
+        setFlagD(1);
     };
 
     // SEI operation
     void Cpu::ExecSEI(uint16_t, bool){
-        I = 1;
+        setFlagI(1);
     };
 
     // STA operation
@@ -495,58 +480,20 @@ namespace nestake {
         push(uint8_t(v & 0xFF));
     }
 
-    void Cpu::setN(uint8_t v) {
-        if (v != 0) {
-            N = 1;
-        } else {
-            N = 0;
-        }
-    }
-
-    void Cpu::setZ(uint8_t v) {
-        if (v == 0) {
-            Z = 1;
-        } else {
-            Z = 0;
-        }
-    }
-
-    void Cpu::setZN(uint8_t v) {
-        setZ(v);
-        setN(v);
-    }
-
     void Cpu::compare(uint8_t a, uint8_t b) {
         setZN(a-b);
-        if (a >= b) {
-            C = 1;
-        } else {
-            C = 0;
-        }
+        setFlagC(a >= b);
     }
 
     void Cpu::setFlags(uint8_t flag) {
-        C = flag & uint8_t(1);
-        Z = (flag >> 1) & uint8_t(1);
-        I = (flag >> 2) & uint8_t(1);
-        D = (flag >> 3) & uint8_t(1);
-        B = (flag >> 4) & uint8_t(1);
-        U = (flag >> 5) & uint8_t(1);
-        V = (flag >> 6) & uint8_t(1);
-        N = (flag >> 7) & uint8_t(1);
+        P = flag & uint8_t(0x7D);
+        setFlagZ((flag >> 1) & uint8_t(1));
+        setFlagN((flag >> 7) & uint8_t(1));
     }
 
 
     uint8_t Cpu::getFlag() {
-        uint8_t flag = C;
-        flag |= Z << 1;
-        flag |= I << 2;
-        flag |= D << 3;
-        flag |= B << 4;
-        flag |= U << 5;
-        flag |= V << 6;
-        flag |= N << 7;
-        return flag;
+        return uint8_t(P | flagZ() << 1 | flagN() << 7);
     }
 
     uint8_t Cpu::pull() {
@@ -565,24 +512,43 @@ namespace nestake {
         A = 0;
         X = 0;
         Y = 0;
-        C = 0;
-        Z = 0;
-        I = 0;
-        D = 0;
-        B = 0;
-        U = 0;
-        V = 0;
-        N = 0;
+        P = 0;
+        setFlagZ(0);
+        setFlagN(0);
         Interrupt = 0;
         Stall = 0;
 
-        PC = mem->Read(0xFFFC);
+        PC = read16(0xFFFC);
         SP = 0xFD;
         setFlags(0x24);
     }
 
+    void Cpu::SaveState(ConsoleState &state) {
+        state.Cycles = Cycles;
+        state.Stall = Stall;
+        state.PC = PC;
+        state.SP = SP;
+        state.A = A;
+        state.X = X;
+        state.Y = Y;
+        state.P = getFlag();
+        state.Interrupt = Interrupt;
+    }
+
+    void Cpu::LoadState(const ConsoleState &state) {
+        Cycles = state.Cycles;
+        Stall = state.Stall;
+        PC = state.PC;
+        SP = state.SP;
+        A = state.A;
+        X = state.X;
+        Y = state.Y;
+        setFlags(state.P);
+        Interrupt = state.Interrupt;
+    }
+
     void Cpu::TriggerIRQ() {
-        if (I == 0) {
+        if (flagI() == 0) {
             Interrupt = interruptIRQ;
         }
     }
@@ -596,7 +562,7 @@ namespace nestake {
         push16(PC);
         ExecPHP(0, false);
         PC = read16(0xFFFE);
-        I = 1;
+        setFlagI(1);
         Cycles += 7;
     }
 
@@ -604,15 +570,286 @@ namespace nestake {
         push16(PC);
         ExecPHP(0, false);
         PC = read16(0xFFFA);
-        I = 1;
+        setFlagI(1);
         Cycles += 7;
     }
 
+    DecodedInstruction Cpu::Decode(uint8_t op, uint16_t operand) {
+        DecodedInstruction d = {};
+        d.Opcode = op;
+        d.Operand = operand;
+
+        const instructionParams &inst = instructionTable()[op];
+        if (inst.executor != nullptr) {
+            d.Executor = inst.executor;
+            d.ID = inst.ID;
+            d.AddressingMode = inst.AddressingMode;
+            d.InstructionSizes = inst.InstructionSizes;
+            d.InstructionCycle = inst.InstructionCycle;
+            d.PageCycle = inst.PageCycle;
+        }
+
+        // only the operand bytes actually belonging to the instruction are kept
+        if (d.InstructionSizes < 3) {
+            d.Operand &= 0x00FF;
+        }
+        if (d.InstructionSizes < 2) {
+            d.Operand = 0;
+        }
+        d.BlockLength = 1;
+        d.BlockCycles = d.InstructionCycle;
+        return d;
+    }
+
+    // whether the instruction ends a basic block
+    bool isBlockTerminator(const DecodedInstruction &d) {
+        if (d.Executor == nullptr || d.AddressingMode == Relative) {
+            return true;
+        }
+        switch (d.ID) {
+            case BRK: case JMP: case JSR: case RTI: case RTS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    std::shared_ptr<BlockCache> Cpu::decodePRG(const std::vector<uint8_t> &prg) {
+        size_t size = prg.size();
+        std::shared_ptr<BlockCache> cache(std::make_shared<BlockCache>(size));
+
+        // every offset is decoded since any of them can be a jump target
+        for (size_t i = 0; i < size; ++i) {
+            uint16_t operand = prg[(i + 1) % size] | uint16_t(prg[(i + 2) % size] << 8);
+            cache->Instructions[i] = Decode(prg[i], operand);
+        }
+
+        // link instructions into basic blocks from the end of PRG-ROM
+        for (size_t i = size; i-- > 0;) {
+            DecodedInstruction &d = cache->Instructions[i];
+            if (d.ID == JMP && d.AddressingMode == Absolute && d.Operand >= 0x8000 && (d.Operand - 0x8000u) % size == i) {
+                // idle loop, Step checks that it jumps to itself under the current mapping
+                d.Fusion = fuseJMPSelf;
+            }
+            size_t next = i + d.InstructionSizes;
+            if (isBlockTerminator(d) || next >= size) {
+                continue;
+            }
+            const DecodedInstruction &n = cache->Instructions[next];
+            if (n.BlockLength < 0xFF) {
+                d.BlockLength = uint8_t(n.BlockLength + 1);
+                d.BlockCycles = uint16_t(n.BlockCycles + d.InstructionCycle);
+            }
+            d.Fusion = FusedPairOf(d, n);
+        }
+        return cache;
+    }
+
+    void Cpu::execFused(const DecodedInstruction &first, const DecodedInstruction &second) {
+        if (first.Fusion == fuseJMPSelf) {
+            PC = first.Operand;
+            Cycles += 3*first.InstructionCycle;
+            return;
+        }
+
+        uint16_t pc = PC;
+        PC += first.InstructionSizes + second.InstructionSizes;
+        Cycles += first.InstructionCycle + second.InstructionCycle;
+
+        switch (first.Fusion) {
+            case fuseDEXBNE:
+                ExecDEX(0, false);
+                ExecBNE(relativeTarget(PC, second.Operand), false);
+                break;
+            case fuseDEYBNE:
+                ExecDEY(0, false);
+                ExecBNE(relativeTarget(PC, second.Operand), false);
+                break;
+            case fuseINXBNE:
+                ExecINX(0, false);
+                ExecBNE(relativeTarget(PC, second.Operand), false);
+                break;
+            case fuseINYBNE:
+                ExecINY(0, false);
+                ExecBNE(relativeTarget(PC, second.Operand), false);
+                break;
+            case fuseLDASTA:
+                ExecLDA(first.Operand, false);
+                ExecSTA(second.Operand, false);
+                break;
+            case fuseINCLDA:
+                ExecINC(first.Operand, false);
+                ExecLDA(second.Operand, false);
+                break;
+            case fuseCMPBEQ:
+                ExecCMP(pc + uint16_t(1), false);
+                ExecBEQ(relativeTarget(PC, second.Operand), false);
+                break;
+            case fuseCMPBNE:
+                ExecCMP(pc + uint16_t(1), false);
+                ExecBNE(relativeTarget(PC, second.Operand), false);
+                break;
+            default: {}
+        }
+    }
+
+    void Cpu::LoadCartridge(std::shared_ptr<Cartridge> cartridge) {
+        if (!cartridge->Blocks) {
+            cartridge->Blocks = decodePRG(cartridge->PRG);
+        }
+        blocks = cartridge->Blocks;
+        jit.reset();
+        mem->SRAM.reset(cartridge->Battery ? new SaveRAM() : nullptr);
+        mem->Cart = std::move(cartridge);
+        Reset();
+    }
+
+    // debugging purpose
+    static const std::map<int, std::string> &idToInstructionName() {
+        static const std::map<int, std::string> names = {
+            {ADC, "ADC"}, {AHX, "AHX"}, {ALR, "ALR"}, {ANC, "ANC"}, {AND, "AND"},
+            {ARR, "ARR"}, {ASL, "ASL"}, {AXS, "AXS"}, {BCC, "BCC"}, {BCS, "BCS"},
+            {BEQ, "BEQ"}, {BIT, "BIT"}, {BMI, "BMI"}, {BNE, "BNE"}, {BPL, "BPL"},
+            {BRK, "BRK"}, {BVC, "BVC"}, {BVS, "BVS"}, {CLC, "CLC"}, {CLD, "CLD"},
+            {CLI, "CLI"}, {CLV, "CLV"}, {CMP, "CMP"}, {CPX, "CPX"}, {CPY, "CPY"},
+            {DCP, "DCP"}, {DEC, "DEC"}, {DEX, "DEX"}, {DEY, "DEY"}, {EOR, "EOR"},
+            {INC, "INC"}, {INX, "INX"}, {INY, "INY"}, {ISC, "ISC"}, {JMP, "JMP"},
+            {JSR, "JSR"}, {KIL, "KIL"}, {LAS, "LAS"}, {LAX, "LAX"}, {LDA, "LDA"},
+            {LDX, "LDX"}, {LDY, "LDY"}, {LSR, "LSR"}, {NOP, "NOP"}, {ORA, "ORA"},
+            {PHA, "PHA"}, {PHP, "PHP"}, {PLA, "PLA"}, {PLP, "PLP"}, {RLA, "RLA"},
+            {ROL, "ROL"}, {ROR, "ROR"}, {RRA, "RRA"}, {RTI, "RTI"}, {RTS, "RTS"},
+            {SAX, "SAX"}, {SBC, "SBC"}, {SEC, "SEC"}, {SED, "SED"}, {SEI, "SEI"},
+            {SHX, "SHX"}, {SHY, "SHY"}, {SLO, "SLO"}, {SRE, "SRE"}, {STA, "STA"},
+            {STX, "STX"}, {STY, "STY"}, {TAS, "TAS"}, {TAX, "TAX"}, {TAY, "TAY"},
+            {TSX, "TSX"}, {TXA, "TXA"}, {TXS, "TXS"}, {TYA, "TYA"}, {XAA, "XAA"}
+        };
+        return names;
+    }
+
+    std::string Cpu::InstructionName(uint8_t opcode) const {
+        const instructionParams &inst = instructionTable()[opcode];
+        if (inst.executor == nullptr) {
+            return "???";
+        }
+        auto name = idToInstructionName().find(inst.ID);
+        if (name == idToInstructionName().end()) {
+            return "???";
+        }
+        return name->second;
+    }
+
+    template <typename Accuracy>
+    uint8_t Cpu::busRead(uint16_t address) {
+        uint8_t v = mem->Read(address);
+        if (Accuracy::PerCycle) {
+            ++Cycles;
+        }
+        return v;
+    }
+
+    template <typename Accuracy>
+    uint16_t Cpu::busRead16Bug(uint16_t address) {
+        if (!Accuracy::PerCycle) {
+            return read16Bug(address);
+        }
+        uint16_t _address = (address&uint16_t(0xFF00)) | uint16_t(address+1) <<8;
+        uint16_t lo = busRead<Accuracy>(address);
+        uint16_t hi = busRead<Accuracy>(_address) <<8;
+        return hi | lo;
+    }
+
+    template <typename Accuracy>
+    DecodedInstruction Cpu::decodeFromBus(uint16_t address) {
+        uint8_t op = busRead<Accuracy>(address);
+        const instructionParams &inst = instructionTable()[op];
+        uint8_t size = (inst.executor != nullptr) ? inst.InstructionSizes : uint8_t(1);
+
+        // never touch bytes outside of the instruction since they might be I/O registers
+        uint16_t operand = 0;
+        if (size > 1) {
+            operand = busRead<Accuracy>(address + uint16_t(1));
+        }
+        if (size > 2) {
+            operand |= uint16_t(busRead<Accuracy>(address + uint16_t(2))) << 8;
+        }
+        return Decode(op, operand);
+    }
+
+    // number of bus cycles issued by the executor of the instruction itself, at the end of the instruction
+    uint8_t executorAccesses(const DecodedInstruction &d) {
+        if (d.AddressingMode == Immediate || d.AddressingMode == Implied ||
+            d.AddressingMode == Accumulator || d.AddressingMode == Relative) {
+            switch (d.ID) {
+                case PHA: case PHP: case PLA: case PLP:
+                    return 1;
+                case RTS:
+                    return 2;
+                case RTI:
+                    return 3;
+                case BRK:
+                    return 5;
+                default:
+                    return 0;
+            }
+        }
+        switch (d.ID) {
+            case JMP:
+                return 0;
+            case JSR:
+                return 2;
+            default:
+                return 1;
+        }
+    }
+
+    bool isStore(const DecodedInstruction &d) {
+        return d.Executor == &Cpu::ExecSTA || d.Executor == &Cpu::ExecSTX || d.Executor == &Cpu::ExecSTY;
+    }
+
+    bool isReadModifyWrite(const DecodedInstruction &d) {
+        if (d.AddressingMode == Accumulator) {
+            return false;
+        }
+        instructionExecutor e = d.Executor;
+        return e == &Cpu::ExecASL || e == &Cpu::ExecLSR || e == &Cpu::ExecROL || e == &Cpu::ExecROR ||
+               e == &Cpu::ExecINC || e == &Cpu::ExecDEC;
+    }
+
+    void Cpu::trace(const DecodedInstruction &inst, uint64_t cycles) {
+#ifdef NESTAKE_TRACE
+        TraceRecord r = {};
+        r.Cycles = cycles;
+        r.PC = PC;
+        r.Operand = inst.Operand;
+        r.Opcode = inst.Opcode;
+        r.A = A;
+        r.X = X;
+        r.Y = Y;
+        r.P = getFlag();
+        r.SP = SP;
+        Tracer->Append(r);
+#else
+        (void)inst;
+        (void)cycles;
+#endif
+    }
+
+    uint64_t Cpu::Step() {
+        if (IsCycleAccurate) {
+            return Step<CycleAccuracy>();
+        }
+        return Step<InstructionAccuracy>();
+    }
+
+    template <typename Accuracy>
     uint64_t Cpu::Step() {
 
         // stall cpu cycle
         if (Stall > 0) {
             --Stall;
+#ifdef NESTAKE_COUNTERS
+            ++StallCycles;
+#endif
             return 1;
         }
 
@@ -628,29 +865,103 @@ namespace nestake {
         // reset interrupt flag
         Interrupt = interruptNone;
 
+#ifdef NESTAKE_DEBUGGER
+        // stop before a breakpoint
+        if (debugging() && (mem->Traps[PC >> 8] & TrapExecute) && mem->Debug->OnExecute(PC, Cycles)) {
+            return 0;
+        }
+#endif
+
         // auxiliary variables
         uint64_t prev_cycles = Cycles;
         uint16_t address = 0;
         bool page_crossed = false;
 
-        // read opcode
-        uint8_t op = mem->Read(PC);
-        instructionParams inst = instructionTable[op];
+        // PRG-ROM code comes pre-decoded from the block cache, anything else (e.g. code in RAM) is read from the bus.
+        // the cycle accurate mode always fetches through the bus.
+        DecodedInstruction inst;
+        bool declined = false;
+        if (!Accuracy::PerCycle && PC >= 0x8000 && blocks) {
+            uint32_t offset = mem->PRGOffset(PC);
+            const DecodedInstruction &decoded = blocks->At(offset);
+
+            // hot PRG-ROM blocks run as native code when the recompiler is on. they start where the
+            // last step did not fall through, and the basic block bounds their length
+            if (IsJITMode && PC != fallthroughPC && decoded.BlockLength >= Jit::MinBlockInstructions &&
+                decoded.Fusion != fuseJMPSelf && !tracing() && !debugging() && !Profile) {
+                if (!jit && Jit::IsSupported()) {
+                    jit = std::make_shared<Jit>(*this);
+                }
+                if (jit && jit->Run(*this, *blocks, offset)) {
+                    fallthroughPC = noFallthrough;
+                    return Cycles - prev_cycles;
+                }
+                declined = jit && jit->Declined();
+            }
+            inst = decoded;
+
+            // superinstruction: the pair, or three iterations of the idle loop, in one dispatch.
+            // the idle loop has to jump to itself and end by the deadline (the next vblank in a console)
+            if (inst.Fusion != fuseNone && IsFusionMode && !tracing() && !debugging() &&
+                (inst.Fusion != fuseJMPSelf || (inst.Operand == PC && Cycles + 3*inst.InstructionCycle <= CycleDeadline))) {
+                const int length = FusedLength(inst.Fusion);
+                const DecodedInstruction &second = inst.Fusion == fuseJMPSelf ? inst : blocks->At(offset + inst.InstructionSizes);
+                uint16_t pc = PC;
+                fallthroughPC = declined || second.BlockLength == 1 ? noFallthrough :
+                    uint16_t(pc + inst.InstructionSizes + second.InstructionSizes);
+                execFused(inst, second);
+                countInstructions(uint64_t(length));
+                if (Pairs || Profile) {
+                    uint64_t cycles = Cycles - prev_cycles;
+                    for (int i = 0; i < length; ++i) {
+                        const DecodedInstruction &d = i == 0 ? inst : second;
+                        if (Pairs) {
+                            Pairs->Count(d.Opcode);
+                        }
+                        if (Profile) {
+                            // the last one gets the cycles left (page crossings and taken branches)
+                            uint64_t c = i + 1 < length ? uint64_t(d.InstructionCycle) : cycles;
+                            Profile->Record(pc, d.Opcode, d.AddressingMode, c);
+                            cycles -= c;
+                        }
+                        pc = uint16_t(pc + (inst.Fusion == fuseJMPSelf ? 0 : d.InstructionSizes));
+                    }
+                }
+                return Cycles - prev_cycles;
+            }
+        } else {
+            inst = decodeFromBus<Accuracy>(PC);
+        }
+
+        if (tracing()) {
+            trace(inst, prev_cycles);
+        }
+
+        if (inst.Executor == nullptr) {
+            throw std::runtime_error("unsupported opcode");
+        }
 
-        // switch the instruction's condition according to the addressing mode
+        // switch the instruction's condition according to the addressing mode.
+        // dummy reads are only issued by the cycle accurate mode.
         switch (inst.AddressingMode) {
             case Absolute : {
-                address = read16(PC + uint16_t(1));
+                address = inst.Operand;
                 break;
             }
             case AbsoluteX: {
-                address = read16(PC + uint16_t(1)) + uint8_t(X);
-                page_crossed = isPageCrossed(address - uint8_t(X), address);
+                address = inst.Operand + uint8_t(X);
+                page_crossed = isPageCrossed(inst.Operand, address);
+                if (Accuracy::PerCycle && (page_crossed || isStore(inst) || isReadModifyWrite(inst))) {
+                    busRead<Accuracy>((inst.Operand & 0xFF00) | (address & 0x00FF));
+                }
                 break;
             }
             case AbsoluteY: {
-                address = read16(PC + uint16_t(1)) + uint8_t(Y);
-                page_crossed = isPageCrossed(address - uint8_t(Y), address);
+                address = inst.Operand + uint8_t(Y);
+                page_crossed = isPageCrossed(inst.Operand, address);
+                if (Accuracy::PerCycle && (page_crossed || isStore(inst))) {
+                    busRead<Accuracy>((inst.Operand & 0xFF00) | (address & 0x00FF));
+                }
                 break;
             }
             case Immediate: {
@@ -658,295 +969,353 @@ namespace nestake {
                 break;
             }
             case IndexedIndirect: {
-                address = read16Bug(mem->Read(PC + uint16_t(1)) + uint16_t(X));
+                if (Accuracy::PerCycle) {
+                    busRead<Accuracy>(inst.Operand);
+                }
+                address = busRead16Bug<Accuracy>(inst.Operand + uint16_t(X));
                 break;
             }
             case Indirect: {
-                address = read16Bug(read16(PC + uint16_t(1)));
+                address = busRead16Bug<Accuracy>(inst.Operand);
                 break;
             }
             case IndirectIndexed: {
-                address = read16Bug(mem->Read(PC + uint16_t(1))) + uint16_t(Y);
+                address = busRead16Bug<Accuracy>(inst.Operand) + uint16_t(Y);
                 page_crossed = isPageCrossed(address - uint16_t(Y), address);
+                if (Accuracy::PerCycle && (page_crossed || isStore(inst))) {
+                    busRead<Accuracy>(((address - uint16_t(Y)) & 0xFF00) | (address & 0x00FF));
+                }
                 break;
             }
             case Relative: {
-                uint16_t offset = mem->Read(PC + uint16_t(1));
-                if (offset < 0x80) {
-                    address = PC + uint16_t(2) + offset;
-                } else {
-                    address = PC + uint16_t(2) + offset - uint16_t(0x100);
-                }
+                address = relativeTarget(PC + uint16_t(2), inst.Operand);
                 break;
             }
             case ZeroPage: {
-                address = mem->Read(PC + uint16_t(1));
+                address = inst.Operand;
                 break;
             }
             case ZeroPageX: {
-                address = uint16_t((mem->Read(PC + uint16_t(1)) + X) & 0xff);
+                if (Accuracy::PerCycle) {
+                    busRead<Accuracy>(inst.Operand);
+                }
+                address = uint16_t((inst.Operand + X) & 0xff);
                 break;
             }
             case ZeroPageY: {
-                address = uint16_t((mem->Read(PC + uint16_t(1)) + Y) & 0xff);
+                if (Accuracy::PerCycle) {
+                    busRead<Accuracy>(inst.Operand);
+                }
+                address = uint16_t((inst.Operand + Y) & 0xff);
                 break;
             }
             default: {
+                // implied / accumulator: the byte after the opcode is read and thrown away
+                if (Accuracy::PerCycle) {
+                    busRead<Accuracy>(PC + uint16_t(1));
+                }
             }
         }
 
-        PC += inst.InstructionSizes;
-        Cycles += inst.InstructionCycle;
-        if (page_crossed) {
-            Cycles += inst.PageCycle;
+        if (Pairs) {
+            Pairs->Count(inst.Opcode);
         }
 
-        inst.executor(address, inst.AddressingMode == Accumulator);
+        uint16_t pc = PC;
+        uint64_t cycles = inst.InstructionCycle;
+        if (page_crossed) {
+            cycles += inst.PageCycle;
+        }
+        PC += inst.InstructionSizes;
+        fallthroughPC = declined || inst.BlockLength == 1 ? noFallthrough : PC;
+
+        if (!Accuracy::PerCycle) {
+            Cycles += cycles;
+            (this->*inst.Executor)(address, inst.AddressingMode == Accumulator);
+        } else if (isReadModifyWrite(inst)) {
+            // read, write back the unmodified value, write the result: the last three cycles
+            Cycles = std::max(Cycles, prev_cycles + cycles - 3);
+            uint8_t v = busRead<Accuracy>(address);
+            mem->Write(address, v);
+            ++Cycles;
 
-        if (IsDebugMode) {
-            cout << "[Instruction]:" << idToInstructionName.find(inst.ID)->second;
-            cout << "[address]: " << address;
-            cout << "[addressing mode]: " << inst.AddressingMode << "\n";
+            uint8_t result;
+            if (inst.Executor == &Cpu::ExecINC) {
+                result = v + uint8_t(1);
+                setZN(result);
+            } else if (inst.Executor == &Cpu::ExecDEC) {
+                result = v - uint8_t(1);
+                setZN(result);
+            } else {
+                // shifts and rotates are computed by their accumulator variant
+                uint8_t a = A;
+                A = v;
+                (this->*inst.Executor)(address, true);
+                result = A;
+                A = a;
+            }
+            mem->Write(address, result);
+            Cycles = prev_cycles + cycles;
+        } else {
+            // internal cycles elapse first, so that the executor's own accesses happen on their cycles
+            uint8_t accesses = executorAccesses(inst);
+            Cycles = std::max(Cycles, prev_cycles + cycles - accesses);
+            uint64_t before = Cycles;
+            (this->*inst.Executor)(address, inst.AddressingMode == Accumulator);
+
+            // branches add their extra cycles by themselves
+            uint64_t extra = Cycles - before;
+            Cycles = prev_cycles + cycles + extra;
         }
 
+        countInstructions(1);
+        if (Profile) {
+            Profile->Record(pc, inst.Opcode, inst.AddressingMode, Cycles - prev_cycles);
+        }
         return Cycles - prev_cycles;
     }
 
-    Cpu::Cpu(std::shared_ptr<CPUMemory> m) {
-        // setup instruction table
+    template uint64_t Cpu::Step<InstructionAccuracy>();
+    template uint64_t Cpu::Step<CycleAccuracy>();
+
+    const std::array<Cpu::instructionParams, 256> &Cpu::instructionTable() {
+        static const std::array<instructionParams, 256> table = buildInstructionTable();
+        return table;
+    }
+
+    std::array<Cpu::instructionParams, 256> Cpu::buildInstructionTable() {
         // ref: http://pgate1.at-ninja.jp/NES_on_FPGA/nes_cpu.htm#instruction
-        instructionTable = {
+        // (a map first: the first entry of a duplicated opcode wins)
+        const std::map<uint8_t, instructionParams> instructions = {
             // ADC
-            {0x69, {ADC, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecADC(a,b);}}},
-            {0x65, {ADC, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecADC(a,b);}}},
-            {0x75, {ADC, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecADC(a,b);}}},
-            {0x6D, {ADC, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecADC(a,b);}}},
-            {0x7D, {ADC, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecADC(a,b);}}},
-            {0x79, {ADC, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecADC(a,b);}}},
-            {0x79, {ADC, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecADC(a,b);}}},
-            {0x71, {ADC, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecADC(a,b);}}},
+            {0x69, {ADC, Immediate, 2, 2, 0, &Cpu::ExecADC}},
+            {0x65, {ADC, ZeroPage, 2, 3, 0, &Cpu::ExecADC}},
+            {0x75, {ADC, ZeroPageX, 2, 4, 0, &Cpu::ExecADC}},
+            {0x6D, {ADC, Absolute, 3, 4, 0, &Cpu::ExecADC}},
+            {0x7D, {ADC, AbsoluteX, 3, 4, 1, &Cpu::ExecADC}},
+            {0x79, {ADC, AbsoluteY, 3, 4, 1, &Cpu::ExecADC}},
+            {0x79, {ADC, IndexedIndirect, 2, 6, 0, &Cpu::ExecADC}},
+            {0x71, {ADC, IndirectIndexed, 2, 5, 1, &Cpu::ExecADC}},
 
             // SBC
-            {0xE9, {SBC, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
-            {0xE5, {SBC, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
-            {0xF5, {SBC, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
-            {0xED, {SBC, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
-            {0xFD, {SBC, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
-            {0xF9, {SBC, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
-            {0xE1, {SBC, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
-            {0xF1, {SBC, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecSBC(a,b);}}},
+            {0xE9, {SBC, Immediate, 2, 2, 0, &Cpu::ExecSBC}},
+            {0xE5, {SBC, ZeroPage, 2, 3, 0, &Cpu::ExecSBC}},
+            {0xF5, {SBC, ZeroPageX, 2, 4, 0, &Cpu::ExecSBC}},
+            {0xED, {SBC, Absolute, 3, 4, 0, &Cpu::ExecSBC}},
+            {0xFD, {SBC, AbsoluteX, 3, 4, 1, &Cpu::ExecSBC}},
+            {0xF9, {SBC, AbsoluteY, 3, 4, 1, &Cpu::ExecSBC}},
+            {0xE1, {SBC, IndexedIndirect, 2, 6, 0, &Cpu::ExecSBC}},
+            {0xF1, {SBC, IndirectIndexed, 2, 5, 1, &Cpu::ExecSBC}},
 
             // AND
-            {0x29, {AND, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecAND(a,b);}}},
-            {0x25, {AND, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecAND(a,b);}}},
-            {0x35, {AND, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecAND(a,b);}}},
-            {0x2D, {AND, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecAND(a,b);}}},
-            {0x3D, {AND, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecAND(a,b);}}},
-            {0x39, {AND, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecAND(a,b);}}},
-            {0x21, {AND, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecAND(a,b);}}},
-            {0x31, {AND, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecAND(a,b);}}},
+            {0x29, {AND, Immediate, 2, 2, 0, &Cpu::ExecAND}},
+            {0x25, {AND, ZeroPage, 2, 3, 0, &Cpu::ExecAND}},
+            {0x35, {AND, ZeroPageX, 2, 4, 0, &Cpu::ExecAND}},
+            {0x2D, {AND, Absolute, 3, 4, 0, &Cpu::ExecAND}},
+            {0x3D, {AND, AbsoluteX, 3, 4, 1, &Cpu::ExecAND}},
+            {0x39, {AND, AbsoluteY, 3, 4, 1, &Cpu::ExecAND}},
+            {0x21, {AND, IndexedIndirect, 2, 6, 0, &Cpu::ExecAND}},
+            {0x31, {AND, IndirectIndexed, 2, 5, 1, &Cpu::ExecAND}},
 
             // ORA
-            {0x09, {ORA, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecORA(a,b);}}},
-            {0x05, {ORA, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecORA(a,b);}}},
-            {0x15, {ORA, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecORA(a,b);}}},
-            {0x0D, {ORA, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecORA(a,b);}}},
-            {0x1D, {ORA, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecORA(a,b);}}},
-            {0x19, {ORA, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecORA(a,b);}}},
-            {0x01, {ORA, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecORA(a,b);}}},
-            {0x11, {ORA, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecORA(a,b);}}},
+            {0x09, {ORA, Immediate, 2, 2, 0, &Cpu::ExecORA}},
+            {0x05, {ORA, ZeroPage, 2, 3, 0, &Cpu::ExecORA}},
+            {0x15, {ORA, ZeroPageX, 2, 4, 0, &Cpu::ExecORA}},
+            {0x0D, {ORA, Absolute, 3, 4, 0, &Cpu::ExecORA}},
+            {0x1D, {ORA, AbsoluteX, 3, 4, 1, &Cpu::ExecORA}},
+            {0x19, {ORA, AbsoluteY, 3, 4, 1, &Cpu::ExecORA}},
+            {0x01, {ORA, IndexedIndirect, 2, 6, 0, &Cpu::ExecORA}},
+            {0x11, {ORA, IndirectIndexed, 2, 5, 1, &Cpu::ExecORA}},
 
             // EOR
-            {0x49, {EOR, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
-            {0x45, {EOR, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
-            {0x55, {EOR, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
-            {0x4D, {EOR, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
-            {0x5D, {EOR, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
-            {0x59, {EOR, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
-            {0x41, {EOR, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
-            {0x51, {EOR, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecEOR(a,b);}}},
+            {0x49, {EOR, Immediate, 2, 2, 0, &Cpu::ExecEOR}},
+            {0x45, {EOR, ZeroPage, 2, 3, 0, &Cpu::ExecEOR}},
+            {0x55, {EOR, ZeroPageX, 2, 4, 0, &Cpu::ExecEOR}},
+            {0x4D, {EOR, Absolute, 3, 4, 0, &Cpu::ExecEOR}},
+            {0x5D, {EOR, AbsoluteX, 3, 4, 1, &Cpu::ExecEOR}},
+            {0x59, {EOR, AbsoluteY, 3, 4, 1, &Cpu::ExecEOR}},
+            {0x41, {EOR, IndexedIndirect, 2, 6, 0, &Cpu::ExecEOR}},
+            {0x51, {EOR, IndirectIndexed, 2, 5, 1, &Cpu::ExecEOR}},
 
             // ASL
-            {0x0A, {ASL, Accumulator, 1, 2, 0, [&](uint16_t a, bool b){ExecASL(a,b);}}},
-            {0x06, {ASL, ZeroPage, 2, 5, 0, [&](uint16_t a, bool b){ExecASL(a,b);}}},
-            {0x16, {ASL, ZeroPageX, 2, 6, 0, [&](uint16_t a, bool b){ExecASL(a,b);}}},
-            {0x0E, {ASL, Absolute, 3, 6, 0, [&](uint16_t a, bool b){ExecASL(a,b);}}},
-            {0x1E, {ASL, AbsoluteX, 3, 6, 1, [&](uint16_t a, bool b){ExecASL(a,b);}}},
+            {0x0A, {ASL, Accumulator, 1, 2, 0, &Cpu::ExecASL}},
+            {0x06, {ASL, ZeroPage, 2, 5, 0, &Cpu::ExecASL}},
+            {0x16, {ASL, ZeroPageX, 2, 6, 0, &Cpu::ExecASL}},
+            {0x0E, {ASL, Absolute, 3, 6, 0, &Cpu::ExecASL}},
+            {0x1E, {ASL, AbsoluteX, 3, 6, 1, &Cpu::ExecASL}},
 
             // LSR
-            {0x4A, {LSR, Accumulator, 1, 2, 0, [&](uint16_t a, bool b){ExecLSR(a,b);}}},
-            {0x46, {LSR, ZeroPage, 2, 5, 0, [&](uint16_t a, bool b){ExecLSR(a,b);}}},
-            {0x56, {LSR, ZeroPageX, 2, 6, 0, [&](uint16_t a, bool b){ExecLSR(a,b);}}},
-            {0x4E, {LSR, Absolute, 3, 6, 0, [&](uint16_t a, bool b){ExecLSR(a,b);}}},
-            {0x5E, {LSR, AbsoluteX, 3, 6, 1, [&](uint16_t a, bool b){ExecLSR(a,b);}}},
+            {0x4A, {LSR, Accumulator, 1, 2, 0, &Cpu::ExecLSR}},
+            {0x46, {LSR, ZeroPage, 2, 5, 0, &Cpu::ExecLSR}},
+            {0x56, {LSR, ZeroPageX, 2, 6, 0, &Cpu::ExecLSR}},
+            {0x4E, {LSR, Absolute, 3, 6, 0, &Cpu::ExecLSR}},
+            {0x5E, {LSR, AbsoluteX, 3, 6, 1, &Cpu::ExecLSR}},
 
             // ROL
-            {0x2A, {ROL, Accumulator, 1, 2, 0, [&](uint16_t a, bool b){ExecROL(a,b);}}},
-            {0x26, {ROL, ZeroPage, 2, 5, 0, [&](uint16_t a, bool b){ExecROL(a,b);}}},
-            {0x36, {ROL, ZeroPageX, 2, 6, 0, [&](uint16_t a, bool b){ExecROL(a,b);}}},
-            {0x2E, {ROL, Absolute, 3, 6, 0, [&](uint16_t a, bool b){ExecROL(a,b);}}},
-            {0x3E, {ROL, AbsoluteX, 3, 6, 1, [&](uint16_t a, bool b){ExecROL(a,b);}}},
+            {0x2A, {ROL, Accumulator, 1, 2, 0, &Cpu::ExecROL}},
+            {0x26, {ROL, ZeroPage, 2, 5, 0, &Cpu::ExecROL}},
+            {0x36, {ROL, ZeroPageX, 2, 6, 0, &Cpu::ExecROL}},
+            {0x2E, {ROL, Absolute, 3, 6, 0, &Cpu::ExecROL}},
+            {0x3E, {ROL, AbsoluteX, 3, 6, 1, &Cpu::ExecROL}},
 
             // ROR
-            {0x6A, {ROR, Accumulator, 1, 2, 0, [&](uint16_t a, bool b){ExecROR(a,b);}}},
-            {0x66, {ROR, ZeroPage, 2, 5, 0, [&](uint16_t a, bool b){ExecROR(a,b);}}},
-            {0x76, {ROR, ZeroPageX, 2, 6, 0, [&](uint16_t a, bool b){ExecROR(a,b);}}},
-            {0x6E, {ROR, Absolute, 3, 6, 0, [&](uint16_t a, bool b){ExecROR(a,b);}}},
-            {0x7E, {ROR, AbsoluteX, 3, 6, 1, [&](uint16_t a, bool b){ExecROR(a,b);}}},
+            {0x6A, {ROR, Accumulator, 1, 2, 0, &Cpu::ExecROR}},
+            {0x66, {ROR, ZeroPage, 2, 5, 0, &Cpu::ExecROR}},
+            {0x76, {ROR, ZeroPageX, 2, 6, 0, &Cpu::ExecROR}},
+            {0x6E, {ROR, Absolute, 3, 6, 0, &Cpu::ExecROR}},
+            {0x7E, {ROR, AbsoluteX, 3, 6, 1, &Cpu::ExecROR}},
 
             // Relatives
-            {0x90, {BCC, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBCC(a,b);}}},
-            {0xB0, {BCS, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBCS(a,b);}}},
-            {0xF0, {BEQ, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBEQ(a,b);}}},
-            {0xD0, {BNE, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBNE(a,b);}}},
-            {0x50, {BVC, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBVC(a,b);}}},
-            {0x70, {BVS, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBVS(a,b);}}},
-            {0x10, {BPL, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBPL(a,b);}}},
-            {0x30, {BMI, Relative, 2, 2, 1, [&](uint16_t a, bool b){ExecBMI(a,b);}}},
+            {0x90, {BCC, Relative, 2, 2, 1, &Cpu::ExecBCC}},
+            {0xB0, {BCS, Relative, 2, 2, 1, &Cpu::ExecBCS}},
+            {0xF0, {BEQ, Relative, 2, 2, 1, &Cpu::ExecBEQ}},
+            {0xD0, {BNE, Relative, 2, 2, 1, &Cpu::ExecBNE}},
+            {0x50, {BVC, Relative, 2, 2, 1, &Cpu::ExecBVC}},
+            {0x70, {BVS, Relative, 2, 2, 1, &Cpu::ExecBVS}},
+            {0x10, {BPL, Relative, 2, 2, 1, &Cpu::ExecBPL}},
+            {0x30, {BMI, Relative, 2, 2, 1, &Cpu::ExecBMI}},
 
             // BIT
-            {0x24, {BIT, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecBIT(a,b);}}},
-            {0x2C, {BIT, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecBIT(a,b);}}},
+            {0x24, {BIT, ZeroPage, 2, 3, 0, &Cpu::ExecBIT}},
+            {0x2C, {BIT, Absolute, 3, 4, 0, &Cpu::ExecBIT}},
 
             // JMP
-            {0x4C, {JMP, Absolute, 3, 3, 0, [&](uint16_t a, bool b){ExecJMP(a,b);}}},
-            {0x6C, {JMP, Indirect, 3, 5, 0, [&](uint16_t a, bool b){ExecJMP(a,b);}}},
+            {0x4C, {JMP, Absolute, 3, 3, 0, &Cpu::ExecJMP}},
+            {0x6C, {JMP, Indirect, 3, 5, 0, &Cpu::ExecJMP}},
 
             // JSR / RTS / BRK / RTI
-            {0x20, {JSR, Absolute, 3, 6, 0, [&](uint16_t a, bool b){ExecJSR(a,b);}}},
-            {0x60, {RTS, Implied, 1, 6, 0, [&](uint16_t a, bool b){ExecRTS(a,b);}}},
-            {0x00, {BRK, Implied, 1, 7, 0, [&](uint16_t a, bool b){ExecBRK(a,b);}}},
-            {0x40, {RTI, Implied, 1, 6, 0, [&](uint16_t a, bool b){ExecRTI(a,b);}}},
+            {0x20, {JSR, Absolute, 3, 6, 0, &Cpu::ExecJSR}},
+            {0x60, {RTS, Implied, 1, 6, 0, &Cpu::ExecRTS}},
+            {0x00, {BRK, Implied, 1, 7, 0, &Cpu::ExecBRK}},
+            {0x40, {RTI, Implied, 1, 6, 0, &Cpu::ExecRTI}},
 
             // CMP
-            {0xC9, {CMP, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
-            {0xC5, {CMP, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
-            {0xD5, {CMP, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
-            {0xCD, {CMP, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
-            {0xDD, {CMP, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
-            {0xD9, {CMP, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
-            {0xC1, {CMP, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
-            {0xD1, {CMP, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecCMP(a,b);}}},
+            {0xC9, {CMP, Immediate, 2, 2, 0, &Cpu::ExecCMP}},
+            {0xC5, {CMP, ZeroPage, 2, 3, 0, &Cpu::ExecCMP}},
+            {0xD5, {CMP, ZeroPageX, 2, 4, 0, &Cpu::ExecCMP}},
+            {0xCD, {CMP, Absolute, 3, 4, 0, &Cpu::ExecCMP}},
+            {0xDD, {CMP, AbsoluteX, 3, 4, 1, &Cpu::ExecCMP}},
+            {0xD9, {CMP, AbsoluteY, 3, 4, 1, &Cpu::ExecCMP}},
+            {0xC1, {CMP, IndexedIndirect, 2, 6, 0, &Cpu::ExecCMP}},
+            {0xD1, {CMP, IndirectIndexed, 2, 5, 1, &Cpu::ExecCMP}},
 
             // CPX
-            {0xE0, {CPX, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecCPX(a,b);}}},
-            {0xE4, {CPX, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecCPX(a,b);}}},
-            {0xEC, {CPX, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecCPX(a,b);}}},
+            {0xE0, {CPX, Immediate, 2, 2, 0, &Cpu::ExecCPX}},
+            {0xE4, {CPX, ZeroPage, 2, 3, 0, &Cpu::ExecCPX}},
+            {0xEC, {CPX, Absolute, 3, 4, 0, &Cpu::ExecCPX}},
 
             // CPY
-            {0xC0, {CPY, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecCPY(a,b);}}},
-            {0xC4, {CPX, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecCPY(a,b);}}},
-            {0xCC, {CPY, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecCPY(a,b);}}},
+            {0xC0, {CPY, Immediate, 2, 2, 0, &Cpu::ExecCPY}},
+            {0xC4, {CPX, ZeroPage, 2, 3, 0, &Cpu::ExecCPY}},
+            {0xCC, {CPY, Absolute, 3, 4, 0, &Cpu::ExecCPY}},
 
             // INC
-            {0xE6, {INC, ZeroPage, 2, 5, 0, [&](uint16_t a, bool b){ExecINC(a,b);}}},
-            {0xF6, {INC, ZeroPageX, 2, 6, 0, [&](uint16_t a, bool b){ExecINC(a,b);}}},
-            {0xEE, {INC, Absolute, 3, 6, 0, [&](uint16_t a, bool b){ExecINC(a,b);}}},
-            {0xFE, {INC, AbsoluteX, 3, 6, 1, [&](uint16_t a, bool b){ExecINC(a,b);}}},
+            {0xE6, {INC, ZeroPage, 2, 5, 0, &Cpu::ExecINC}},
+            {0xF6, {INC, ZeroPageX, 2, 6, 0, &Cpu::ExecINC}},
+            {0xEE, {INC, Absolute, 3, 6, 0, &Cpu::ExecINC}},
+            {0xFE, {INC, AbsoluteX, 3, 6, 1, &Cpu::ExecINC}},
 
             // DEC
-            {0xC6, {DEC, ZeroPage, 2, 5, 0, [&](uint16_t a, bool b){ExecDEC(a,b);}}},
-            {0xD6, {DEC, ZeroPageX, 2, 6, 0, [&](uint16_t a, bool b){ExecDEC(a,b);}}},
-            {0xCE, {DEC, Absolute, 3, 6, 0, [&](uint16_t a, bool b){ExecDEC(a,b);}}},
-            {0xDE, {DEC, AbsoluteX, 3, 6, 1, [&](uint16_t a, bool b){ExecDEC(a,b);}}},
+            {0xC6, {DEC, ZeroPage, 2, 5, 0, &Cpu::ExecDEC}},
+            {0xD6, {DEC, ZeroPageX, 2, 6, 0, &Cpu::ExecDEC}},
+            {0xCE, {DEC, Absolute, 3, 6, 0, &Cpu::ExecDEC}},
+            {0xDE, {DEC, AbsoluteX, 3, 6, 1, &Cpu::ExecDEC}},
 
             // DE{X,Y} / IN{X,Y}
-            {0xE8, {INX, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecINX(a,b);}}},
-            {0xCA, {DEX, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecDEX(a,b);}}},
-            {0xC8, {INY, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecINY(a,b);}}},
-            {0x88, {DEY, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecDEY(a,b);}}},
+            {0xE8, {INX, Implied, 1, 2, 0, &Cpu::ExecINX}},
+            {0xCA, {DEX, Implied, 1, 2, 0, &Cpu::ExecDEX}},
+            {0xC8, {INY, Implied, 1, 2, 0, &Cpu::ExecINY}},
+            {0x88, {DEY, Implied, 1, 2, 0, &Cpu::ExecDEY}},
 
             // CL{C,I,D,V} / SE{C, I, D}
-            {0x18, {CLC, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecCLC(a,b);}}},
-            {0x38, {SEC, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecSEC(a,b);}}},
-            {0x58, {CLI, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecCLI(a,b);}}},
-            {0x78, {SEI, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecSEI(a,b);}}},
-            {0xD8, {CLD, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecCLD(a,b);}}},
-            {0xF8, {SED, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecSED(a,b);}}},
-            {0xB8, {CLV, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecCLV(a,b);}}},
+            {0x18, {CLC, Implied, 1, 2, 0, &Cpu::ExecCLC}},
+            {0x38, {SEC, Implied, 1, 2, 0, &Cpu::ExecSEC}},
+            {0x58, {CLI, Implied, 1, 2, 0, &Cpu::ExecCLI}},
+            {0x78, {SEI, Implied, 1, 2, 0, &Cpu::ExecSEI}},
+            {0xD8, {CLD, Implied, 1, 2, 0, &Cpu::ExecCLD}},
+            {0xF8, {SED, Implied, 1, 2, 0, &Cpu::ExecSED}},
+            {0xB8, {CLV, Implied, 1, 2, 0, &Cpu::ExecCLV}},
 
             // LDA
-            {0xA9, {LDA, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
-            {0xA5, {LDA, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
-            {0xB5, {LDA, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
-            {0xAD, {LDA, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
-            {0xBD, {LDA, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
-            {0xB9, {LDA, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
-            {0xA9, {LDA, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
-            {0xB1, {LDA, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecLDA(a,b);}}},
+            {0xA9, {LDA, Immediate, 2, 2, 0, &Cpu::ExecLDA}},
+            {0xA5, {LDA, ZeroPage, 2, 3, 0, &Cpu::ExecLDA}},
+            {0xB5, {LDA, ZeroPageX, 2, 4, 0, &Cpu::ExecLDA}},
+            {0xAD, {LDA, Absolute, 3, 4, 0, &Cpu::ExecLDA}},
+            {0xBD, {LDA, AbsoluteX, 3, 4, 1, &Cpu::ExecLDA}},
+            {0xB9, {LDA, AbsoluteY, 3, 4, 1, &Cpu::ExecLDA}},
+            {0xA9, {LDA, IndexedIndirect, 2, 6, 0, &Cpu::ExecLDA}},
+            {0xB1, {LDA, IndirectIndexed, 2, 5, 1, &Cpu::ExecLDA}},
 
             // LDX
-            {0xA2, {LDX, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecLDX(a,b);}}},
-            {0xA6, {LDX, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecLDX(a,b);}}},
-            {0xB6, {LDX, ZeroPageY, 2, 4, 0, [&](uint16_t a, bool b){ExecLDX(a,b);}}},
-            {0xAE, {LDX, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecLDX(a,b);}}},
-            {0xBE, {LDX, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecLDX(a,b);}}},
+            {0xA2, {LDX, Immediate, 2, 2, 0, &Cpu::ExecLDX}},
+            {0xA6, {LDX, ZeroPage, 2, 3, 0, &Cpu::ExecLDX}},
+            {0xB6, {LDX, ZeroPageY, 2, 4, 0, &Cpu::ExecLDX}},
+            {0xAE, {LDX, Absolute, 3, 4, 0, &Cpu::ExecLDX}},
+            {0xBE, {LDX, AbsoluteY, 3, 4, 1, &Cpu::ExecLDX}},
 
             // LDY
-            {0xA0, {LDY, Immediate, 2, 2, 0, [&](uint16_t a, bool b){ExecLDY(a,b);}}},
-            {0xA4, {LDY, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecLDY(a,b);}}},
-            {0xB4, {LDY, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecLDY(a,b);}}},
-            {0xAC, {LDY, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecLDY(a,b);}}},
-            {0xBC, {LDY, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecLDY(a,b);}}},
+            {0xA0, {LDY, Immediate, 2, 2, 0, &Cpu::ExecLDY}},
+            {0xA4, {LDY, ZeroPage, 2, 3, 0, &Cpu::ExecLDY}},
+            {0xB4, {LDY, ZeroPageX, 2, 4, 0, &Cpu::ExecLDY}},
+            {0xAC, {LDY, Absolute, 3, 4, 0, &Cpu::ExecLDY}},
+            {0xBC, {LDY, AbsoluteX, 3, 4, 1, &Cpu::ExecLDY}},
 
             // STA
-            {0x85, {STA, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecSTA(a,b);}}},
-            {0x95, {LDA, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecSTA(a,b);}}},
-            {0x8D, {STA, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecSTA(a,b);}}},
-            {0x9D, {LDA, AbsoluteX, 3, 4, 1, [&](uint16_t a, bool b){ExecSTA(a,b);}}},
-            {0x99, {STA, AbsoluteY, 3, 4, 1, [&](uint16_t a, bool b){ExecSTA(a,b);}}},
-            {0x81, {LDA, IndexedIndirect, 2, 6, 0, [&](uint16_t a, bool b){ExecSTA(a,b);}}},
-            {0x91, {STA, IndirectIndexed, 2, 5, 1, [&](uint16_t a, bool b){ExecSTA(a,b);}}},
+            {0x85, {STA, ZeroPage, 2, 3, 0, &Cpu::ExecSTA}},
+            {0x95, {LDA, ZeroPageX, 2, 4, 0, &Cpu::ExecSTA}},
+            {0x8D, {STA, Absolute, 3, 4, 0, &Cpu::ExecSTA}},
+            {0x9D, {LDA, AbsoluteX, 3, 4, 1, &Cpu::ExecSTA}},
+            {0x99, {STA, AbsoluteY, 3, 4, 1, &Cpu::ExecSTA}},
+            {0x81, {LDA, IndexedIndirect, 2, 6, 0, &Cpu::ExecSTA}},
+            {0x91, {STA, IndirectIndexed, 2, 5, 1, &Cpu::ExecSTA}},
 
             // STX
-            {0x86, {STX, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecSTX(a,b);}}},
-            {0x96, {STX, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecSTX(a,b);}}},
-            {0x8E, {STX, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecSTX(a,b);}}},
+            {0x86, {STX, ZeroPage, 2, 3, 0, &Cpu::ExecSTX}},
+            {0x96, {STX, ZeroPageX, 2, 4, 0, &Cpu::ExecSTX}},
+            {0x8E, {STX, Absolute, 3, 4, 0, &Cpu::ExecSTX}},
 
             // STY
-            {0x84, {STY, ZeroPage, 2, 3, 0, [&](uint16_t a, bool b){ExecSTY(a,b);}}},
-            {0x94, {STY, ZeroPageX, 2, 4, 0, [&](uint16_t a, bool b){ExecSTY(a,b);}}},
-            {0x8C, {STY, Absolute, 3, 4, 0, [&](uint16_t a, bool b){ExecSTY(a,b);}}},
+            {0x84, {STY, ZeroPage, 2, 3, 0, &Cpu::ExecSTY}},
+            {0x94, {STY, ZeroPageX, 2, 4, 0, &Cpu::ExecSTY}},
+            {0x8C, {STY, Absolute, 3, 4, 0, &Cpu::ExecSTY}},
 
             // transfer related
-            {0xAA, {TAX, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecTAX(a,b);}}},
-            {0x8A, {TXA, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecTXA(a,b);}}},
-            {0xA8, {TAY, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecTAY(a,b);}}},
-            {0x98, {TYA, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecTYA(a,b);}}},
-            {0x9A, {TXS, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecTXS(a,b);}}},
-            {0xBA, {TSX, Implied, 1, 2, 0, [&](uint16_t a, bool b){ExecTSX(a,b);}}},
+            {0xAA, {TAX, Implied, 1, 2, 0, &Cpu::ExecTAX}},
+            {0x8A, {TXA, Implied, 1, 2, 0, &Cpu::ExecTXA}},
+            {0xA8, {TAY, Implied, 1, 2, 0, &Cpu::ExecTAY}},
+            {0x98, {TYA, Implied, 1, 2, 0, &Cpu::ExecTYA}},
+            {0x9A, {TXS, Implied, 1, 2, 0, &Cpu::ExecTXS}},
+            {0xBA, {TSX, Implied, 1, 2, 0, &Cpu::ExecTSX}},
 
             // push related
-            {0x48, {PHA, Implied, 1, 3, 0, [&](uint16_t a, bool b){ExecPHA(a,b);}}},
-            {0x68, {PLA, Implied, 1, 4, 0, [&](uint16_t a, bool b){ExecPLA(a,b);}}},
-            {0x08, {PHP, Implied, 1, 3, 0, [&](uint16_t a, bool b){ExecPHP(a,b);}}},
-            {0x28, {PLP, Implied, 1, 4, 0, [&](uint16_t a, bool b){ExecPLP(a,b);}}},
+            {0x48, {PHA, Implied, 1, 3, 0, &Cpu::ExecPHA}},
+            {0x68, {PLA, Implied, 1, 4, 0, &Cpu::ExecPLA}},
+            {0x08, {PHP, Implied, 1, 3, 0, &Cpu::ExecPHP}},
+            {0x28, {PLP, Implied, 1, 4, 0, &Cpu::ExecPLP}},
 
             // NOP
-            {0xEA, {NOP, Implied, 1, 2, 0, [&](uint16_t a, bool b){}}}
-        };
-
-        // debugging purpose
-        idToInstructionName = {
-            {ADC, "ADC"}, {AHX, "AHX"}, {ALR, "ALR"}, {ANC, "ANC"}, {AND, "AND"},
-            {ARR, "ARR"}, {ASL, "ASL"}, {AXS, "AXS"}, {BCC, "BCC"}, {BCS, "BCS"},
-            {BEQ, "BEQ"}, {BIT, "BIT"}, {BMI, "BMI"}, {BNE, "BNE"}, {BPL, "BPL"},
-            {BRK, "BRK"}, {BVC, "BVC"}, {BVS, "BVS"}, {CLC, "CLC"}, {CLD, "CLD"},
-            {CLI, "CLI"}, {CLV, "CLV"}, {CMP, "CMP"}, {CPX, "CPX"}, {CPY, "CPY"},
-            {DCP, "DCP"}, {DEC, "DEC"}, {DEX, "DEX"}, {DEY, "DEY"}, {EOR, "EOR"},
-            {INC, "INC"}, {INX, "INX"}, {INY, "INY"}, {ISC, "ISC"}, {JMP, "JMP"},
-            {JSR, "JSR"}, {KIL, "KIL"}, {LAS, "LAS"}, {LAX, "LAX"}, {LDA, "LDA"},
-            {LDX, "LDX"}, {LDY, "LDY"}, {LSR, "LSR"}, {NOP, "NOP"}, {ORA, "ORA"},
-            {PHA, "PHA"}, {PHP, "PHP"}, {PLA, "PLA"}, {PLP, "PLP"}, {RLA, "RLA"},
-            {ROL, "ROL"}, {ROR, "ROR"}, {RRA, "RRA"}, {RTI, "RTI"}, {RTS, "RTS"},
-            {SAX, "SAX"}, {SBC, "SBC"}, {SEC, "SEC"}, {SED, "SED"}, {SEI, "SEI"},
-            {SHX, "SHX"}, {SHY, "SHY"}, {SLO, "SLO"}, {SRE, "SRE"}, {STA, "STA"},
-            {STX, "STX"}, {STY, "STY"}, {TAS, "TAS"}, {TAX, "TAX"}, {TAY, "TAY"},
-            {TSX, "TSX"}, {TXA, "TXA"}, {TXS, "TXS"}, {TYA, "TYA"}, {XAA, "XAA"}
+            {0xEA, {NOP, Implied, 1, 2, 0, &Cpu::ExecNOP}}
         };
+        std::array<instructionParams, 256> table = {};
+        for (const auto &inst : instructions) {
+            table[inst.first] = inst.second;
+        }
+        return table;
+    }
 
+    Cpu::Cpu(std::shared_ptr<CPUMemory> m) {
         // setup memory interface
         mem = m;
+        mem->CPU = this;
+        IsJITMode = false;
+        IsFusionMode = true;
+        IsCycleAccurate = false;
+#ifdef NESTAKE_COUNTERS
+        Instructions = 0;
+        StallCycles = 0;
+#endif
+        CycleDeadline = UINT64_MAX;
+        fallthroughPC = noFallthrough;
         Reset();
     }
 }
@@ -2,17 +2,96 @@
 #define NESTAKE_CPU
 
 #include <array>
-#include <functional>
-#include <map>
 #include <memory>
 #include <stdint.h>
 #include <string>
 
+#include "block.hpp"
 #include "memory.hpp"
 
 namespace nestake {
+    struct ConsoleState;
+    class Jit;
+    class TraceBuffer;
+    class PairCounter;
+    class Profiler;
+    class PerfMap;
+
+    // addressing mode
+    enum AddressingMode {
+        Absolute = 1, AbsoluteX, AbsoluteY, Accumulator, Immediate,
+        Implied, IndexedIndirect, Indirect, IndirectIndexed, Relative,
+        ZeroPage, ZeroPageX, ZeroPageY
+    };
+
+    // instructions's identifier supposed to be used in debugging
+    enum InstructionID {
+        ADC = 1, AHX, ALR, ANC, AND, ARR, ASL, AXS, BCC, BCS, BEQ, BIT, BMI,
+        BNE, BPL, BRK, BVC, BVS, CLC, CLD, CLI, CLV, CMP, CPX, CPY, DCP, DEC,
+        DEX, DEY, EOR, INC, INX, INY, ISC, JMP, JSR, KIL, LAS, LAX, LDA, LDX,
+        LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, RLA, ROL, ROR, RRA, RTI, RTS,
+        SAX, SBC, SEC, SED, SEI, SHX, SHY, SLO, SRE, STA, STX, STY, TAS, TAX,
+        TAY, TSX, TXA, TXS, TYA, XAA,
+    };
+
+    // accuracy policies of Cpu::Step, each compiled into its own path
+
+    // cycles are added once per instruction and only the accesses the instruction needs hit the bus
+    struct InstructionAccuracy {
+        static const bool PerCycle = false;
+    };
+
+    // every bus cycle is issued in hardware order, dummy reads/writes included,
+    // and Cycles advances with each of them so that I/O sees the right cycle
+    struct CycleAccuracy {
+        static const bool PerCycle = true;
+    };
+
     class Cpu {
+    public:
+        // hot registers come first and are 64-byte aligned, so that they share one cache line
+
+        // cpu cycles
+        alignas(64) uint64_t Cycles;
+
+        // program counter
+        uint16_t PC;
+
+        // stack pointer
+        uint8_t SP;
+
+        // accumulator
+        uint8_t A;
+
+        // x register
+        uint8_t X;
+
+        // y register
+        uint8_t Y;
+
+        // status register without Z and N, which are kept lazily (bits 1 and 7 stay 0):
+        // carry (bit 0), interrupt disable (2), decimal (3), break (4), unused (5), overflow (6)
+        uint8_t P;
+
+        // interrupt type to execute
+        uint8_t Interrupt;
+
+        // number of cycles to stall
+        int Stall;
+
+#ifdef NESTAKE_COUNTERS
+        // executed instructions and stalled cycles (see counters.hpp)
+        uint64_t Instructions;
+        uint64_t StallCycles;
+#endif
     private:
+        friend class Jit;
+
+        // zero and negative flags are evaluated lazily from the last results
+        // written by setZ / setN / setZN (see flagZ / flagN)
+        uint8_t zResult;
+        uint8_t nResult;
+
         // struct consisting of information for instruction execution
         struct instructionParams {
             // instruction's id
@@ -30,21 +109,101 @@ namespace nestake {
             // the number of page cycles used by the instruction
             uint8_t PageCycle;
 
-            std::function<void (uint16_t, bool)> executor;
+            instructionExecutor executor;
         };
 
-        // map of all instructions
-        std::map<uint8_t , instructionParams> instructionTable;
-        std::map<int, std::string> idToInstructionName;
+        // all instructions by opcode, shared by every cpu (executor is nullptr for unsupported opcodes)
+        static const std::array<instructionParams, 256> &instructionTable();
+        static std::array<instructionParams, 256> buildInstructionTable();
+
+        // pre-decoded PRG-ROM of the loaded cartridge (nullptr if no cartridge)
+        std::shared_ptr<BlockCache> blocks;
+
+        // native code of hot PRG-ROM blocks (created on first use)
+        std::shared_ptr<Jit> jit;
+
+        // PC the last step fell through to. the recompiler only looks for a block where control
+        // was transferred, or after a compiled block, a branch or an instruction it cannot compile
+        // (noFallthrough)
+        static const uint32_t noFallthrough = 0x10000;
+        uint32_t fallthroughPC;
+
+        // decode the instruction at the address through the bus (used for code outside of PRG-ROM)
+        template <typename Accuracy>
+        DecodedInstruction decodeFromBus(uint16_t address);
+
+        // bus reads of the addressing phase, one cycle each in the cycle accurate mode
+        template <typename Accuracy>
+        uint8_t busRead(uint16_t address);
+        template <typename Accuracy>
+        uint16_t busRead16Bug(uint16_t address);
+
+        // decode every offset of PRG-ROM and link them into basic blocks
+        std::shared_ptr<BlockCache> decodePRG(const std::vector<uint8_t> &prg);
+
+        // whether instructions are being traced (constant false in builds without NESTAKE_TRACE)
+        bool tracing() const {
+#ifdef NESTAKE_TRACE
+            return Tracer != nullptr;
+#else
+            return false;
+#endif
+        }
+
+        // whether a debugger is attached to the memory (constant false in builds without NESTAKE_DEBUGGER)
+        bool debugging() const {
+#ifdef NESTAKE_DEBUGGER
+            return mem->Traps != nullptr;
+#else
+            return false;
+#endif
+        }
+
+        // count executed instructions (no-op in builds without NESTAKE_COUNTERS)
+        void countInstructions(uint64_t n) {
+#ifdef NESTAKE_COUNTERS
+            Instructions += n;
+#else
+            (void)n;
+#endif
+        }
+
+        // append the state at the beginning of the instruction to the tracer
+        void trace(const DecodedInstruction &inst, uint64_t cycles);
+
+        // execute a pair of instructions fused at decode time, or three iterations of the idle loop
+        void execFused(const DecodedInstruction &first, const DecodedInstruction &second);
     public:
         // flag related
         uint8_t getFlag();
-        void setZ(uint8_t v);
-        void setN(uint8_t v);
-        void setZN(uint8_t v);
+        void setZ(uint8_t v) { zResult = v; }
+        void setN(uint8_t v) { nResult = v; }
+        void setZN(uint8_t v) { zResult = v; nResult = v; }
         void compare(uint8_t a, uint8_t b);
         void setFlags(uint8_t flag);
 
+        // carry, interrupt disable, decimal, break, unused and overflow flags (0 or 1)
+        uint8_t flagC() const { return P & uint8_t(1); }
+        uint8_t flagI() const { return (P >> 2) & uint8_t(1); }
+        uint8_t flagD() const { return (P >> 3) & uint8_t(1); }
+        uint8_t flagB() const { return (P >> 4) & uint8_t(1); }
+        uint8_t flagU() const { return (P >> 5) & uint8_t(1); }
+        uint8_t flagV() const { return (P >> 6) & uint8_t(1); }
+        void setFlagC(uint8_t c) { P = uint8_t((P & ~0x01) | (c & 1)); }
+        void setFlagI(uint8_t i) { P = uint8_t((P & ~0x04) | (i & 1) << 2); }
+        void setFlagD(uint8_t d) { P = uint8_t((P & ~0x08) | (d & 1) << 3); }
+        void setFlagB(uint8_t b) { P = uint8_t((P & ~0x10) | (b & 1) << 4); }
+        void setFlagU(uint8_t u) { P = uint8_t((P & ~0x20) | (u & 1) << 5); }
+        void setFlagV(uint8_t v) { P = uint8_t((P & ~0x40) | (v & 1) << 6); }
+
+        // zero flag
+        uint8_t flagZ() const { return zResult == 0; }
+        void setFlagZ(uint8_t z) { zResult = z ? 0 : 1; }
+
+        // negative flag
+        uint8_t flagN() const { return nResult != 0; }
+        void setFlagN(uint8_t n) { nResult = n; }
+
         // interruption related methods
         void irq();
         void nmi();
@@ -61,63 +220,51 @@ namespace nestake {
         uint16_t read16(uint16_t);
         uint16_t read16Bug(uint16_t);
 
-        // debug flag
-        bool IsDebugMode;
-
-        // pointer to CPUMemory
-        std::shared_ptr<CPUMemory> mem;
-
-        // cpu cycles
-        uint64_t Cycles;
-
-        // program counter
-        uint16_t PC;
-
-        // stack pointer
-        uint8_t SP;
-
-        // accumulator
-        uint8_t A;
-
-        // x register
-        uint8_t X;
-
-        // y register
-        uint8_t Y;
+#ifdef NESTAKE_TRACE
+        // every instruction is appended to the tracer when set (disables the recompiler and fusion)
+        std::shared_ptr<TraceBuffer> Tracer;
+#endif
 
-        // c register
-        uint8_t C;
+        // run hot PRG-ROM blocks as native code (x86-64 only, ignored elsewhere)
+        bool IsJITMode;
 
-        // zero flag
-        uint8_t Z;
+        // dispatch fused instruction pairs and idle loops of PRG-ROM as a single step
+        bool IsFusionMode;
 
-        // interrupt disable flag
-        uint8_t I;
+        // Step() with CycleAccuracy instead of InstructionAccuracy (disables the recompiler and fusion)
+        bool IsCycleAccurate;
 
-        // decimal mode flag
-        uint8_t D;
+        // counts executed opcode pairs when set (nullptr by default)
+        std::shared_ptr<PairCounter> Pairs;
 
-        //break command flag
-        uint8_t B;
+        // compiled blocks are written to the perf map when set (nullptr by default)
+        std::shared_ptr<PerfMap> Perf;
 
-        // unused flag
-        uint8_t U;
+        // profiles executed instructions when set (nullptr by default, disables the recompiler)
+        std::shared_ptr<Profiler> Profile;
 
-        // overflow flag
-        uint8_t V;
+        // decode the instruction with given opcode and operand bytes
+        DecodedInstruction Decode(uint8_t op, uint16_t operand);
 
-        // negative flag
-        uint8_t N;
+        // mnemonic of the opcode ("???" for unsupported ones)
+        std::string InstructionName(uint8_t opcode) const;
 
-        // interrupt type to execute
-        uint8_t Interrupt;
+        // compiled blocks never run past this cycle, so the scheduler regains control in time
+        uint64_t CycleDeadline;
 
-        // number of cycles to stall
-        int Stall;
+        // pointer to CPUMemory
+        std::shared_ptr<CPUMemory> mem;
 
         // core method for executing instructions
         uint64_t Step();
 
+        // Step() with the given accuracy policy (InstructionAccuracy or CycleAccuracy)
+        template <typename Accuracy>
+        uint64_t Step();
+
+        // map the cartridge into the memory and share its decoded PRG-ROM
+        void LoadCartridge(std::shared_ptr<Cartridge>);
+
         // interruption related methods
         void Reset();
         void TriggerIRQ();
@@ -157,6 +304,7 @@ namespace nestake {
         void ExecLDX(uint16_t, bool);
         void ExecLDY(uint16_t, bool);
         void ExecLSR(uint16_t, bool);
+        void ExecNOP(uint16_t, bool);
         void ExecORA(uint16_t, bool);
         void ExecPHA(uint16_t, bool);
         void ExecPHP(uint16_t, bool);
@@ -182,6 +330,10 @@ namespace nestake {
 
         // setup (instruction table)
         explicit Cpu(std::shared_ptr<CPUMemory>);
+
+        // registers into / from the cpu fields of the state
+        void SaveState(ConsoleState &state);
+        void LoadState(const ConsoleState &state);
     };
 
     bool isPageCrossed(uint16_t, uint16_t);
@@ -0,0 +1,55 @@
+#include "debugger.hpp"
+
+namespace nestake {
+
+    Debugger::Debugger(): stopped(false), event(), resuming(false) {
+        pages.fill(0);
+    }
+
+    void Debugger::arm(const trap &t) {
+        traps.push_back(t);
+        for (int page = t.First >> 8; page <= t.Last >> 8; ++page) {
+            pages[page] |= t.Kinds;
+        }
+    }
+
+    void Debugger::AddBreakpoint(uint16_t pc, Condition check, void *context) {
+        trap t = {pc, pc, TrapExecute, check, context};
+        arm(t);
+    }
+
+    void Debugger::AddWatchpoint(uint16_t first, uint16_t last, uint8_t kinds, Condition check, void *context) {
+        trap t = {first, last, uint8_t(kinds & (TrapRead | TrapWrite)), check, context};
+        arm(t);
+    }
+
+    void Debugger::Clear() {
+        traps.clear();
+        pages.fill(0);
+        stopped = false;
+        resuming = false;
+    }
+
+    bool Debugger::hit(uint8_t kind, uint16_t address, uint8_t value, uint64_t cycles) {
+        DebugEvent e = {kind, value, address, cycles};
+        for (size_t i = 0; i < traps.size(); ++i) {
+            const trap &t = traps[i];
+            if ((t.Kinds & kind) && address >= t.First && address <= t.Last &&
+                (t.Check == nullptr || t.Check(t.Context, e))) {
+                stopped = true;
+                event = e;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Debugger::OnExecute(uint16_t pc, uint64_t cycles) {
+        if (resuming && event.Kind == TrapExecute && event.Address == pc && event.Cycles == cycles) {
+            resuming = false;
+            return false;
+        }
+        resuming = hit(TrapExecute, pc, 0, cycles);
+        return resuming;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef NESTAKE_DEBUGGER_TRAPS
+#define NESTAKE_DEBUGGER_TRAPS
+
+#include <array>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+namespace nestake {
+
+    // trap flags of a 256-byte page of the cpu bus
+    enum TrapFlags {
+        TrapRead = 1,
+        TrapWrite = 2,
+        TrapExecute = 4,
+    };
+
+    // access that stopped the debugger
+    struct DebugEvent {
+        // TrapRead, TrapWrite or TrapExecute
+        uint8_t Kind;
+
+        // value read or written (0 for breakpoints)
+        uint8_t Value;
+
+        // accessed address, or the PC of a breakpoint
+        uint16_t Address;
+
+        // cpu cycles when it happened
+        uint64_t Cycles;
+    };
+
+    // breakpoints (PC) and read / write watchpoints (address ranges) of a cpu bus.
+    // armed addresses set trap flags in a page table that CPUMemory and Cpu look at only
+    // when it is attached (CPUMemory::Traps): untrapped pages take the usual path, and
+    // nothing is checked at all in builds without NESTAKE_DEBUGGER.
+    // a breakpoint stops before its instruction (Step returns 0), a watchpoint after the
+    // instruction making the access; stepping again goes on from there.
+    class Debugger {
+    public:
+        // optional predicate of a trap: stop only when it returns true
+        typedef bool (*Condition)(void *context, const DebugEvent &event);
+    private:
+        struct trap {
+            uint16_t First;
+            uint16_t Last;
+            uint8_t Kinds;
+            Condition Check;
+            void *Context;
+        };
+
+        std::array<uint8_t, 256> pages;
+        std::vector<trap> traps;
+
+        bool stopped;
+        DebugEvent event;
+
+        // the breakpoint stopped at, passed through by the next Step
+        bool resuming;
+
+        void arm(const trap &t);
+        bool hit(uint8_t kind, uint16_t address, uint8_t value, uint64_t cycles);
+    public:
+        Debugger();
+
+        void AddBreakpoint(uint16_t pc, Condition check = nullptr, void *context = nullptr);
+
+        // kinds: TrapRead and / or TrapWrite over first-last (inclusive)
+        void AddWatchpoint(uint16_t first, uint16_t last, uint8_t kinds,
+                           Condition check = nullptr, void *context = nullptr);
+
+        // remove every breakpoint and watchpoint
+        void Clear();
+
+        // trap flags by page (address >> 8)
+        const uint8_t *Traps() const { return pages.data(); }
+
+        // whether a trap was hit since the last Resume
+        bool Stopped() const { return stopped; }
+        const DebugEvent &Event() const { return event; }
+        void Resume() { stopped = false; }
+
+        // called on the accesses of trapped pages
+        void OnRead(uint16_t address, uint8_t value, uint64_t cycles) { hit(TrapRead, address, value, cycles); }
+        void OnWrite(uint16_t address, uint8_t value, uint64_t cycles) { hit(TrapWrite, address, value, cycles); }
+
+        // called before an instruction of a trapped page; true to stop before it
+        bool OnExecute(uint16_t pc, uint64_t cycles);
+    };
+}
+
+#endif
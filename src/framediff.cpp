@@ -0,0 +1,119 @@
+#include <cstring>
+#include <utility>
+
+#include "framediff.hpp"
+#include "simd.hpp"
+
+namespace nestake {
+
+    static const size_t lineSize = 256;
+    static const size_t frameLines = 240;
+
+    FrameDiffStream::FrameDiffStream(const std::string &path):
+        frame(lineSize*frameLines, 0), out(nullptr), written(0) {
+        pending.Frame = 0;
+        last.Frame = 0;
+        if (path.empty()) {
+            return;
+        }
+        out = std::fopen(path.c_str(), "wb");
+        if (out == nullptr) {
+            return;
+        }
+        FrameDiffHeader h = {{'N', 'E', 'S', 'D', 'I', 'F', 'F', 0}, 1, uint16_t(lineSize), uint16_t(frameLines)};
+        written += sizeof(h) * std::fwrite(&h, sizeof(h), 1, out);
+    }
+
+    FrameDiffStream::~FrameDiffStream() {
+        if (out != nullptr) {
+            std::fclose(out);
+        }
+    }
+
+    void FrameDiffStream::Line(int line, const uint8_t *pixels) {
+        if (Simd().UpdateBytes(pixels, &frame[size_t(line)*lineSize], lineSize)) {
+            pending.Lines.push_back(uint8_t(line));
+            pending.Pixels.insert(pending.Pixels.end(), pixels, pixels + lineSize);
+        }
+    }
+
+    void FrameDiffStream::EndFrame() {
+        if (out != nullptr) {
+            uint32_t lines = uint32_t(pending.Lines.size());
+            written += sizeof(pending.Frame) * std::fwrite(&pending.Frame, sizeof(pending.Frame), 1, out);
+            written += sizeof(lines) * std::fwrite(&lines, sizeof(lines), 1, out);
+            written += std::fwrite(pending.Lines.data(), 1, pending.Lines.size(), out);
+            written += std::fwrite(pending.Pixels.data(), 1, pending.Pixels.size(), out);
+        }
+        // swapping keeps the capacity of both diffs
+        std::swap(last, pending);
+        pending.Frame = last.Frame + 1;
+        pending.Lines.clear();
+        pending.Pixels.clear();
+    }
+
+    // lines in increasing order within the frame, with their pixels
+    static bool isValid(const FrameDiff &diff) {
+        if (diff.Lines.size() > frameLines || diff.Pixels.size() != diff.Lines.size()*lineSize) {
+            return false;
+        }
+        for (size_t i = 0; i < diff.Lines.size(); ++i) {
+            if (diff.Lines[i] >= frameLines || (i > 0 && diff.Lines[i] <= diff.Lines[i - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ApplyFrameDiff(const FrameDiff &diff, uint8_t *frame) {
+        if (!isValid(diff)) {
+            return false;
+        }
+        for (size_t i = 0; i < diff.Lines.size(); ++i) {
+            std::memcpy(frame + size_t(diff.Lines[i])*lineSize, &diff.Pixels[i*lineSize], lineSize);
+        }
+        return true;
+    }
+
+    FrameDiffReader::FrameDiffReader(const std::string &path): corrupt(false) {
+        in = std::fopen(path.c_str(), "rb");
+        if (in == nullptr) {
+            return;
+        }
+        FrameDiffHeader h;
+        if (std::fread(&h, sizeof(h), 1, in) != 1 || std::memcmp(h.Magic, "NESDIFF", 8) != 0 ||
+            h.Version != 1 || h.Width != lineSize || h.Height != frameLines) {
+            std::fclose(in);
+            in = nullptr;
+        }
+    }
+
+    FrameDiffReader::~FrameDiffReader() {
+        if (in != nullptr) {
+            std::fclose(in);
+        }
+    }
+
+    bool FrameDiffReader::Next(FrameDiff &diff) {
+        if (in == nullptr || corrupt) {
+            return false;
+        }
+        uint32_t lines;
+        size_t n = std::fread(&diff.Frame, 1, sizeof(diff.Frame), in);
+        if (n == 0 && std::feof(in)) {
+            return false;
+        }
+        if (n != sizeof(diff.Frame) || std::fread(&lines, sizeof(lines), 1, in) != 1 || lines > frameLines) {
+            corrupt = true;
+            return false;
+        }
+        diff.Lines.resize(lines);
+        diff.Pixels.resize(lines*lineSize);
+        if (std::fread(diff.Lines.data(), 1, lines, in) != lines ||
+            std::fread(diff.Pixels.data(), 1, diff.Pixels.size(), in) != diff.Pixels.size() || !isValid(diff)) {
+            corrupt = true;
+            return false;
+        }
+        return true;
+    }
+}
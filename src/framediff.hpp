@@ -0,0 +1,96 @@
+#ifndef NESTAKE_FRAMEDIFF
+#define NESTAKE_FRAMEDIFF
+
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace nestake {
+
+    // scanlines of a frame that differ from the previous frame, as system palette indices (0-63).
+    // the frame before the first one is all 0
+    struct FrameDiff {
+        // number of the frame in its stream (0 for the first one)
+        uint64_t Frame;
+
+        // changed scanlines in increasing order
+        std::vector<uint8_t> Lines;
+
+        // 256 pixels per changed scanline
+        std::vector<uint8_t> Pixels;
+    };
+
+    // header at the beginning of a diff file, followed by one record per frame:
+    // uint64_t frame, uint32_t number of lines, the lines then their pixels
+    struct FrameDiffHeader {
+        // "NESDIFF"
+        char Magic[8];
+        uint32_t Version;
+        uint16_t Width;
+        uint16_t Height;
+    };
+
+    // frame diffs fed by PPU::RenderFrame with the scanlines it publishes (set PPU::Diffs to use it).
+    // the diffs can be read from Last() after every frame and appended to a file
+    class FrameDiffStream {
+    private:
+        // published frame
+        std::vector<uint8_t> frame;
+        FrameDiff pending;
+        FrameDiff last;
+        FILE *out;
+        uint64_t written;
+    public:
+        // an empty path, or a file that cannot be created (see IsOpen), keeps the diffs in memory only
+        explicit FrameDiffStream(const std::string &path = "");
+        ~FrameDiffStream();
+        FrameDiffStream(const FrameDiffStream &) = delete;
+        FrameDiffStream &operator=(const FrameDiffStream &) = delete;
+
+        // a scanline (256 pixels) of the frame being published; kept if it changed
+        void Line(int line, const uint8_t *pixels);
+
+        // the frame is complete: it becomes Last() and is written to the file
+        void EndFrame();
+
+        // diff of the last complete frame
+        const FrameDiff &Last() const { return last; }
+
+        // last complete frame (256*240 pixels)
+        const uint8_t *Frame() const { return frame.data(); }
+
+        // bytes written to the file so far
+        uint64_t BytesWritten() const { return written; }
+
+        // false if there is no file or it could not be created
+        bool IsOpen() const { return out != nullptr; }
+    };
+
+    // apply a diff onto the frame before it (256*240 pixels).
+    // false, leaving the frame untouched, if a line is out of the frame or pixels are missing
+    bool ApplyFrameDiff(const FrameDiff &diff, uint8_t *frame);
+
+    // reader of the diffs of a file written by FrameDiffStream
+    class FrameDiffReader {
+    private:
+        FILE *in;
+        bool corrupt;
+    public:
+        explicit FrameDiffReader(const std::string &path);
+        ~FrameDiffReader();
+        FrameDiffReader(const FrameDiffReader &) = delete;
+        FrameDiffReader &operator=(const FrameDiffReader &) = delete;
+
+        // false if the file can not be read or is not a diff file
+        bool IsOpen() const { return in != nullptr; }
+
+        // next diff; false at the end of the file or on a malformed record
+        bool Next(FrameDiff &diff);
+
+        // whether Next stopped on a malformed or truncated record rather than at the end of the file
+        bool IsCorrupt() const { return corrupt; }
+    };
+}
+
+#endif
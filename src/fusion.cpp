@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "cpu.hpp"
+#include "fusion.hpp"
+
+namespace nestake {
+
+    uint8_t FusedPairOf(const DecodedInstruction &first, const DecodedInstruction &second) {
+        instructionExecutor a = first.Executor;
+        instructionExecutor b = second.Executor;
+        if (a == nullptr || b == nullptr) {
+            return fuseNone;
+        }
+
+        if (b == &Cpu::ExecBNE) {
+            if (a == &Cpu::ExecDEX) return fuseDEXBNE;
+            if (a == &Cpu::ExecDEY) return fuseDEYBNE;
+            if (a == &Cpu::ExecINX) return fuseINXBNE;
+            if (a == &Cpu::ExecINY) return fuseINYBNE;
+        }
+        if (a == &Cpu::ExecLDA && first.AddressingMode == Absolute &&
+            b == &Cpu::ExecSTA && second.AddressingMode == Absolute) {
+            return fuseLDASTA;
+        }
+        if (a == &Cpu::ExecINC && first.AddressingMode == ZeroPage &&
+            b == &Cpu::ExecLDA && second.AddressingMode == ZeroPage) {
+            return fuseINCLDA;
+        }
+        if (a == &Cpu::ExecCMP && first.AddressingMode == Immediate) {
+            if (b == &Cpu::ExecBEQ) return fuseCMPBEQ;
+            if (b == &Cpu::ExecBNE) return fuseCMPBNE;
+        }
+        return fuseNone;
+    }
+
+    PairCounter::PairCounter(): counts(0x10000, 0), previous(0x100) {}
+
+    std::vector<PairCounter::Pair> PairCounter::Hottest(size_t n) const {
+        std::vector<Pair> pairs;
+        for (uint32_t i = 0; i < counts.size(); ++i) {
+            if (counts[i] > 0) {
+                Pair p = {uint8_t(i >> 8), uint8_t(i & 0xFF), counts[i]};
+                pairs.push_back(p);
+            }
+        }
+        std::stable_sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b) {
+            return a.Count > b.Count;
+        });
+        if (pairs.size() > n) {
+            pairs.resize(n);
+        }
+        return pairs;
+    }
+
+    void PairCounter::Report(std::ostream &out, const Cpu &cpu, size_t n) const {
+        std::vector<Pair> pairs = Hottest(n);
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            out << std::hex << std::uppercase << std::setfill('0')
+                << cpu.InstructionName(pairs[i].First) << "(" << std::setw(2) << int(pairs[i].First) << ") -> "
+                << cpu.InstructionName(pairs[i].Second) << "(" << std::setw(2) << int(pairs[i].Second) << "): "
+                << std::dec << pairs[i].Count << "\n";
+        }
+    }
+
+    void PairCounter::Clear() {
+        std::fill(counts.begin(), counts.end(), 0);
+        previous = 0x100;
+    }
+}
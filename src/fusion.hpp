@@ -0,0 +1,82 @@
+#ifndef NESTAKE_FUSION
+#define NESTAKE_FUSION
+
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+#include "block.hpp"
+
+namespace nestake {
+    class Cpu;
+
+    // frequent instruction pairs dispatched as a single handler, and the idle loop.
+    // PairCounter::Report over 120 frames of sample.nes (executed pairs):
+    //   JMP abs -> JMP abs (to itself)     1181927  idle loop
+    //   DEY -> BNE                              29  copy loop
+    // the other loop counters, copies and compares are the idioms of the original set.
+    // sequences only the synthetic bench workloads run are not fused, so the set is not
+    // tuned to the benchmark measuring it
+    enum FusedSequence {
+        fuseNone = 0,
+
+        // pairs
+        fuseDEXBNE,  // DEX / BNE
+        fuseDEYBNE,  // DEY / BNE
+        fuseINXBNE,  // INX / BNE
+        fuseINYBNE,  // INY / BNE
+        fuseLDASTA,  // LDA abs / STA abs
+        fuseINCLDA,  // INC zp / LDA zp
+        fuseCMPBEQ,  // CMP #imm / BEQ
+        fuseCMPBNE,  // CMP #imm / BNE
+
+        // JMP abs to its own address, three iterations ending by Cpu::CycleDeadline
+        fuseJMPSelf,
+    };
+
+    // number of instructions of the fused sequence (1 for fuseNone)
+    inline int FusedLength(uint8_t fusion) {
+        return fusion == fuseNone ? 1 : fusion == fuseJMPSelf ? 3 : 2;
+    }
+
+    // superinstruction formed by the two consecutive instructions (fuseNone if none)
+    uint8_t FusedPairOf(const DecodedInstruction &first, const DecodedInstruction &second);
+
+
+    // dynamic count of consecutive opcode pairs, used to pick the fused pairs from real games
+    class PairCounter {
+    private:
+        std::vector<uint64_t> counts;
+        uint16_t previous;
+    public:
+        struct Pair {
+            uint8_t First;
+            uint8_t Second;
+            uint64_t Count;
+        };
+
+        PairCounter();
+
+        // record the executed opcode
+        void Count(uint8_t opcode) {
+            if (previous <= 0xFF) {
+                ++counts[(previous << 8) | opcode];
+            }
+            previous = opcode;
+        }
+
+        uint64_t Get(uint8_t first, uint8_t second) const {
+            return counts[(first << 8) | second];
+        }
+
+        // the n most executed pairs in descending order
+        std::vector<Pair> Hottest(size_t n) const;
+
+        // write the n most executed pairs with their mnemonics, one per line
+        void Report(std::ostream &out, const Cpu &cpu, size_t n) const;
+
+        void Clear();
+    };
+}
+
+#endif
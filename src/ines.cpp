@@ -24,50 +24,98 @@ namespace nestake {
             fputs ("File error", stderr); exit (1);
         }
 
+        std::vector<uint8_t> image;
+        uint8_t buf[0x4000];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+            image.insert(image.end(), buf, buf + n);
+        }
+        std::fclose(f);
+        load(image);
+
+        if (Battery) {
+            // game.nes -> game.sav
+            size_t dot = path.find_last_of('.');
+            if (dot == std::string::npos || path.find_first_of('/', dot) != std::string::npos) {
+                dot = path.size();
+            }
+            SavePath = path.substr(0, dot) + ".sav";
+        }
+    }
+
+    Cartridge::Cartridge(const std::vector<uint8_t> &image) {
+        load(image);
+    }
+
+    void Cartridge::load(const std::vector<uint8_t> &image) {
+        if (image.size() < 16) {
+            fputs ("File error", stderr); exit (1);
+        }
+
         // read magic number
-        uint8_t nesMagic[4]={};
-        std::fread(nesMagic, 1, 4, f);
-        checkMagicNumber(nesMagic);
+        checkMagicNumber(image.data());
 
         // Size of PRG ROM in 16 KB units
-        uint8_t  numPRG;
-        std::fread(&numPRG, 1, 1, f);
+        uint8_t  numPRG = image[4];
         if (numPRG == 0) {
             fputs ("File error", stderr); exit (1);
         }
 
         // Size of CHR ROM in 8 KB units (Value 0 means the board uses CHR RAM)
-        uint8_t  numCHR;
-        std::fread(&numCHR, 1, 1, f);
+        uint8_t  numCHR = image[5];
         if (numCHR == 0) {
             fputs ("File error", stderr); exit (1);
         }
 
         // flag 6
-        uint8_t control1;
-        std::fread(&control1, 1, 1, f);
+        uint8_t control1 = image[6];
 
         // flag 7
-        uint8_t control2;
-        std::fread(&control2, 1, 1, f);
+        uint8_t control2 = image[7];
 
         // define mapper
         Mapper = (control2 & uint8_t(0b11110000)) | ((control1 & uint8_t(0b11110000)) >> 4);
-        Mirror = (control1 & uint8_t(0b00000001)) | (control1 & uint8_t(0b00000100));
-
-        // padding
-        std::fread(new(uint8_t[8]), 1, 8, f);
+        // bit 3 (four screen VRAM) overrides bit 0
+        Mirror = (control1 & uint8_t(0b00001000)) ? uint8_t(MirrorFour) : uint8_t(control1 & uint8_t(0b00000001));
+        Battery = (control1 & uint8_t(0b00000010)) != 0;
 
-        // read PRG
-        PRG.reserve(size_t(0x4000*numPRG));
-        for (auto i = 0; i < size_t(0x4000*numPRG); ++i ) {
-            std::fread(&PRG[i], 1, 1, f);
+        // PRG and CHR follow the 8 bytes of padding
+        size_t prgSize = size_t(0x4000*numPRG);
+        size_t chrSize = size_t(0x2000*numCHR);
+        if (image.size() < 16 + prgSize + chrSize) {
+            fputs ("File error", stderr); exit (1);
         }
+        PRG.assign(image.begin() + 16, image.begin() + 16 + prgSize);
+        CHR.assign(image.begin() + 16 + prgSize, image.begin() + 16 + prgSize + chrSize);
+    }
 
-        // read CHR
-        CHR.reserve(size_t(0x4000*numCHR));
-        for (auto i = 0; i < size_t(0x4000*numPRG); ++i ) {
-            std::fread(&CHR[i], 1, 1, f);
+    std::vector<uint8_t> MakeINES(const std::vector<uint8_t> &prg, const std::vector<uint8_t> &chr,
+                                  uint8_t mapper, uint8_t mirror, bool battery) {
+        size_t numPRG = (prg.size() + 0x3FFF) / 0x4000;
+        size_t numCHR = (chr.size() + 0x1FFF) / 0x2000;
+        if (numPRG == 0) {
+            numPRG = 1;
         }
+        if (numCHR == 0) {
+            numCHR = 1;
+        }
+
+        std::vector<uint8_t> image(16, 0);
+        image[0] = 0x4e;
+        image[1] = 0x45;
+        image[2] = 0x53;
+        image[3] = 0x1a;
+        image[4] = uint8_t(numPRG);
+        image[5] = uint8_t(numCHR);
+        image[6] = uint8_t((mapper & 0x0F) << 4) | (mirror == MirrorFour ? uint8_t(0b00001000) : uint8_t(mirror & 1)) |
+                   (battery ? uint8_t(0b00000010) : uint8_t(0));
+        image[7] = mapper & uint8_t(0xF0);
+
+        // unused PRG is filled like an erased EPROM
+        image.insert(image.end(), prg.begin(), prg.end());
+        image.resize(16 + numPRG*0x4000, 0xFF);
+        image.insert(image.end(), chr.begin(), chr.end());
+        image.resize(16 + numPRG*0x4000 + numCHR*0x2000, 0);
+        return image;
     }
 }
@@ -5,16 +5,44 @@
 #include <string>
 #include <vector>
 
+#include "block.hpp"
+
 namespace nestake{
+    // values of Cartridge::Mirror (the single screen layouts are selected by mappers)
+    enum MirrorMode {
+        MirrorHorizontal = 0,
+        MirrorVertical = 1,
+        MirrorSingle0 = 2,
+        MirrorSingle1 = 3,
+        MirrorFour = 4,
+    };
+
     class Cartridge {
     public:
         std::vector<uint8_t> PRG;
         std::vector<uint8_t> CHR;
-        std::vector<uint8_t> SRAM;
         uint8_t Mapper;
         uint8_t Mirror;
+
+        // flag 6 bit 1: consoles get battery-backed SRAM at 0x6000-0x7FFF (CPUMemory::SRAM)
+        bool Battery;
+
+        // game.sav next to a ROM file with a battery (empty otherwise), see CPUMemory::MapSaveFile
+        std::string SavePath;
+
+        // decoded PRG-ROM shared by every console running this cartridge (built on first load)
+        std::shared_ptr<BlockCache> Blocks;
         explicit Cartridge(std::string);
+
+        // cartridge from an iNES image in memory
+        explicit Cartridge(const std::vector<uint8_t> &image);
+    private:
+        void load(const std::vector<uint8_t> &image);
     };
+
+    // iNES image of the given ROMs, padded to 16KB PRG / 8KB CHR units (at least one of each)
+    std::vector<uint8_t> MakeINES(const std::vector<uint8_t> &prg, const std::vector<uint8_t> &chr,
+                                  uint8_t mapper = 0, uint8_t mirror = 0, bool battery = false);
 }
 
 #endif
@@ -0,0 +1,576 @@
+/*
+ * x86-64 code generation for hot PRG-ROM blocks.
+ *
+ * while a block runs, the cpu pointer lives in rbx, CPUMemory::RAM in r15 and
+ * A / X / Y in r12 / r13 / r14. results are stored into the lazy Z / N bytes of the
+ * register file and the other flags are bits of Cpu::P.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define NESTAKE_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "cpu.hpp"
+#include "jit.hpp"
+#include "perfmap.hpp"
+
+namespace nestake {
+    // state of Jit::entry
+    const int32_t notCompiled = -1;
+    const int32_t notCompilable = -2;
+    const uint32_t freeEntry = 0xFFFFFFFF;
+
+    // host registers
+    const int regA = 12;
+    const int regX = 13;
+    const int regY = 14;
+
+    // limits
+    const size_t jitCodeCapacity = 1 << 20;
+    const size_t jitMaxBlockInstructions = 64;
+    const uint32_t jitInitialEntryBits = 8;
+
+    // bus callbacks used for everything outside of RAM (I/O registers, PRG-ROM, ...)
+    uint8_t jitRead(Cpu *cpu, uint16_t address) {
+        return cpu->mem->Read(address);
+    }
+
+    void jitWrite(Cpu *cpu, uint16_t address, uint8_t value) {
+        cpu->mem->Write(address, value);
+    }
+
+    int32_t memberOffset(const Cpu &cpu, const void *member) {
+        return int32_t(reinterpret_cast<const uint8_t *>(member) - reinterpret_cast<const uint8_t *>(&cpu));
+    }
+
+    Jit::Jit(const Cpu &cpu): code(nullptr), codeCapacity(0), codeSize(0), entryBits(0), entryMask(0), usedEntries(0),
+                              syncedCycles(0), busWritten(false), mapperAttached(false),
+                              declined(false) {
+        offA = memberOffset(cpu, &cpu.A);
+        offX = memberOffset(cpu, &cpu.X);
+        offY = memberOffset(cpu, &cpu.Y);
+        offSP = memberOffset(cpu, &cpu.SP);
+        offPC = memberOffset(cpu, &cpu.PC);
+        offP = memberOffset(cpu, &cpu.P);
+        offZ = memberOffset(cpu, &cpu.zResult);
+        offN = memberOffset(cpu, &cpu.nResult);
+        offCycles = memberOffset(cpu, &cpu.Cycles);
+        growEntries();
+
+#ifdef NESTAKE_JIT_X86_64
+        // W^X: pages are only made executable once their code is written (see install)
+        void *p = mmap(nullptr, jitCodeCapacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            code = static_cast<uint8_t *>(p);
+            codeCapacity = jitCodeCapacity;
+        }
+#endif
+    }
+
+    Jit::~Jit() {
+#ifdef NESTAKE_JIT_X86_64
+        if (code != nullptr) {
+            munmap(code, codeCapacity);
+        }
+#endif
+    }
+
+    bool Jit::IsSupported() {
+#ifdef NESTAKE_JIT_X86_64
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool Jit::Run(Cpu &cpu, const BlockCache &blocks, uint32_t prgOffset) {
+        declined = false;
+        if (code == nullptr) {
+            return false;
+        }
+
+        entry &e = find(prgOffset);
+        int32_t index = e.Index;
+        if (index == notCompiled) {
+            if (++e.Hits < HotThreshold) {
+                return false;
+            }
+            index = compile(cpu, blocks, prgOffset);
+            e.Index = index;
+            if (index >= 0 && cpu.Perf) {
+                const compiledBlock &b = compiled[index];
+                cpu.Perf->Add(reinterpret_cast<const void *>(b.Function), b.CodeSize, label(cpu, blocks, prgOffset, b));
+            }
+        }
+        if (index < 0) {
+            declined = true;
+            return false;
+        }
+
+        const compiledBlock &b = compiled[index];
+        if (b.EntryPC != cpu.PC || cpu.Cycles + b.MaxCycles > cpu.CycleDeadline) {
+            // mirrored entry or the block would overrun the scheduler's deadline
+            return false;
+        }
+        b.Function(&cpu, cpu.mem->RAM.data());
+#ifdef NESTAKE_COUNTERS
+        cpu.Instructions += b.Instructions;
+#endif
+        return true;
+    }
+
+    Jit::entry &Jit::find(uint32_t prgOffset) {
+        for (;;) {
+            // fibonacci hashing: the top entryBits bits of the product
+            size_t i = (prgOffset * 0x9E3779B1u) >> (32 - entryBits);
+            while (entries[i].Offset != prgOffset && entries[i].Offset != freeEntry) {
+                i = (i + 1) & entryMask;
+            }
+            entry &e = entries[i];
+            if (e.Offset == prgOffset) {
+                return e;
+            }
+            if (2*(usedEntries + 1) <= entries.size()) {
+                e.Offset = prgOffset;
+                ++usedEntries;
+                return e;
+            }
+            growEntries();
+        }
+    }
+
+    void Jit::growEntries() {
+        std::vector<entry> old;
+        old.swap(entries);
+        entryBits = old.empty() ? jitInitialEntryBits : entryBits + 1;
+        const entry unused = {freeEntry, notCompiled, 0};
+        entries.assign(size_t(1) << entryBits, unused);
+        entryMask = entries.size() - 1;
+        usedEntries = 0;
+        for (const entry &e : old) {
+            if (e.Offset != freeEntry) {
+                find(e.Offset) = e;
+            }
+        }
+    }
+
+    std::string Jit::label(Cpu &cpu, const BlockCache &blocks, uint32_t prgOffset, const compiledBlock &b) const {
+        // banks of 16KB
+        uint8_t bank = uint8_t(prgOffset / 0x4000);
+        char location[16];
+        std::snprintf(location, sizeof(location), "%02X:%04X", bank, b.EntryPC);
+
+        std::string name = std::string("nestake ") + location;
+        uint32_t prgSize = uint32_t(blocks.Instructions.size());
+        uint32_t offset = prgOffset;
+        for (uint16_t i = 0; i < b.Instructions; ++i) {
+            const DecodedInstruction &d = blocks.At(offset);
+            name += " " + cpu.InstructionName(d.Opcode);
+            offset = (offset + d.InstructionSizes) % prgSize;
+        }
+
+        std::string symbol = cpu.Perf->Symbol(bank, b.EntryPC);
+        if (!symbol.empty()) {
+            name += " (" + symbol + ")";
+        }
+        return name;
+    }
+
+    void Jit::emit(uint8_t v) {
+        buf.push_back(v);
+    }
+
+    void Jit::emit16(uint16_t v) {
+        emit(uint8_t(v));
+        emit(uint8_t(v >> 8));
+    }
+
+    void Jit::emit32(uint32_t v) {
+        emit16(uint16_t(v));
+        emit16(uint16_t(v >> 16));
+    }
+
+    void Jit::emit64(uint64_t v) {
+        emit32(uint32_t(v));
+        emit32(uint32_t(v >> 32));
+    }
+
+    // movzx reg32, byte [rbx + offset]
+    void Jit::emitLoadReg(int reg, int32_t offset) {
+        emit(0x44); emit(0x0F); emit(0xB6);
+        emit(uint8_t(0x80 | ((reg & 7) << 3) | 3));
+        emit32(uint32_t(offset));
+    }
+
+    // mov byte [rbx + offset], reg8
+    void Jit::emitStoreReg(int reg, int32_t offset) {
+        emit(0x44); emit(0x88);
+        emit(uint8_t(0x80 | ((reg & 7) << 3) | 3));
+        emit32(uint32_t(offset));
+    }
+
+    // and byte [rbx + offP], ~mask / or byte [rbx + offP], mask
+    void Jit::emitSetP(uint8_t mask, bool set) {
+        emit(0x80); emit(set ? uint8_t(0x8B) : uint8_t(0xA3));
+        emit32(uint32_t(offP));
+        emit(set ? mask : uint8_t(~mask));
+    }
+
+    // Cpu::setZN with the result in reg8 (0 stands for al)
+    void Jit::emitSetZN(int reg) {
+        if (reg == 0) {
+            // mov byte [rbx + offZ], al; mov byte [rbx + offN], al
+            emit(0x88); emit(0x83); emit32(uint32_t(offZ));
+            emit(0x88); emit(0x83); emit32(uint32_t(offN));
+            return;
+        }
+        emitStoreReg(reg, offZ);
+        emitStoreReg(reg, offN);
+    }
+
+    // call function with rdi = cpu (esi / edx are set by the caller)
+    void Jit::emitCall(const void *function) {
+        // mov rdi, rbx
+        emit(0x48); emit(0x89); emit(0xDF);
+        // mov rax, imm64; call rax
+        emit(0x48); emit(0xB8);
+        emit64(reinterpret_cast<uint64_t>(function));
+        emit(0xFF); emit(0xD0);
+    }
+
+    // Cpu::PC and Cpu::Cycles as the interpreter has them while the instruction executes,
+    // so that the bus callbacks (e.g. OAM DMA and its odd cycle) see the right cpu
+    void Jit::emitSync(uint16_t pc, uint32_t cycles) {
+        // mov word [rbx + offPC], imm16
+        emit(0x66); emit(0xC7); emit(0x83);
+        emit32(uint32_t(offPC));
+        emit16(pc);
+
+        if (cycles != syncedCycles) {
+            // add qword [rbx + offCycles], imm32
+            emit(0x48); emit(0x81); emit(0x83);
+            emit32(uint32_t(offCycles));
+            emit32(cycles - syncedCycles);
+            syncedCycles = cycles;
+        }
+    }
+
+    // exits share the synced cycles of the straight-line code before them
+    void Jit::emitExit(uint16_t pc, uint32_t cycles) {
+        emitStoreReg(regA, offA);
+        emitStoreReg(regX, offX);
+        emitStoreReg(regY, offY);
+
+        uint32_t synced = syncedCycles;
+        emitSync(pc, cycles);
+        syncedCycles = synced;
+
+        // pop r15; pop r14; pop r13; pop r12; pop rbx; ret
+        emit(0x41); emit(0x5F);
+        emit(0x41); emit(0x5E);
+        emit(0x41); emit(0x5D);
+        emit(0x41); emit(0x5C);
+        emit(0x5B);
+        emit(0xC3);
+    }
+
+    bool Jit::emitInstruction(const DecodedInstruction &d, uint16_t next, uint32_t cycles) {
+        instructionExecutor e = d.Executor;
+        busWritten = false;
+
+        switch (d.AddressingMode) {
+            case Implied: {
+                // inc / dec reg8
+                int reg = 0;
+                uint8_t ext = 0;
+                if (e == &Cpu::ExecINX) { reg = regX; ext = 0; }
+                else if (e == &Cpu::ExecINY) { reg = regY; ext = 0; }
+                else if (e == &Cpu::ExecDEX) { reg = regX; ext = 1; }
+                else if (e == &Cpu::ExecDEY) { reg = regY; ext = 1; }
+                if (reg != 0) {
+                    emit(0x41); emit(0xFE);
+                    emit(uint8_t(0xC0 | (ext << 3) | (reg & 7)));
+                    emitSetZN(reg);
+                    return true;
+                }
+
+                // mov dst8, src8
+                int src = 0, dst = 0;
+                if (e == &Cpu::ExecTAX) { src = regA; dst = regX; }
+                else if (e == &Cpu::ExecTAY) { src = regA; dst = regY; }
+                else if (e == &Cpu::ExecTXA) { src = regX; dst = regA; }
+                else if (e == &Cpu::ExecTYA) { src = regY; dst = regA; }
+                if (src != 0) {
+                    emit(0x45); emit(0x88);
+                    emit(uint8_t(0xC0 | ((src & 7) << 3) | (dst & 7)));
+                    emitSetZN(dst);
+                    return true;
+                }
+
+                if (e == &Cpu::ExecTXS) {
+                    emitStoreReg(regX, offSP);
+                } else if (e == &Cpu::ExecTSX) {
+                    emitLoadReg(regX, offSP);
+                    emitSetZN(regX);
+                } else if (e == &Cpu::ExecCLC) {
+                    emitSetP(0x01, false);
+                } else if (e == &Cpu::ExecSEC) {
+                    emitSetP(0x01, true);
+                } else if (e == &Cpu::ExecCLD) {
+                    emitSetP(0x08, false);
+                } else if (e == &Cpu::ExecSED) {
+                    emitSetP(0x08, true);
+                } else if (e == &Cpu::ExecCLV) {
+                    emitSetP(0x40, false);
+                } else if (e != &Cpu::ExecNOP) {
+                    return false;
+                }
+                return true;
+            }
+            case Immediate: {
+                uint8_t v = uint8_t(d.Operand);
+
+                // mov reg8, imm8
+                int reg = 0;
+                if (e == &Cpu::ExecLDA) { reg = regA; }
+                else if (e == &Cpu::ExecLDX) { reg = regX; }
+                else if (e == &Cpu::ExecLDY) { reg = regY; }
+                if (reg != 0) {
+                    emit(0x41); emit(uint8_t(0xB0 + (reg & 7))); emit(v);
+                    emitSetZN(reg);
+                    return true;
+                }
+
+                if (e == &Cpu::ExecCMP) {
+                    // mov eax, r12d; sub al, imm8; setae cl; and byte [rbx + offP], ~1; or byte [rbx + offP], cl
+                    emit(0x44); emit(0x89); emit(uint8_t(0xC0 | ((regA & 7) << 3)));
+                    emit(0x2C); emit(v);
+                    emit(0x0F); emit(0x93); emit(0xC1);
+                    emitSetP(0x01, false);
+                    emit(0x08); emit(0x8B);
+                    emit32(uint32_t(offP));
+                    emitSetZN(0);
+                    return true;
+                }
+
+                // {and, or, xor} A, imm8
+                uint8_t ext = 0;
+                if (e == &Cpu::ExecAND) { ext = 4; }
+                else if (e == &Cpu::ExecORA) { ext = 1; }
+                else if (e == &Cpu::ExecEOR) { ext = 6; }
+                else { return false; }
+                emit(0x41); emit(0x80);
+                emit(uint8_t(0xC0 | (ext << 3) | (regA & 7)));
+                emit(v);
+                emitSetZN(regA);
+                return true;
+            }
+            case ZeroPage:
+            case Absolute: {
+                uint16_t address = d.Operand;
+                bool inRAM = address < 0x2000;
+                uint32_t ramOffset = address % 0x800;
+
+                int load = 0, store = 0;
+                uint8_t ext = 0xFF;
+                if (e == &Cpu::ExecLDA) { load = regA; }
+                else if (e == &Cpu::ExecLDX) { load = regX; }
+                else if (e == &Cpu::ExecLDY) { load = regY; }
+                else if (e == &Cpu::ExecSTA) { store = regA; }
+                else if (e == &Cpu::ExecSTX) { store = regX; }
+                else if (e == &Cpu::ExecSTY) { store = regY; }
+                else if (e == &Cpu::ExecINC && inRAM) { ext = 0; }
+                else if (e == &Cpu::ExecDEC && inRAM) { ext = 1; }
+                else { return false; }
+
+                if (load != 0) {
+                    if (inRAM) {
+                        // movzx reg32, byte [r15 + offset]
+                        emit(0x45); emit(0x0F); emit(0xB6);
+                        emit(uint8_t(0x80 | ((load & 7) << 3) | 7));
+                        emit32(ramOffset);
+                    } else {
+                        // mov esi, address; call jitRead; movzx reg32, al
+                        emitSync(next, cycles);
+                        emit(0xBE); emit32(address);
+                        emitCall(reinterpret_cast<const void *>(&jitRead));
+                        emit(0x44); emit(0x0F); emit(0xB6);
+                        emit(uint8_t(0xC0 | ((load & 7) << 3)));
+                    }
+                    emitSetZN(load);
+                } else if (store != 0) {
+                    if (inRAM) {
+                        // mov byte [r15 + offset], reg8
+                        emit(0x45); emit(0x88);
+                        emit(uint8_t(0x80 | ((store & 7) << 3) | 7));
+                        emit32(ramOffset);
+                    } else {
+                        // mov esi, address; movzx edx, reg8; call jitWrite
+                        emitSync(next, cycles);
+                        emit(0xBE); emit32(address);
+                        emit(0x41); emit(0x0F); emit(0xB6);
+                        emit(uint8_t(0xC0 | (2 << 3) | (store & 7)));
+                        emitCall(reinterpret_cast<const void *>(&jitWrite));
+                        busWritten = address == 0x4014 || (address >= 0x4020 && mapperAttached);
+                    }
+                } else {
+                    // inc / dec byte [r15 + offset]; movzx eax, byte [r15 + offset]
+                    emit(0x41); emit(0xFE);
+                    emit(uint8_t(0x80 | (ext << 3) | 7));
+                    emit32(ramOffset);
+                    emit(0x41); emit(0x0F); emit(0xB6); emit(0x87);
+                    emit32(ramOffset);
+                    emitSetZN(0);
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool Jit::install() {
+#ifdef NESTAKE_JIT_X86_64
+        // the pages the block lands on are writable while it is copied, and executable after
+        uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+        uintptr_t first = reinterpret_cast<uintptr_t>(code + codeSize) & ~(pageSize - 1);
+        uintptr_t end = reinterpret_cast<uintptr_t>(code + codeSize + buf.size());
+        void *pages = reinterpret_cast<void *>(first);
+        size_t length = size_t(end - first);
+        if (mprotect(pages, length, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+        std::memcpy(code + codeSize, buf.data(), buf.size());
+        return mprotect(pages, length, PROT_READ | PROT_EXEC) == 0;
+#else
+        return false;
+#endif
+    }
+
+    int32_t Jit::compile(const Cpu &cpu, const BlockCache &blocks, uint32_t prgOffset) {
+        if (compiled.size() >= 0x7FFFFFFF) {
+            return notCompilable;
+        }
+        buf.clear();
+        syncedCycles = 0;
+        mapperAttached = cpu.mem->MapperWrite != nullptr;
+        const uint16_t pc = cpu.PC;
+
+        // push rbx; push r12; push r13; push r14; push r15
+        emit(0x53);
+        emit(0x41); emit(0x54);
+        emit(0x41); emit(0x55);
+        emit(0x41); emit(0x56);
+        emit(0x41); emit(0x57);
+        // mov rbx, rdi; mov r15, rsi
+        emit(0x48); emit(0x89); emit(0xFB);
+        emit(0x49); emit(0x89); emit(0xF7);
+        emitLoadReg(regA, offA);
+        emitLoadReg(regX, offX);
+        emitLoadReg(regY, offY);
+
+        uint32_t prgSize = uint32_t(blocks.Instructions.size());
+        uint32_t offset = prgOffset;
+        uint16_t current = pc;
+        uint32_t cycles = 0;
+        uint32_t maxCycles = 0;
+        size_t count = 0;
+        bool terminated = false;
+
+        while (count < jitMaxBlockInstructions) {
+            const DecodedInstruction &d = blocks.At(offset);
+            if (d.Executor == nullptr || uint32_t(current) + d.InstructionSizes > 0xFFFF) {
+                break;
+            }
+
+            if (d.AddressingMode == Relative) {
+                // the branch is taken when the `mask` bits of the byte at `flag` are (not) zero.
+                // note that Z is set when the last result is zero
+                int32_t flag = offP;
+                uint8_t mask = 0xFF;
+                bool takenWhenZero = false;
+                if (d.Executor == &Cpu::ExecBCC) { mask = 0x01; takenWhenZero = true; }
+                else if (d.Executor == &Cpu::ExecBCS) { mask = 0x01; }
+                else if (d.Executor == &Cpu::ExecBNE) { flag = offZ; }
+                else if (d.Executor == &Cpu::ExecBEQ) { flag = offZ; takenWhenZero = true; }
+                else if (d.Executor == &Cpu::ExecBPL) { flag = offN; takenWhenZero = true; }
+                else if (d.Executor == &Cpu::ExecBMI) { flag = offN; }
+                else if (d.Executor == &Cpu::ExecBVC) { mask = 0x40; takenWhenZero = true; }
+                else { mask = 0x40; }
+
+                uint16_t next = current + uint16_t(2);
+                uint16_t target = next + uint16_t(int8_t(uint8_t(d.Operand)));
+                uint32_t notTakenCycles = cycles + d.InstructionCycle;
+                uint32_t takenCycles = notTakenCycles + 1 + (isPageCrossed(next, target) ? 1 : 0);
+
+                // test byte [rbx + flag], mask; j{e,ne} notTaken
+                emit(0xF6); emit(0x83); emit32(uint32_t(flag)); emit(mask);
+                emit(0x0F); emit(takenWhenZero ? uint8_t(0x85) : uint8_t(0x84));
+                size_t patch = buf.size();
+                emit32(0);
+                emitExit(target, takenCycles);
+                uint32_t rel = uint32_t(buf.size() - (patch + 4));
+                std::memcpy(&buf[patch], &rel, 4);
+                emitExit(next, notTakenCycles);
+
+                maxCycles = takenCycles;
+                terminated = true;
+                ++count;
+                break;
+            }
+
+            if (d.Executor == &Cpu::ExecJMP && d.AddressingMode == Absolute) {
+                cycles += d.InstructionCycle;
+                emitExit(d.Operand, cycles);
+                maxCycles = cycles;
+                terminated = true;
+                ++count;
+                break;
+            }
+
+            uint16_t next = current + uint16_t(d.InstructionSizes);
+            if (!emitInstruction(d, next, cycles + d.InstructionCycle)) {
+                break;
+            }
+            cycles += d.InstructionCycle;
+            current = next;
+            offset = (uint32_t(current) - 0x8000) % prgSize;
+            ++count;
+
+            // an OAM DMA stall or a bank switch has to be seen before the next instruction
+            if (busWritten) {
+                break;
+            }
+        }
+
+        if (count < MinBlockInstructions) {
+            return notCompilable;
+        }
+        if (!terminated) {
+            emitExit(current, cycles);
+            maxCycles = cycles;
+        }
+        if (codeSize + buf.size() > codeCapacity) {
+            return notCompilable;
+        }
+
+        if (!install()) {
+            return notCompilable;
+        }
+
+        compiledBlock b = {};
+        b.Function = reinterpret_cast<jitFunction>(code + codeSize);
+        b.EntryPC = pc;
+        b.MaxCycles = uint16_t(maxCycles);
+        b.Instructions = uint16_t(count);
+        b.CodeSize = uint32_t(buf.size());
+        codeSize += buf.size();
+        compiled.push_back(b);
+        return int32_t(compiled.size() - 1);
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef NESTAKE_JIT
+#define NESTAKE_JIT
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "block.hpp"
+
+namespace nestake {
+    class Cpu;
+
+    // compiled native code of a PRG-ROM block: (cpu, pointer to CPUMemory::RAM)
+    typedef void (*jitFunction)(Cpu *, uint8_t *);
+
+    // x86-64 dynamic recompiler for hot PRG-ROM basic blocks.
+    // the ExecXXX implementations stay the reference: a block only contains instructions
+    // the compiler knows, and anything else is left to the interpreter.
+    class Jit {
+    private:
+        struct compiledBlock {
+            jitFunction Function;
+
+            // cpu address the block was compiled for (PRG-ROM can be mirrored)
+            uint16_t EntryPC;
+
+            // upper bound of cycles spent by the block (used against cycle deadline)
+            uint16_t MaxCycles;
+
+            // number of guest instructions of the block
+            uint16_t Instructions;
+
+            // number of bytes of emitted code
+            uint32_t CodeSize;
+        };
+
+        // memory of the compiled code, mapped either writable or executable
+        uint8_t *code;
+        size_t codeCapacity;
+        size_t codeSize;
+
+        struct entry {
+            // PRG offset of the block entry (freeEntry for an unused slot)
+            uint32_t Offset;
+
+            // index in `compiled`, notCompiled or notCompilable
+            int32_t Index;
+
+            // executions while not compiled
+            uint32_t Hits;
+        };
+
+        // open addressing by PRG offset, 2^entryBits slots at most half used.
+        // only the block entries Run was asked for take a slot
+        std::vector<entry> entries;
+        uint32_t entryBits;
+        size_t entryMask;
+        size_t usedEntries;
+        entry &find(uint32_t prgOffset);
+        void growEntries();
+
+        std::vector<compiledBlock> compiled;
+
+        // offsets of the cpu registers from the beginning of Cpu
+        int32_t offA, offX, offY, offSP, offPC, offP, offZ, offN, offCycles;
+
+        // emitter
+        std::vector<uint8_t> buf;
+        void emit(uint8_t);
+        void emit16(uint16_t);
+        void emit32(uint32_t);
+        void emit64(uint64_t);
+        void emitLoadReg(int reg, int32_t offset);
+        void emitStoreReg(int reg, int32_t offset);
+        void emitSetP(uint8_t mask, bool set);
+        void emitSetZN(int reg);
+        void emitCall(const void *function);
+        void emitSync(uint16_t pc, uint32_t cycles);
+        void emitExit(uint16_t pc, uint32_t cycles);
+
+        // cycles of the block already added to Cpu::Cycles by emitSync
+        uint32_t syncedCycles;
+
+        // the last instruction wrote to OAM DMA or to a mapper (which may switch banks)
+        bool busWritten;
+
+        // a mapper handles the writes at $4020 and above (CPUMemory::MapperWrite)
+        bool mapperAttached;
+
+        // see Declined
+        bool declined;
+
+        // emit native code of the instruction, `next` and `cycles` being PC and the cycles of
+        // the block once it has executed. false if the instruction is not supported
+        bool emitInstruction(const DecodedInstruction &d, uint16_t next, uint32_t cycles);
+
+        // copy the emitted code to the executable memory. false if the pages cannot be remapped
+        bool install();
+
+        int32_t compile(const Cpu &cpu, const BlockCache &blocks, uint32_t prgOffset);
+
+        // "nestake 01:C004 LDX DEX BNE (symbol)": PRG bank:PC of the entry, opcodes of the block
+        std::string label(Cpu &cpu, const BlockCache &blocks, uint32_t prgOffset, const compiledBlock &b) const;
+    public:
+        explicit Jit(const Cpu &cpu);
+        ~Jit();
+        Jit(const Jit &) = delete;
+        Jit &operator=(const Jit &) = delete;
+
+        // number of executions of a block entry before it gets compiled
+        static const uint8_t HotThreshold = 16;
+
+        // shorter blocks are left to the interpreter, which dispatches them (and fuses
+        // the idle loops) for less than the entry and exit of native code cost
+        static const uint8_t MinBlockInstructions = 2;
+
+        // whether this host can run the generated code
+        static bool IsSupported();
+
+        // run the compiled block at cpu.PC if any; false if the interpreter has to execute the instruction.
+        // blocks shorter than MinBlockInstructions are never compiled, so Step does not ask for them
+        bool Run(Cpu &cpu, const BlockCache &blocks, uint32_t prgOffset);
+
+        // the last Run found that no block can start at its PC, so one may start at the next instruction
+        bool Declined() const { return declined; }
+
+        // number of compiled blocks
+        size_t CompiledBlocks() const { return compiled.size(); }
+    };
+}
+
+#endif
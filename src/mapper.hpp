@@ -0,0 +1,43 @@
+#ifndef NESTAKE_MAPPER
+#define NESTAKE_MAPPER
+
+#include <stdint.h>
+
+#include "memory.hpp"
+
+namespace nestake {
+
+    // mappers of BasicConsole. ID is the iNES mapper number, Reset sets up the banks of the
+    // loaded cartridge and Write receives the cpu writes to 0x4020-0xFFFF.
+
+    // mapper 0: fixed PRG-ROM and CHR
+    struct NROM {
+        static const uint8_t ID = 0;
+
+        void Reset(CPUMemory &, PPUMemory &) {}
+        void Write(CPUMemory &, PPUMemory &, uint16_t, uint8_t) {}
+    };
+
+    // mapper 3: fixed PRG-ROM, 8KB CHR bank selected by writes to 0x8000-0xFFFF
+    struct CNROM {
+        static const uint8_t ID = 3;
+
+        void Reset(CPUMemory &, PPUMemory &ppu) {
+            selectCHR(ppu, 0);
+        }
+
+        void Write(CPUMemory &, PPUMemory &ppu, uint16_t address, uint8_t value) {
+            if (address >= 0x8000) {
+                selectCHR(ppu, value);
+            }
+        }
+    private:
+        static void selectCHR(PPUMemory &ppu, uint8_t bank) {
+            for (int i = 0; i < 8; ++i) {
+                ppu.MapCHR(i, uint32_t(bank)*0x2000 + uint32_t(i)*0x400);
+            }
+        }
+    };
+}
+
+#endif
@@ -2,13 +2,16 @@
  * implement memory Read/Write on memory.hpp 
  */
 
+#include <cstring>
+
+#include "cpu.hpp"
 #include "memory.hpp"
+#include "ppu.hpp"
+#include "state.hpp"
 
 namespace nestake {
-    uint8_t CPUMemory::Read(uint16_t address) {
-        if (address < 0x2000) {
-            return RAM[address%0x800];
-        } else if (address < 0x4000) {
+    uint8_t CPUMemory::readIO(uint16_t address) {
+        if (address < 0x4000) {
             // TODO: read from PPU
             return 0;
         } else if (address == 0x4014) {
@@ -23,6 +26,8 @@ namespace nestake {
         } else if (address == 0x4017) {
             // TODO: read from controller
             return 0;
+        } else if (address >= 0x6000 && address < 0x8000 && SRAM != nullptr) {
+            return SRAM->Read(uint16_t(address - 0x6000));
         } else if (address > 0x4020) {
             // TODO: read from mapper
             return 0;
@@ -30,32 +35,177 @@ namespace nestake {
         return 0;
     }
 
-    void CPUMemory::Write(uint16_t address, uint8_t value) {
-        if (address < 0x2000) {
-            RAM[address%0x0800] = value;
-        } else if (address < 0x4000) {
+    void CPUMemory::writeIO(uint16_t address, uint8_t value) {
+        if (address < 0x4000) {
             // TODO: write from PPU
         } else if (address == 0x4014) {
-            // TODO: write from PPU
+            writeDMA(value);
         } else if (address == 0x4015) {
             // TODO: write from APU
         } else if (address == 0x4016) {
             // TODO: write from controller
         } else if (address == 0x4017) {
             // TODO: write from controller
-        } else if (address >= 0x4020) {
-            // TODO: write from mapper
+        } else if (address >= 0x6000 && address < 0x8000 && SRAM != nullptr) {
+            SRAM->Write(uint16_t(address - 0x6000), value);
+        } else if (address >= 0x4020 && MapperWrite != nullptr) {
+            MapperWrite(Mapper, address, value);
         }
     }
 
+#ifdef NESTAKE_DEBUGGER
+    uint8_t CPUMemory::trappedRead(uint16_t address) {
+        uint8_t value = read(address);
+        Debug->OnRead(address, value, CPU != nullptr ? CPU->Cycles : 0);
+        return value;
+    }
+
+    void CPUMemory::trappedWrite(uint16_t address, uint8_t value) {
+        write(address, value);
+        Debug->OnWrite(address, value, CPU != nullptr ? CPU->Cycles : 0);
+    }
+#endif
 
-    uint8_t PPUMemory::Read(uint16_t address) {
-        // TODO:
-        return 0;
+    const uint8_t *CPUMemory::pageData(uint8_t page) const {
+#ifdef NESTAKE_DEBUGGER
+        // watched pages are read through the traps
+        if (Traps != nullptr && (Traps[page] & TrapRead)) {
+            return nullptr;
+        }
+#endif
+        uint16_t address = uint16_t(page << 8);
+        if (address < 0x2000) {
+            return &RAM[address % 0x800];
+        } else if (address >= 0x8000 && Cart != nullptr) {
+            // PRG-ROM is a multiple of 16KB, so a page never wraps
+            return &Cart->PRG[PRGOffset(address)];
+        } else if (address >= 0x6000 && SRAM != nullptr) {
+            return SRAM->Data() + (address - 0x6000);
+        }
+        return nullptr;
+    }
+
+    void CPUMemory::writeDMA(uint8_t page) {
+        if (PPU == nullptr) {
+            return;
+        }
+        uint8_t buffer[256];
+        const uint8_t *data = pageData(page);
+        if (data == nullptr) {
+            for (int i = 0; i < 256; ++i) {
+                buffer[i] = Read(uint16_t(page << 8 | i));
+            }
+            data = buffer;
+        }
+
+        // 256 writes to OAMDATA from OAMADDR, which wraps back to where it started
+        size_t first = 256 - PPU->oamAddress;
+        std::memcpy(&PPU->oamData[PPU->oamAddress], data, first);
+        std::memcpy(&PPU->oamData[0], data + first, 256 - first);
+
+        // 256 read/write pairs, plus one cycle to halt and one more on an odd cycle.
+        // the halt follows the write, which the cycle accurate cpu has not counted yet
+        if (CPU != nullptr) {
+            uint64_t halt = CPU->Cycles + (CPU->IsCycleAccurate ? 1 : 0);
+            CPU->Stall += 513 + int(halt % 2);
+        }
+    }
+
+    bool CPUMemory::MapSaveFile(const std::string &path) {
+        std::unique_ptr<SaveRAM> mapped(new SaveRAM(path));
+        if (!mapped->IsFileBacked()) {
+            return false;
+        }
+        SRAM = std::move(mapped);
+        return true;
+    }
+
+    void CPUMemory::SaveState(ConsoleState &state) const {
+        std::memcpy(state.RAM, RAM.data(), RAM.size());
+        if (SRAM != nullptr) {
+            std::memcpy(state.SRAM, SRAM->Data(), SaveRAM::Size);
+        } else {
+            std::memset(state.SRAM, 0, SaveRAM::Size);
+        }
+    }
+
+    void CPUMemory::LoadState(const ConsoleState &state) {
+        std::memcpy(RAM.data(), state.RAM, RAM.size());
+        if (SRAM != nullptr) {
+            SRAM->Restore(state.SRAM);
+        }
+    }
+
+    void CPUMemory::PowerOn() {
+        RAM.fill(0);
+        if (SRAM != nullptr) {
+            if (SRAM->IsFileBacked()) {
+                SRAM->Flush();
+            } else {
+                SRAM->Clear();
+            }
+        }
     }
 
+    // pattern pages without a cartridge
+    static uint8_t unmappedPage[0x400];
 
-    void PPUMemory::Write(uint16_t address, uint8_t value) {
-        // TODO:
+    PPUMemory::PPUMemory(uint8_t *nameTables, uint8_t *palette):
+        nameTables(nameTables), palette(palette), mirror(MirrorHorizontal), generation(0) {
+        for (int i = 0; i < 8; ++i) {
+            pages[i] = unmappedPage;
+        }
+        SetMirror(MirrorHorizontal);
+    }
+
+    void PPUMemory::LoadCartridge(std::shared_ptr<Cartridge> cartridge) {
+        Cart = std::move(cartridge);
+        for (int i = 0; i < 8; ++i) {
+            if (Cart != nullptr) {
+                MapCHR(i, uint32_t(i*0x400));
+            } else {
+                pages[i] = unmappedPage;
+            }
+        }
+        SetMirror(Cart != nullptr ? Cart->Mirror : uint8_t(MirrorHorizontal));
+    }
+
+    void PPUMemory::MapCHR(int page, uint32_t offset) {
+        // CHR is a multiple of 8KB
+        pages[page] = &Cart->CHR[offset % Cart->CHR.size()];
+        ++generation;
+    }
+
+    void PPUMemory::SetMirror(uint8_t mode) {
+        // physical 1KB table of each logical name table
+        uint8_t *tables[4];
+        switch (mode) {
+            case MirrorVertical:
+                tables[0] = tables[2] = nameTables;
+                tables[1] = tables[3] = nameTables + 0x400;
+                break;
+            case MirrorSingle0:
+                tables[0] = tables[1] = tables[2] = tables[3] = nameTables;
+                break;
+            case MirrorSingle1:
+                tables[0] = tables[1] = tables[2] = tables[3] = nameTables + 0x400;
+                break;
+            case MirrorFour:
+                extraNameTables.resize(0x800);
+                tables[0] = nameTables;
+                tables[1] = nameTables + 0x400;
+                tables[2] = &extraNameTables[0];
+                tables[3] = &extraNameTables[0x400];
+                break;
+            default:
+                tables[0] = tables[1] = nameTables;
+                tables[2] = tables[3] = nameTables + 0x400;
+        }
+        for (int i = 0; i < 4; ++i) {
+            // 0x3000-0x3EFF mirrors 0x2000-0x2EFF
+            pages[8 + i] = pages[12 + i] = tables[i];
+        }
+        mirror = mode;
+        ++generation;
     }
 }
@@ -2,20 +2,189 @@
 #define NESTAKE_MEMORY
 
 #include <array>
+#include <memory>
 #include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "debugger.hpp"
+#include "ines.hpp"
+#include "saveram.hpp"
 
 namespace nestake {
+    struct ConsoleState;
+    class Cpu;
+    class PPU;
+
     class CPUMemory {
+    private:
+        // OAM DMA (0x4014): copy the page into PPU::oamData and stall the cpu
+        void writeDMA(uint8_t page);
+
+        // the 256 bytes of a page when they are plain memory, nullptr otherwise
+        const uint8_t *pageData(uint8_t page) const;
+
+        uint8_t readIO(uint16_t address);
+        void writeIO(uint16_t address, uint8_t value);
+
+        // RAM and PRG-ROM inline, the rest through readIO / writeIO
+        uint8_t read(uint16_t address) {
+            if (address < 0x2000) {
+                return RAM[address%0x800];
+            } else if (address >= 0x8000 && Cart != nullptr) {
+                return Cart->PRG[PRGOffset(address)];
+            }
+            return readIO(address);
+        }
+
+        void write(uint16_t address, uint8_t value) {
+            if (address < 0x2000) {
+                RAM[address%0x0800] = value;
+                return;
+            }
+            writeIO(address, value);
+        }
+
+#ifdef NESTAKE_DEBUGGER
+        // accesses of trapped pages
+        uint8_t trappedRead(uint16_t address);
+        void trappedWrite(uint16_t address, uint8_t value);
+#endif
     public:
         std::array<uint8_t, 2048> RAM;
-        uint8_t Read(uint16_t address);
-        void Write(uint16_t address, uint8_t value);
+
+        // cartridge mapped into 0x8000-0xFFFF
+        std::shared_ptr<Cartridge> Cart;
+
+        // battery-backed RAM at 0x6000-0x7FFF of this console, in memory unless MapSaveFile
+        // is called (nullptr when the cartridge has no battery; set by Cpu::LoadCartridge)
+        std::unique_ptr<SaveRAM> SRAM;
+
+        // keep the SRAM in the file (e.g. Cartridge::SavePath), which then holds its content.
+        // false, keeping the current SRAM, if the file cannot be mapped
+        bool MapSaveFile(const std::string &path);
+
+        // RAM and SRAM into / from the memory fields of the state
+        void SaveState(ConsoleState &state) const;
+        void LoadState(const ConsoleState &state);
+
+        // RAM and in-memory SRAM cleared; the SRAM of a save file keeps the file's content
+        void PowerOn();
+
+        // PPU receiving OAM DMA
+        std::shared_ptr<nestake::PPU> PPU;
+
+        // cpu stalled by OAM DMA (set by the Cpu constructor)
+        Cpu *CPU = nullptr;
+
+        // mapper registers (writes to 0x4020-0xFFFF): called with Mapper, bound by BasicConsole
+        void (*MapperWrite)(void *mapper, uint16_t address, uint8_t value) = nullptr;
+        void *Mapper = nullptr;
+
+#ifdef NESTAKE_DEBUGGER
+        // breakpoints and watchpoints when set (nullptr by default, disables the recompiler and fusion)
+        std::shared_ptr<Debugger> Debug;
+
+        // Debug->Traps() while a debugger is attached, so unwatched consoles only test a null pointer
+        const uint8_t *Traps = nullptr;
+
+        void Attach(std::shared_ptr<Debugger> debugger) {
+            Debug = std::move(debugger);
+            Traps = Debug != nullptr ? Debug->Traps() : nullptr;
+        }
+#endif
+
+        uint8_t Read(uint16_t address) {
+#ifdef NESTAKE_DEBUGGER
+            if (Traps != nullptr && (Traps[address >> 8] & TrapRead)) {
+                return trappedRead(address);
+            }
+#endif
+            return read(address);
+        }
+
+        void Write(uint16_t address, uint8_t value) {
+#ifdef NESTAKE_DEBUGGER
+            if (Traps != nullptr && (Traps[address >> 8] & TrapWrite)) {
+                trappedWrite(address, value);
+                return;
+            }
+#endif
+            write(address, value);
+        }
+
+        // offset in Cartridge::PRG of the address (0x8000-0xFFFF). PRG-ROM is not switched
+        // (NROM and CNROM): 16KB cartridges are mirrored at 0xC000
+        uint32_t PRGOffset(uint16_t address) const {
+            return uint32_t(address - 0x8000) % uint32_t(Cart->PRG.size());
+        }
     };
 
+    // PPU address space: 1KB pages for the pattern tables (0x0000-0x1FFF) and the name tables
+    // (0x2000-0x2FFF, mirrored up to 0x3EFF), then palette RAM (0x3F00-0x3FFF).
+    // bank switching and mirroring only rewrite page entries.
     class PPUMemory {
+    private:
+        std::array<uint8_t *, 16> pages;
+
+        // PPU::nameTableData (2KB) and PPU::paletteData
+        uint8_t *nameTables;
+        uint8_t *palette;
+
+        // name tables 2 and 3 of four screen cartridges
+        std::vector<uint8_t> extraNameTables;
+
+        uint8_t mirror;
+        uint32_t generation;
+
+        // 0x3F00-0x3FFF: 0x3F10 / 0x3F14 / 0x3F18 / 0x3F1C mirror 0x3F00 / 0x3F04 / 0x3F08 / 0x3F0C
+        static uint8_t paletteIndex(uint16_t address) {
+            uint8_t i = uint8_t(address & 0x1F);
+            return (i & 0x13) == 0x10 ? uint8_t(i - 0x10) : i;
+        }
     public:
-        uint8_t Read(uint16_t address);
-        void Write(uint16_t address, uint8_t value);
+        PPUMemory(uint8_t *nameTables, uint8_t *palette);
+        PPUMemory(const PPUMemory &) = delete;
+        PPUMemory &operator=(const PPUMemory &) = delete;
+
+        // cartridge providing the pattern tables; its CHR is mapped in order with its mirroring
+        std::shared_ptr<Cartridge> Cart;
+        void LoadCartridge(std::shared_ptr<Cartridge> cartridge);
+
+        // map a 1KB pattern page (0-7) onto Cart->CHR from the offset
+        void MapCHR(int page, uint32_t offset);
+
+        // offset in Cart->CHR of a pattern page (0-7); 0 without a cartridge
+        uint32_t CHROffset(int page) const {
+            return Cart != nullptr ? uint32_t(pages[page] - Cart->CHR.data()) : 0;
+        }
+
+        // arrange the name tables by MirrorMode
+        void SetMirror(uint8_t mode);
+        uint8_t Mirror() const { return mirror; }
+
+        // changes at every MapCHR / SetMirror
+        uint32_t Generation() const { return generation; }
+
+        // memory of a 1KB page (8-15 are name tables)
+        const uint8_t *Page(int page) const { return pages[page]; }
+
+        uint8_t Read(uint16_t address) const {
+            address &= 0x3FFF;
+            if (address >= 0x3F00) {
+                return palette[paletteIndex(address)];
+            }
+            return pages[address >> 10][address & 0x3FF];
+        }
+
+        void Write(uint16_t address, uint8_t value) {
+            address &= 0x3FFF;
+            if (address >= 0x3F00) {
+                palette[paletteIndex(address)] = value;
+                return;
+            }
+            pages[address >> 10][address & 0x3FF] = value;
+        }
     };
 }
 #endif
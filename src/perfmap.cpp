@@ -0,0 +1,102 @@
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#include "perfmap.hpp"
+
+namespace nestake {
+
+    PerfMap::PerfMap(const std::string &path) {
+        std::string p = path;
+        if (p.empty()) {
+            p = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        }
+        out = std::fopen(p.c_str(), "a");
+    }
+
+    PerfMap::~PerfMap() {
+        if (out != nullptr) {
+            std::fclose(out);
+        }
+    }
+
+    // parse "[bank:]address" in hex, with an optional leading '$'
+    static bool parseLocation(std::string s, uint32_t &key) {
+        if (!s.empty() && s[0] == '$') {
+            s = s.substr(1);
+        }
+        uint32_t bank = 0;
+        size_t colon = s.find(':');
+        char *end;
+        if (colon != std::string::npos) {
+            bank = uint32_t(std::strtoul(s.substr(0, colon).c_str(), &end, 16));
+            if (*end != 0 || colon == 0) {
+                return false;
+            }
+            s = s.substr(colon + 1);
+        }
+        uint32_t address = uint32_t(std::strtoul(s.c_str(), &end, 16));
+        if (*end != 0 || s.empty() || address > 0xFFFF || bank > 0xFF) {
+            return false;
+        }
+        key = (bank << 16) | address;
+        return true;
+    }
+
+    bool PerfMap::LoadSymbols(const std::string &path) {
+        std::ifstream in(path);
+        if (!in) {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(in, line)) {
+            std::string location, name;
+            if (!line.empty() && line[0] == '$' && line.find('#') != std::string::npos) {
+                // $C000#name#comment
+                std::stringstream fields(line);
+                std::getline(fields, location, '#');
+                std::getline(fields, name, '#');
+            } else {
+                std::stringstream fields(line);
+                fields >> location >> name;
+            }
+
+            uint32_t key;
+            if (!name.empty() && parseLocation(location, key)) {
+                symbols[key] = name;
+            }
+        }
+        return true;
+    }
+
+    std::string PerfMap::Symbol(uint8_t bank, uint16_t address) const {
+        uint32_t key = (uint32_t(bank) << 16) | address;
+        auto it = symbols.upper_bound(key);
+        if (it == symbols.begin()) {
+            return "";
+        }
+        --it;
+        if ((it->first >> 16) != bank) {
+            return "";
+        }
+        uint32_t offset = key - it->first;
+        if (offset == 0) {
+            return it->second;
+        }
+        std::ostringstream s;
+        s << it->second << "+0x" << std::hex << offset;
+        return s.str();
+    }
+
+    bool PerfMap::Add(const void *start, size_t size, const std::string &name) {
+        if (out == nullptr) {
+            return false;
+        }
+        // flushed right away, perf may read the map while we are running
+        std::fprintf(out, "%lx %zx %s\n", (unsigned long) reinterpret_cast<uintptr_t>(start), size, name.c_str());
+        std::fflush(out);
+        return true;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef NESTAKE_PERFMAP
+#define NESTAKE_PERFMAP
+
+#include <cstdio>
+#include <map>
+#include <stdint.h>
+#include <string>
+
+namespace nestake {
+
+    // writer of perf's JIT symbol map (/tmp/perf-<pid>.map), so that `perf report` names
+    // the native code of compiled blocks after the guest code instead of anonymous addresses.
+    // set Cpu::Perf to use it.
+    class PerfMap {
+    private:
+        FILE *out;
+
+        // guest symbols by (bank << 16 | address)
+        std::map<uint32_t, std::string> symbols;
+    public:
+        // an empty path stands for /tmp/perf-<pid>.map
+        explicit PerfMap(const std::string &path = "");
+        ~PerfMap();
+        PerfMap(const PerfMap &) = delete;
+        PerfMap &operator=(const PerfMap &) = delete;
+
+        // load guest symbols, one per line: "$C000#name#comment" (FCEUX .nl), "C000 name" or "01:C000 name".
+        // lines without a bank apply to bank 0. false if the file can not be read
+        bool LoadSymbols(const std::string &path);
+
+        // nearest guest symbol at or before the address of the bank ("name" or "name+0x12", "" if none)
+        std::string Symbol(uint8_t bank, uint16_t address) const;
+
+        // record native code; false if the map is not open
+        bool Add(const void *start, size_t size, const std::string &name);
+    };
+}
+
+#endif
@@ -1,7 +1,29 @@
+#include <cstring>
+
 #include "ppu.hpp"
+#include "simd.hpp"
+#include "state.hpp"
 
 namespace nestake {
 
+    // 2C02 palette (0xRRGGBB)
+    static const uint32_t systemPalette[64] = {
+        0x666666, 0x002A88, 0x1412A7, 0x3B00A4, 0x5C007E, 0x6E0040, 0x6C0600, 0x561D00,
+        0x333500, 0x0B4800, 0x005200, 0x004F08, 0x00404D, 0x000000, 0x000000, 0x000000,
+        0xADADAD, 0x155FD9, 0x4240FF, 0x7527FE, 0xA01ACC, 0xB71E7B, 0xB53120, 0x994E00,
+        0x6B6D00, 0x388700, 0x0C9300, 0x008F32, 0x007C8D, 0x000000, 0x000000, 0x000000,
+        0xFFFEFF, 0x64B0FF, 0x9290FF, 0xC676FF, 0xF36AFF, 0xFE6ECC, 0xFE8170, 0xEA9E22,
+        0xBCBE00, 0x88D800, 0x5CE430, 0x45E082, 0x48CDDE, 0x4F4F4F, 0x000000, 0x000000,
+        0xFFFEFF, 0xC0DFFF, 0xD3D2FF, 0xE8C8FF, 0xFBC2FF, 0xFEC4EA, 0xFECCC5, 0xF7D8A5,
+        0xE4E594, 0xCFEF96, 0xBDF4AB, 0xB3F3CC, 0xB5EBF2, 0xB8B8B8, 0x000000, 0x000000,
+    };
+
+    static uint8_t reverseBits(uint8_t b) {
+        b = uint8_t((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+        b = uint8_t((b & 0xCC) >> 2 | (b & 0x33) << 2);
+        return uint8_t((b & 0xAA) >> 1 | (b & 0x55) << 1);
+    }
+
     void PPU::Reset() {
         Cycle = 340;
         ScanLine = 240;
@@ -12,8 +34,152 @@ namespace nestake {
     }
 
 
-    PPU::PPU() {
-        // TODO:
+    // dot 1 of the first vblank line and of the pre-render line
+    static const uint64_t vblankStart = 241*DotsPerLine + 1;
+    static const uint64_t vblankEnd = 261*DotsPerLine + 1;
+
+    bool PPU::Tick(uint64_t dots) {
+        bool nmi = false;
+        uint64_t position = ScanLine*DotsPerLine + Cycle;
+        // jump from event to event
+        while (dots > 0) {
+            uint64_t next = position < vblankStart ? vblankStart : position < vblankEnd ? vblankEnd : DotsPerFrame;
+            uint64_t n = next - position < dots ? next - position : dots;
+            position += n;
+            dots -= n;
+            if (position == vblankStart) {
+                if (flagShowBackground || flagShowSprites) {
+                    RenderFrame();
+                }
+                nmiOccurred = true;
+                nmi = nmi || (nmiOutput && !nmiPrevious);
+                nmiPrevious = nmiOutput;
+            } else if (position == vblankEnd) {
+                nmiOccurred = nmiPrevious = false;
+                flagSpriteZeroHit = flagSpriteOverflow = 0;
+            } else if (position == DotsPerFrame) {
+                position = 0;
+                ++Frame;
+                f ^= 1;
+            }
+        }
+        ScanLine = position / DotsPerLine;
+        Cycle = position % DotsPerLine;
+        return nmi;
+    }
+
+    uint64_t PPU::DotsToVBlank() const {
+        uint64_t position = ScanLine*DotsPerLine + Cycle;
+        return position < vblankStart ? vblankStart - position : DotsPerFrame - position + vblankStart;
+    }
+
+    static std::array<color, 64> systemColors() {
+        std::array<color, 64> colors;
+        for (size_t i = 0; i < colors.size(); ++i) {
+            uint32_t c = systemPalette[i];
+            colors[i] = color{uint8_t(c >> 16), uint8_t(c >> 8), uint8_t(c)};
+        }
+        return colors;
+    }
+
+    // shared by every PPU
+    static const std::array<color, 64> palatte = systemColors();
+
+    PPU::PPU(): mem(nameTableData.data(), paletteData.data()) {
+        PowerOn();
+    }
+
+    void PPU::PowerOn() {
+        paletteData.fill(0);
+        nameTableData.fill(0);
+        oamData.fill(0);
+        lineSpriteCount = 0;
+        nmiOccurred = nmiOutput = nmiPrevious = false;
+        nmiDelay = 0;
+        flagSpriteZeroHit = flagSpriteOverflow = 0;
+        bufferedData = 0;
+        v = t = 0;
+        x = w = f = 0;
+        frameValid = false;
+        lineIndices.fill(0);
+        lineStatus.fill(0);
+        // back to the cartridge's own banks and mirroring
+        mem.LoadCartridge(mem.Cart);
+        Reset();
+    }
+
+    void PPU::SaveState(ConsoleState &state) const {
+        state.PPUCycle = Cycle;
+        state.ScanLine = ScanLine;
+        state.Frame = Frame;
+        state.V = v;
+        state.T = t;
+        state.FineX = x;
+        state.W = w;
+        state.F = f;
+        state.Control = uint8_t(flagNameTable | flagIncrement << 2 | flagSpriteTable << 3 |
+                                flagBackgroundTable << 4 | flagSpriteSize << 5 | flagMasterSlave << 6 |
+                                uint8_t(nmiOutput) << 7);
+        state.Mask = uint8_t(flagGrayscale | flagShowLeftBackground << 1 | flagShowLeftSprites << 2 |
+                             flagShowBackground << 3 | flagShowSprites << 4 |
+                             flagRedTint << 5 | flagGreenTint << 6 | flagBlueTint << 7);
+        state.Status = uint8_t(flagSpriteZeroHit | flagSpriteOverflow << 1);
+        state.OAMAddress = oamAddress;
+        state.BufferedData = bufferedData;
+        state.NMI = uint8_t(uint8_t(nmiOccurred) | uint8_t(nmiOutput) << 1 | uint8_t(nmiPrevious) << 2);
+        state.NMIDelay = nmiDelay;
+        state.Mirror = mem.Mirror();
+        for (int i = 0; i < 8; ++i) {
+            state.CHRPages[i] = mem.CHROffset(i);
+        }
+        std::memcpy(state.NameTables, nameTableData.data(), sizeof(state.NameTables));
+        std::memcpy(state.OAM, oamData.data(), sizeof(state.OAM));
+        std::memcpy(state.Palette, paletteData.data(), sizeof(state.Palette));
+    }
+
+    void PPU::LoadState(const ConsoleState &state) {
+        Cycle = state.PPUCycle;
+        ScanLine = state.ScanLine;
+        Frame = state.Frame;
+        writeControl(state.Control);
+        writeMask(state.Mask);
+        // after writeControl, which sets the name table bits of t
+        v = state.V;
+        t = state.T;
+        x = state.FineX;
+        w = state.W;
+        f = state.F;
+        flagSpriteZeroHit = state.Status & 1;
+        flagSpriteOverflow = (state.Status >> 1) & 1;
+        oamAddress = state.OAMAddress;
+        bufferedData = state.BufferedData;
+        nmiOccurred = (state.NMI & 1) != 0;
+        nmiOutput = (state.NMI & 2) != 0;
+        nmiPrevious = (state.NMI & 4) != 0;
+        nmiDelay = state.NMIDelay;
+        mem.SetMirror(state.Mirror);
+        if (mem.Cart != nullptr) {
+            for (int i = 0; i < 8; ++i) {
+                mem.MapCHR(i, state.CHRPages[i]);
+            }
+        }
+        std::memcpy(nameTableData.data(), state.NameTables, sizeof(state.NameTables));
+        std::memcpy(oamData.data(), state.OAM, sizeof(state.OAM));
+        std::memcpy(paletteData.data(), state.Palette, sizeof(state.Palette));
+        InvalidateFrame();
+    }
+
+    void PPU::allocateImages() {
+        if (currentImage.empty()) {
+            currentImage.assign(256*240, color{0, 0, 0});
+            renderingImage.assign(256*240, color{0, 0, 0});
+            InvalidateFrame();
+        }
+    }
+
+    void PPU::LoadCartridge(std::shared_ptr<Cartridge> cartridge) {
+        mem.LoadCartridge(std::move(cartridge));
+        InvalidateFrame();
     }
 
     uint8_t PPU::ReadPalette(uint16_t address) {
@@ -41,7 +207,15 @@ namespace nestake {
 
     // 0x2000
     void PPU::writeControl(uint8_t v) {
-
+        flagNameTable = v & uint8_t(3);
+        flagIncrement = (v >> 2) & uint8_t(1);
+        flagSpriteTable = (v >> 3) & uint8_t(1);
+        flagBackgroundTable = (v >> 4) & uint8_t(1);
+        flagSpriteSize = (v >> 5) & uint8_t(1);
+        flagMasterSlave = (v >> 6) & uint8_t(1);
+        nmiOutput = ((v >> 7) & uint8_t(1)) == 1;
+        // t: ....BA.. ........ = d: ......BA
+        t = uint16_t((t & 0xF3FF) | (uint16_t(v & 3) << 10));
     };
 
     void PPU::writeMask(uint8_t v) {
@@ -56,4 +230,262 @@ namespace nestake {
     };
 
 
-}
\ No newline at end of file
+
+    void PPU::EvaluateSprites(int line) {
+        int height = flagSpriteSize ? 16 : 8;
+        lineSpriteCount = 0;
+        for (int i = 0; i < 64; ++i) {
+            // sprites are drawn one line below their OAM y
+            int row = line - 1 - int(oamData[i*4]);
+            if (row < 0 || row >= height) {
+                continue;
+            }
+            if (lineSpriteCount == lineSprites.size()) {
+                flagSpriteOverflow = 1;
+                break;
+            }
+
+            uint8_t tile = oamData[i*4 + 1];
+            uint8_t attributes = oamData[i*4 + 2];
+            if (attributes & 0x80) {
+                row = height - 1 - row;
+            }
+            uint16_t address;
+            if (height == 8) {
+                address = uint16_t(0x1000*flagSpriteTable + tile*16 + row);
+            } else {
+                // 8x16: the table is picked by bit 0 of the tile, the bottom half is the next tile
+                uint16_t top = uint16_t(tile & 0xFE) + uint16_t(row >> 3);
+                address = uint16_t(0x1000*(tile & 1) + top*16 + (row & 7));
+            }
+            uint8_t low = mem.Read(address);
+            uint8_t high = mem.Read(uint16_t(address + 8));
+            if (!(attributes & 0x40)) {
+                // bit 0 of Low / High is the leftmost pixel
+                low = reverseBits(low);
+                high = reverseBits(high);
+            }
+
+            LineSprite &s = lineSprites[lineSpriteCount++];
+            s.X = oamData[i*4 + 3];
+            s.Attributes = attributes;
+            s.Low = low;
+            s.High = high;
+            s.Index = uint8_t(i);
+        }
+    }
+
+    void PPU::fetchBackground(int line, uint8_t *out) {
+        // one tile more than the line for the fine x scroll
+        uint8_t tiles[264];
+        int scrollX = ((t >> 10) & 1)*256 + (t & 0x1F)*8 + x;
+        int y = (((t >> 11) & 1)*240 + ((t >> 5) & 0x1F)*8 + ((t >> 12) & 7) + line) % 480;
+        int tableY = y / 240;
+        int coarseY = (y % 240) / 8;
+        int fineY = y % 8;
+        uint16_t patternBase = uint16_t(0x1000*flagBackgroundTable + fineY);
+
+        for (int i = 0; i < 33; ++i) {
+            int wx = ((scrollX & ~7) + i*8) % 512;
+            int table = tableY*2 + wx / 256;
+            int coarseX = (wx % 256) / 8;
+            uint16_t base = uint16_t(0x2000 + table*0x400);
+            uint8_t tile = mem.Read(uint16_t(base + coarseY*32 + coarseX));
+            uint8_t attribute = mem.Read(uint16_t(base + 0x3C0 + (coarseY/4)*8 + coarseX/4));
+            int shift = ((coarseY & 2) << 1) | (coarseX & 2);
+            uint8_t palette = uint8_t(((attribute >> shift) & 3) << 2);
+
+            uint8_t low = mem.Read(uint16_t(patternBase + tile*16));
+            uint8_t high = mem.Read(uint16_t(patternBase + tile*16 + 8));
+            for (int p = 0; p < 8; ++p) {
+                // transparent when the 2 low bits are 0, whatever the palette
+                tiles[i*8 + p] = uint8_t(palette | ((low >> (7 - p)) & 1) | (((high >> (7 - p)) & 1) << 1));
+            }
+        }
+        std::memcpy(out, tiles + (scrollX & 7), 256);
+    }
+
+    void PPU::fetchSprites(uint8_t *out) const {
+        std::memset(out, 0, 256 + 8);
+        // drawn from the last one so that lower OAM indices end up in front
+        for (int i = int(lineSpriteCount) - 1; i >= 0; --i) {
+            const LineSprite &s = lineSprites[i];
+            uint8_t flags = uint8_t(0x10 | ((s.Attributes & 3) << 2));
+            flags |= (s.Attributes & 0x20) ? SpriteBehind : 0;
+            flags |= s.Index == 0 ? SpriteZero : 0;
+            uint8_t *dst = out + s.X;
+            for (int p = 0; p < 8; ++p) {
+                uint8_t pixel = uint8_t(((s.Low >> p) & 1) | (((s.High >> p) & 1) << 1));
+                uint8_t opaque = uint8_t(-uint8_t(pixel != 0));
+                dst[p] = uint8_t((opaque & (flags | pixel)) | (uint8_t(~opaque) & dst[p]));
+            }
+        }
+    }
+
+    void PPU::RenderScanline(int line) {
+        uint8_t background[256];
+        uint8_t sprites[256 + 8];
+        uint8_t indices[256];
+        allocateImages();
+
+        if (flagShowBackground) {
+            fetchBackground(line, background);
+        } else {
+            std::memset(background, 0, sizeof(background));
+        }
+        if (flagShowBackground || flagShowSprites) {
+            EvaluateSprites(line);
+        }
+        if (flagShowSprites) {
+            fetchSprites(sprites);
+        } else {
+            std::memset(sprites, 0, sizeof(sprites));
+        }
+
+        if (!flagShowLeftBackground) {
+            std::memset(background, 0, 8);
+        }
+        if (!flagShowLeftSprites) {
+            std::memset(sprites, 0, 8);
+        }
+        // no sprite 0 hit at x=255
+        sprites[255] &= uint8_t(~SpriteZero);
+
+        if (Simd().ComposeLine(background, sprites, indices, 256)) {
+            flagSpriteZeroHit = 1;
+        }
+
+        uint8_t system[32];
+        uint8_t mask = flagGrayscale ? 0x30 : 0x3F;
+        for (uint16_t i = 0; i < 32; ++i) {
+            system[i] = ReadPalette(i) & mask;
+        }
+        color *dst = &renderingImage[size_t(line)*256];
+        for (int i = 0; i < 256; ++i) {
+            lineIndices[i] = system[indices[i]];
+            dst[i] = palatte[lineIndices[i]];
+        }
+    }
+
+    // PPUMASK as written
+    static uint8_t maskOf(const PPU &ppu) {
+        return uint8_t(ppu.flagGrayscale | ppu.flagShowLeftBackground << 1 | ppu.flagShowLeftSprites << 2 |
+                       ppu.flagShowBackground << 3 | ppu.flagShowSprites << 4 |
+                       ppu.flagRedTint << 5 | ppu.flagGreenTint << 6 | ppu.flagBlueTint << 7);
+    }
+
+    // PPUCTRL bits used by the renderer
+    static uint8_t controlOf(const PPU &ppu) {
+        return uint8_t(ppu.flagSpriteTable << 3 | ppu.flagBackgroundTable << 4 | ppu.flagSpriteSize << 5);
+    }
+
+    // hash of the mapped pattern tables
+    static uint32_t chrHash(const PPUMemory &mem) {
+        uint32_t h = 0;
+        for (int i = 0; i < 8; ++i) {
+            h = h*0x9E3779B1 ^ Simd().HashBytes(mem.Page(i), 0x400);
+        }
+        return h;
+    }
+
+    void PPU::findDirtyLines(std::array<uint8_t, 240> &dirty) const {
+        // tile rows (bits 0-29) changed in each of the 2 name tables of nameTableData
+        uint32_t rows[2] = {0, 0};
+        for (int table = 0; table < 2; ++table) {
+            const uint8_t *now = &nameTableData[table*0x400];
+            const uint8_t *then = &frameNameTable[table*0x400];
+            for (int row = 0; row < 30; ++row) {
+                if (std::memcmp(now + row*32, then + row*32, 32) != 0) {
+                    rows[table] |= uint32_t(1) << row;
+                }
+            }
+            // an attribute byte covers 4 tile rows
+            for (int row = 0; row < 8; ++row) {
+                if (std::memcmp(now + 0x3C0 + row*8, then + 0x3C0 + row*8, 8) != 0) {
+                    rows[table] |= uint32_t(0xF) << (row*4);
+                }
+            }
+        }
+
+        int baseY = ((t >> 11) & 1)*240 + ((t >> 5) & 0x1F)*8 + ((t >> 12) & 7);
+        for (int line = 0; line < 240; ++line) {
+            int y = (baseY + line) % 480;
+            int coarseY = (y % 240) / 8;
+            // both horizontal neighbours are visible on the line
+            int left = 8 + (y / 240)*2;
+            int a = int(mem.Page(left) - nameTableData.data()) / 0x400;
+            int b = int(mem.Page(left + 1) - nameTableData.data()) / 0x400;
+            dirty[line] = uint8_t(((rows[a] | rows[b]) >> coarseY) & 1);
+        }
+
+        // old and new lines of every changed sprite
+        int height = flagSpriteSize ? 16 : 8;
+        for (int i = 0; i < 64; ++i) {
+            if (std::memcmp(&oamData[i*4], &frameOAM[i*4], 4) == 0) {
+                continue;
+            }
+            const int ys[2] = {oamData[i*4] + 1, frameOAM[i*4] + 1};
+            for (int y : ys) {
+                for (int line = y; line < y + height && line < 240; ++line) {
+                    dirty[line] = 1;
+                }
+            }
+        }
+    }
+
+    void PPU::RenderFrame() {
+        allocateImages();
+        std::array<uint8_t, 240> dirty;
+        uint8_t mask = maskOf(*this);
+        uint8_t control = controlOf(*this);
+        uint32_t chr = chrHash(mem);
+        // name tables 2 and 3 of four screen cartridges are not tracked
+        bool all = !frameValid || mem.Mirror() == MirrorFour || mem.Generation() != frameGeneration ||
+                   mask != frameMask || control != frameControl ||
+                   (t & 0x7FFF) != frameT || x != frameX || chr != frameCHR ||
+                   std::memcmp(paletteData.data(), framePalette.data(), framePalette.size()) != 0;
+        if (all) {
+            dirty.fill(1);
+        } else {
+            findDirtyLines(dirty);
+        }
+
+        DirtyLines.clear();
+        uint8_t hit = 0, overflow = 0;
+        for (int line = 0; line < 240; ++line) {
+            if (dirty[line]) {
+                flagSpriteZeroHit = 0;
+                flagSpriteOverflow = 0;
+                RenderScanline(line);
+                lineStatus[line] = uint8_t(flagSpriteZeroHit | flagSpriteOverflow << 1);
+                std::memcpy(&currentImage[size_t(line)*256], &renderingImage[size_t(line)*256], 256*sizeof(color));
+                if (Diffs != nullptr) {
+                    Diffs->Line(line, lineIndices.data());
+                }
+                if (!DirtyLines.empty() && DirtyLines.back().End == line) {
+                    ++DirtyLines.back().End;
+                } else {
+                    DirtyLines.push_back(ScanlineRange{line, line + 1});
+                }
+            }
+            hit |= lineStatus[line] & 1;
+            overflow |= lineStatus[line] >> 1;
+        }
+        flagSpriteZeroHit = hit;
+        flagSpriteOverflow = overflow;
+        if (Diffs != nullptr) {
+            Diffs->EndFrame();
+        }
+
+        frameValid = true;
+        frameNameTable = nameTableData;
+        frameOAM = oamData;
+        framePalette = paletteData;
+        frameMask = mask;
+        frameControl = control;
+        frameT = uint16_t(t & 0x7FFF);
+        frameX = x;
+        frameCHR = chr;
+        frameGeneration = mem.Generation();
+    }
+}
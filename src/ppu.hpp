@@ -1,10 +1,18 @@
 #ifndef NESTAKE_PPU
 #define NESTAKE_PPU
 
+#include <vector>
+
 #include "cpu.hpp"
+#include "framediff.hpp"
 #include "memory.hpp"
 
 namespace nestake {
+    struct ConsoleState;
+
+    // NTSC frame: 262 lines of 341 dots, 3 dots per cpu cycle
+    static const uint64_t DotsPerLine = 341;
+    static const uint64_t DotsPerFrame = DotsPerLine*262;
 
     struct color {
         uint8_t r;
@@ -12,19 +20,90 @@ namespace nestake {
         uint8_t b;
     };
 
+    // sprite found on a scanline by PPU::EvaluateSprites
+    struct LineSprite {
+        uint8_t X;
+        uint8_t Attributes;
+
+        // pattern bits of the sprite's row, already flipped horizontally
+        uint8_t Low;
+        uint8_t High;
+
+        // index in OAM (0-63)
+        uint8_t Index;
+    };
+
+    // scanlines [First, End)
+    struct ScanlineRange {
+        int First;
+        int End;
+    };
+
     class PPU {
     private:
-        std::shared_ptr<PPUMemory> mem;
+        PPUMemory mem;
         std::shared_ptr<Cpu> cpu;
-        std::array<color, 64> palatte;
+
+        // allocate currentImage and renderingImage on the first drawn scanline
+        void allocateImages();
+
+        // palette indices (0-15) of the background of a scanline
+        void fetchBackground(int line, uint8_t *out);
+
+        // palette indices (16-31) and SpriteBehind / SpriteZero flags of lineSprites;
+        // out has 8 bytes of slack past the 256 pixels
+        void fetchSprites(uint8_t *out) const;
+
+        // inputs of the frame last drawn by RenderFrame
+        bool frameValid;
+        std::array<uint8_t, 2048> frameNameTable;
+        std::array<uint8_t, 256> frameOAM;
+        std::array<uint8_t, 32> framePalette;
+        uint8_t frameMask;
+        uint8_t frameControl;
+        uint16_t frameT;
+        uint8_t frameX;
+        uint32_t frameCHR;
+        uint32_t frameGeneration;
+
+        // system palette indices of the scanline drawn last
+        std::array<uint8_t, 256> lineIndices;
+
+        // sprite 0 hit (bit 0) and sprite overflow (bit 1) found on each scanline of that frame
+        std::array<uint8_t, 240> lineStatus;
+
+        // mark the scanlines whose inputs changed since the last frame
+        void findDirtyLines(std::array<uint8_t, 240> &dirty) const;
     public:
         PPU();
+        PPU(const PPU &) = delete;
+        PPU &operator=(const PPU &) = delete;
+
+        // power-on state: memories and registers cleared, the cartridge's banks and mirroring
+        void PowerOn();
+
+        // PPU fields of the state; loading it draws the next frame from scratch
+        void SaveState(ConsoleState &state) const;
+        void LoadState(const ConsoleState &state);
+
+        // cartridge providing the pattern tables and the name table mirroring
+        void LoadCartridge(std::shared_ptr<Cartridge> cartridge);
 
         // counters
         uint64_t Cycle;
         uint64_t ScanLine;
         uint64_t Frame;
 
+        // run the dots: vblank starts at dot 1 of line 241 (drawing the frame when rendering
+        // is on) and ends at dot 1 of the pre-render line 261. whether an NMI is raised
+        bool Tick(uint64_t dots);
+
+        // dots until the next vblank starts (and an NMI may be raised)
+        uint64_t DotsToVBlank() const;
+
+        // PPU address space (0x0000-0x3FFF)
+        PPUMemory &Memory() { return mem; }
+
         // register I/O
         uint8_t ReadRegister(uint16_t);
         void WriteRegister(uint16_t address, uint8_t value);
@@ -39,11 +118,36 @@ namespace nestake {
         std::array<uint8_t, 2048> nameTableData;
         std::array<uint8_t, 256> oamData;
 
-        // used for actual displaying
-        std::array<color, 256*240> currentImage;
+        // sprites of the scanline evaluated last, in OAM order
+        std::array<LineSprite, 8> lineSprites;
+        uint8_t lineSpriteCount;
+
+        // collect the sprites covering the scanline (at most 8) and set flagSpriteOverflow past 8
+        void EvaluateSprites(int line);
+
+        // draw a visible scanline (0-239) into renderingImage, scrolled by t / x.
+        // sets flagSpriteZeroHit when sprite 0 is drawn over the background
+        void RenderScanline(int line);
+
+        // draw the visible scanlines whose inputs (name tables, palette, OAM, CHR banks, mirroring, scroll t / x,
+        // PPUMASK and the pattern / sprite size bits of PPUCTRL) changed since the last call,
+        // and publish them into currentImage. the others are kept from the last frame
+        void RenderFrame();
+
+        // scanlines drawn by the last RenderFrame
+        std::vector<ScanlineRange> DirtyLines;
+
+        // receives the published scanlines of every frame when set
+        std::shared_ptr<FrameDiffStream> Diffs;
+
+        // draw every scanline on the next RenderFrame
+        void InvalidateFrame() { frameValid = false; }
+
+        // used for actual displaying (256*240, empty until something is drawn)
+        std::vector<color> currentImage;
 
-        // used for rendering during vblank timing
-        std::array<color, 256*240> renderingImage;
+        // used for rendering during vblank timing (256*240, empty until something is drawn)
+        std::vector<color> renderingImage;
 
         // NMI flags
         bool nmiOccurred;
@@ -0,0 +1,125 @@
+#include "predicate.hpp"
+
+namespace nestake {
+
+    Predicate::Predicate(const term &t): terms(1, t), ends(1, 1) {
+    }
+
+    Predicate Predicate::RAM(uint16_t address, CompareOp op, uint8_t value) {
+        if (address >= 0x2000) {
+            throw std::out_of_range("Predicate::RAM: address outside the RAM");
+        }
+        term t = {termRAM, uint8_t(op), uint16_t(address % 0x800), value};
+        return Predicate(t);
+    }
+
+    Predicate Predicate::PC(uint16_t pc) {
+        term t = {termPC, CompareEqual, pc, 0};
+        return Predicate(t);
+    }
+
+    Predicate Predicate::Frames(uint64_t count) {
+        term t = {termFrames, CompareGreaterEqual, 0, count};
+        return Predicate(t);
+    }
+
+    Predicate Predicate::operator&&(const Predicate &other) const {
+        // (a || b) && (c || d) = a&&c || a&&d || b&&c || b&&d
+        Predicate p;
+        for (size_t i = 0; i < ends.size(); ++i) {
+            size_t first = i == 0 ? 0 : ends[i - 1];
+            for (size_t j = 0; j < other.ends.size(); ++j) {
+                size_t otherFirst = j == 0 ? 0 : other.ends[j - 1];
+                p.terms.insert(p.terms.end(), terms.begin() + first, terms.begin() + ends[i]);
+                p.terms.insert(p.terms.end(), other.terms.begin() + otherFirst, other.terms.begin() + other.ends[j]);
+                p.ends.push_back(p.terms.size());
+            }
+        }
+        return p;
+    }
+
+    Predicate Predicate::operator||(const Predicate &other) const {
+        Predicate p = *this;
+        p.terms.insert(p.terms.end(), other.terms.begin(), other.terms.end());
+        for (size_t j = 0; j < other.ends.size(); ++j) {
+            p.ends.push_back(terms.size() + other.ends[j]);
+        }
+        return p;
+    }
+
+    bool Predicate::holds(const term &t, const uint8_t *ram, uint16_t pc, uint64_t frames) const {
+        switch (t.Kind) {
+            case termRAM: {
+                uint8_t v = ram[t.Address];
+                switch (t.Op) {
+                    case CompareEqual: return v == t.Value;
+                    case CompareNotEqual: return v != t.Value;
+                    case CompareLess: return v < t.Value;
+                    case CompareLessEqual: return v <= t.Value;
+                    case CompareGreater: return v > t.Value;
+                    default: return v >= t.Value;
+                }
+            }
+            case termPC:
+                return pc == t.Address;
+            default:
+                return frames >= t.Value;
+        }
+    }
+
+    bool Predicate::Holds(const uint8_t *ram, uint16_t pc, uint64_t frames) const {
+        size_t first = 0;
+        for (size_t i = 0; i < ends.size(); ++i) {
+            bool clause = true;
+            for (size_t j = first; j < ends[i] && clause; ++j) {
+                clause = holds(terms[j], ram, pc, frames);
+            }
+            if (clause) {
+                return true;
+            }
+            first = ends[i];
+        }
+        return false;
+    }
+
+    bool Predicate::CountsFrames() const {
+        for (size_t i = 0; i < terms.size(); ++i) {
+            if (terms[i].Kind == termFrames) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Predicate::Arm(Debugger &debugger) const {
+        for (size_t i = 0; i < terms.size(); ++i) {
+            const term &t = terms[i];
+            if (t.Kind == termRAM) {
+                // RAM is mirrored up to 0x1FFF
+                for (uint16_t mirror = 0; mirror < 0x2000; mirror += 0x800) {
+                    debugger.AddWatchpoint(uint16_t(mirror + t.Address), uint16_t(mirror + t.Address), TrapWrite);
+                }
+            } else if (t.Kind == termPC) {
+                debugger.AddBreakpoint(t.Address);
+            }
+        }
+    }
+
+    void Predicate::Watched(std::vector<uint16_t> &addresses, std::vector<uint16_t> &pcs) const {
+        for (size_t i = 0; i < terms.size(); ++i) {
+            const term &t = terms[i];
+            if (t.Kind == termRAM) {
+                addresses.push_back(t.Address);
+            } else if (t.Kind == termPC) {
+                pcs.push_back(t.Address);
+            }
+        }
+    }
+
+    PredicateWatch::PredicateWatch(const Predicate &predicate, const uint8_t *ram) {
+        predicate.Watched(addresses, pcs);
+        for (size_t i = 0; i < addresses.size(); ++i) {
+            values.push_back(ram[addresses[i]]);
+        }
+    }
+}
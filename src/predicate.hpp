@@ -0,0 +1,175 @@
+#ifndef NESTAKE_PREDICATE
+#define NESTAKE_PREDICATE
+
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+#include "cpu.hpp"
+#include "debugger.hpp"
+#include "memory.hpp"
+#include "ppu.hpp"
+
+namespace nestake {
+
+    // comparisons of Predicate::RAM
+    enum CompareOp {
+        CompareEqual,
+        CompareNotEqual,
+        CompareLess,
+        CompareLessEqual,
+        CompareGreater,
+        CompareGreaterEqual,
+    };
+
+    // stop condition of RunUntil, built from RAM compares, PC equality and frame counts
+    // combined with && and ||. it is kept flat as an OR of AND-ed terms, and RunUntil
+    // only evaluates it when one of its terms can have changed: after a write to a
+    // compared RAM byte, before the instruction at a compared PC and at frame boundaries.
+    class Predicate {
+    private:
+        enum termKind {
+            termRAM,
+            termPC,
+            termFrames,
+        };
+
+        struct term {
+            uint8_t Kind;
+            uint8_t Op;
+
+            // RAM address (0x0000-0x07FF) or PC
+            uint16_t Address;
+
+            // compared byte or number of frames
+            uint64_t Value;
+        };
+
+        // clauses are consecutive terms: terms[ends[i-1] .. ends[i])
+        std::vector<term> terms;
+        std::vector<size_t> ends;
+
+        explicit Predicate(const term &t);
+        Predicate() {}
+
+        bool holds(const term &t, const uint8_t *ram, uint16_t pc, uint64_t frames) const;
+    public:
+        // RAM byte (0x0000-0x1FFF, mirrors included) compared with the value.
+        // throws std::out_of_range for addresses outside the RAM
+        static Predicate RAM(uint16_t address, CompareOp op, uint8_t value);
+
+        // the next instruction is at pc
+        static Predicate PC(uint16_t pc);
+
+        // the PPU started at least `count` frames (PPU::Frame) since RunUntil started
+        static Predicate Frames(uint64_t count);
+
+        Predicate operator&&(const Predicate &other) const;
+        Predicate operator||(const Predicate &other) const;
+
+        // whether it holds given the 2KB of RAM, the next PC and the frames run so far
+        bool Holds(const uint8_t *ram, uint16_t pc, uint64_t frames) const;
+
+        // whether frame boundaries matter
+        bool CountsFrames() const;
+
+        // write watchpoints on the compared RAM bytes and breakpoints on the compared PCs
+        void Arm(Debugger &debugger) const;
+
+        // append the compared RAM addresses (0x0000-0x07FF) and PCs
+        void Watched(std::vector<uint16_t> &addresses, std::vector<uint16_t> &pcs) const;
+    };
+
+    // what RunUntil looks at after each step without the debugger traps: the compared
+    // RAM bytes against their last values, and the compared PCs
+    class PredicateWatch {
+        std::vector<uint16_t> addresses;
+        std::vector<uint8_t> values;
+        std::vector<uint16_t> pcs;
+    public:
+        PredicateWatch(const Predicate &predicate, const uint8_t *ram);
+
+        // whether a compared byte changed since the last call or the next instruction is at a compared PC
+        bool Changed(const uint8_t *ram, uint16_t pc) {
+            bool changed = false;
+            for (size_t i = 0; i < addresses.size(); ++i) {
+                if (ram[addresses[i]] != values[i]) {
+                    values[i] = ram[addresses[i]];
+                    changed = true;
+                }
+            }
+            for (size_t i = 0; i < pcs.size() && !changed; ++i) {
+                changed = pc == pcs[i];
+            }
+            return changed;
+        }
+    };
+
+#ifdef NESTAKE_DEBUGGER
+    // attaches a debugger owned by the caller to an unwatched bus and detaches it
+    // when it goes out of scope, also when a step throws
+    class DebuggerScope {
+        CPUMemory &bus;
+    public:
+        DebuggerScope(CPUMemory &bus, Debugger &debugger): bus(bus) {
+            bus.Attach(std::shared_ptr<Debugger>(std::shared_ptr<Debugger>(), &debugger));
+        }
+        ~DebuggerScope() {
+            bus.Attach(nullptr);
+        }
+        DebuggerScope(const DebuggerScope &) = delete;
+        DebuggerScope &operator=(const DebuggerScope &) = delete;
+    };
+#endif
+
+    // step until the predicate holds or maxCycles cycles ran; whether it holds. the predicate is
+    // evaluated when one of its terms can have changed: at its traps with NESTAKE_DEBUGGER,
+    // otherwise when PredicateWatch sees a change, and when PPU::Frame moves.
+    // throws std::logic_error when a debugger is attached to the bus (its traps would be
+    // suspended meanwhile) and std::invalid_argument when frames are compared without a PPU
+    template <typename Stepper>
+    bool RunUntil(Cpu &cpu, CPUMemory &bus, const Predicate &predicate, uint64_t maxCycles, Stepper step) {
+#ifdef NESTAKE_DEBUGGER
+        if (bus.Debug != nullptr) {
+            throw std::logic_error("RunUntil: a debugger is attached to the bus");
+        }
+#endif
+        const PPU *ppu = predicate.CountsFrames() ? bus.PPU.get() : nullptr;
+        if (predicate.CountsFrames() && ppu == nullptr) {
+            throw std::invalid_argument("RunUntil: frames are compared without a PPU");
+        }
+#ifdef NESTAKE_DEBUGGER
+        Debugger traps;
+        predicate.Arm(traps);
+        DebuggerScope scope(bus, traps);
+#else
+        PredicateWatch watch(predicate, bus.RAM.data());
+#endif
+
+        const uint64_t end = cpu.Cycles + maxCycles;
+        const uint64_t startFrame = ppu != nullptr ? ppu->Frame : 0;
+        uint64_t frames = 0;
+        bool held = predicate.Holds(bus.RAM.data(), cpu.PC, frames);
+        while (!held && cpu.Cycles < end) {
+#ifdef NESTAKE_DEBUGGER
+            do {
+                step();
+            } while (cpu.Cycles < end && !traps.Stopped() && (ppu == nullptr || ppu->Frame - startFrame == frames));
+            traps.Resume();
+#else
+            do {
+                step();
+            } while (cpu.Cycles < end && !watch.Changed(bus.RAM.data(), cpu.PC) &&
+                     (ppu == nullptr || ppu->Frame - startFrame == frames));
+#endif
+            if (ppu != nullptr) {
+                frames = ppu->Frame - startFrame;
+            }
+            held = predicate.Holds(bus.RAM.data(), cpu.PC, frames);
+        }
+        return held;
+    }
+}
+
+#endif
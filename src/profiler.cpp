@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+
+#include "cpu.hpp"
+#include "profiler.hpp"
+
+namespace nestake {
+
+    // header of an exported profile
+    struct profileHeader {
+        // "NESPROF"
+        char Magic[8];
+        uint32_t Version;
+        uint32_t Interval;
+        uint64_t Instructions;
+        uint64_t Samples;
+    };
+
+    static const char *modeNames[16] = {
+        "???", "Absolute", "AbsoluteX", "AbsoluteY", "Accumulator", "Immediate", "Implied",
+        "IndexedIndirect", "Indirect", "IndirectIndexed", "Relative", "ZeroPage", "ZeroPageX", "ZeroPageY",
+        "???", "???",
+    };
+
+    Profiler::Profiler(uint32_t interval):
+        interval(interval > 0 ? interval : 1), countdown(this->interval), instructions(0), samples(0),
+        opcodeCounts(0x100, 0), modeCounts(0x10, 0), pcCycles(0x10000, 0) {}
+
+    bool Profiler::Export(const std::string &path) const {
+        FILE *f = std::fopen(path.c_str(), "wb");
+        if (f == nullptr) {
+            return false;
+        }
+
+        profileHeader h = {{'N', 'E', 'S', 'P', 'R', 'O', 'F', 0}, 1, interval, instructions, samples};
+        bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+                  std::fwrite(opcodeCounts.data(), sizeof(uint64_t), opcodeCounts.size(), f) == opcodeCounts.size() &&
+                  std::fwrite(modeCounts.data(), sizeof(uint64_t), modeCounts.size(), f) == modeCounts.size() &&
+                  std::fwrite(pcCycles.data(), sizeof(uint64_t), pcCycles.size(), f) == pcCycles.size();
+        return std::fclose(f) == 0 && ok;
+    }
+
+    // indices of the n largest non-zero values in descending order
+    static std::vector<uint32_t> largest(const std::vector<uint64_t> &values, size_t n) {
+        std::vector<uint32_t> indices;
+        for (uint32_t i = 0; i < values.size(); ++i) {
+            if (values[i] > 0) {
+                indices.push_back(i);
+            }
+        }
+        std::stable_sort(indices.begin(), indices.end(), [&values](uint32_t a, uint32_t b) {
+            return values[a] > values[b];
+        });
+        if (indices.size() > n) {
+            indices.resize(n);
+        }
+        return indices;
+    }
+
+    static double percentOf(uint64_t v, uint64_t total) {
+        return total > 0 ? 100.0 * double(v) / double(total) : 0.0;
+    }
+
+    void Profiler::Report(std::ostream &out, const Cpu &cpu, size_t n) const {
+        uint64_t cycles = 0;
+        for (size_t i = 0; i < pcCycles.size(); ++i) {
+            cycles += pcCycles[i];
+        }
+
+        out << "instructions: " << instructions << " (" << samples << " samples, every " << interval << ")\n";
+        out << std::fixed << std::setprecision(1);
+
+        out << "opcodes:\n";
+        std::vector<uint32_t> opcodes = largest(opcodeCounts, n);
+        for (size_t i = 0; i < opcodes.size(); ++i) {
+            uint64_t count = opcodeCounts[opcodes[i]];
+            out << "  " << cpu.InstructionName(uint8_t(opcodes[i])) << "(" << std::hex << std::uppercase
+                << std::setfill('0') << std::setw(2) << opcodes[i] << std::dec << "): " << count
+                << " (" << percentOf(count, samples) << "%)\n";
+        }
+
+        out << "addressing modes:\n";
+        std::vector<uint32_t> modes = largest(modeCounts, modeCounts.size());
+        for (size_t i = 0; i < modes.size(); ++i) {
+            uint64_t count = modeCounts[modes[i]];
+            out << "  " << modeNames[modes[i]] << ": " << count << " (" << percentOf(count, samples) << "%)\n";
+        }
+
+        out << "cycles by address:\n";
+        std::vector<uint32_t> pcs = largest(pcCycles, n);
+        for (size_t i = 0; i < pcs.size(); ++i) {
+            uint64_t count = pcCycles[pcs[i]];
+            out << "  $" << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << pcs[i] << std::dec
+                << ": " << count << " (" << percentOf(count, cycles) << "%)\n";
+        }
+    }
+
+    void Profiler::Clear() {
+        countdown = interval;
+        instructions = 0;
+        samples = 0;
+        std::fill(opcodeCounts.begin(), opcodeCounts.end(), 0);
+        std::fill(modeCounts.begin(), modeCounts.end(), 0);
+        std::fill(pcCycles.begin(), pcCycles.end(), 0);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef NESTAKE_PROFILER
+#define NESTAKE_PROFILER
+
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace nestake {
+    class Cpu;
+
+    // guest profile fed by Cpu::Step: opcode counts, addressing mode mix and cycles spent per cpu address.
+    // with an interval of N only every Nth instruction is recorded (1 records all of them).
+    class Profiler {
+    private:
+        uint32_t interval;
+        uint32_t countdown;
+        uint64_t instructions;
+        uint64_t samples;
+        std::vector<uint64_t> opcodeCounts;
+        std::vector<uint64_t> modeCounts;
+
+        // indexed by cpu address; to be keyed by bank once mappers switch PRG-ROM
+        std::vector<uint64_t> pcCycles;
+    public:
+        explicit Profiler(uint32_t interval = 1);
+
+        // record an executed instruction and the cycles it took
+        void Record(uint16_t pc, uint8_t opcode, uint8_t mode, uint64_t cycles) {
+            ++instructions;
+            if (--countdown != 0) {
+                return;
+            }
+            countdown = interval;
+            ++samples;
+            ++opcodeCounts[opcode];
+            ++modeCounts[mode & 0xF];
+            pcCycles[pc] += cycles;
+        }
+
+        uint32_t Interval() const { return interval; }
+
+        // executed instructions, recorded or not
+        uint64_t Instructions() const { return instructions; }
+
+        // recorded instructions
+        uint64_t Samples() const { return samples; }
+
+        uint64_t OpcodeCount(uint8_t opcode) const { return opcodeCounts[opcode]; }
+        uint64_t ModeCount(uint8_t mode) const { return modeCounts[mode & 0xF]; }
+        uint64_t CyclesAt(uint16_t pc) const { return pcCycles[pc]; }
+
+        // write the raw tables to a file: header, 256 opcode counts, 16 mode counts, 65536 cycle totals
+        bool Export(const std::string &path) const;
+
+        // human readable summary with the n most frequent opcodes and the n hottest addresses
+        void Report(std::ostream &out, const Cpu &cpu, size_t n) const;
+
+        void Clear();
+    };
+}
+
+#endif
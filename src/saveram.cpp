@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "saveram.hpp"
+
+namespace nestake {
+
+    SaveRAM::SaveRAM(): data(new uint8_t[Size]()), fileBacked(false), dirty(0) {
+    }
+
+    SaveRAM::SaveRAM(const std::string &path): data(nullptr), fileBacked(false), dirty(0) {
+        // a shorter (or new) file is padded with 0
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        void *p = MAP_FAILED;
+        if (fd >= 0 && ftruncate(fd, off_t(Size)) == 0) {
+            p = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (p == MAP_FAILED) {
+            data = new uint8_t[Size]();
+            return;
+        }
+        data = static_cast<uint8_t *>(p);
+        fileBacked = true;
+    }
+
+    SaveRAM::~SaveRAM() {
+        if (fileBacked) {
+            Sync();
+            munmap(data, Size);
+        } else {
+            delete[] data;
+        }
+    }
+
+    // msync the host pages holding a dirty 256-byte page
+    static void syncPages(uint8_t *data, uint32_t dirty, int flags) {
+        const size_t hostPage = size_t(sysconf(_SC_PAGESIZE));
+        const size_t pagesPerHost = hostPage / 0x100;
+        for (size_t first = 0; first < SaveRAM::Size / 0x100; first += pagesPerHost) {
+            const uint32_t mask = pagesPerHost >= 32 ? ~uint32_t(0) : ((uint32_t(1) << pagesPerHost) - 1) << first;
+            if ((dirty & mask) != 0) {
+                size_t length = hostPage < SaveRAM::Size ? hostPage : SaveRAM::Size;
+                msync(data + first*0x100, length, flags);
+            }
+        }
+    }
+
+    void SaveRAM::Flush() {
+        if (fileBacked && dirty != 0) {
+            syncPages(data, dirty, MS_ASYNC);
+        }
+        dirty = 0;
+    }
+
+    void SaveRAM::Sync() {
+        if (fileBacked) {
+            // pages scheduled by Flush may still be in flight
+            msync(data, Size, MS_SYNC);
+        }
+        dirty = 0;
+    }
+
+    void SaveRAM::Restore(const uint8_t *snapshot) {
+        std::memcpy(data, snapshot, Size);
+        dirty = ~uint32_t(0);
+    }
+
+    void SaveRAM::Clear() {
+        std::memset(data, 0, Size);
+        dirty = ~uint32_t(0);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef NESTAKE_SAVERAM
+#define NESTAKE_SAVERAM
+
+#include <stdint.h>
+#include <string>
+
+namespace nestake {
+
+    // battery-backed cartridge RAM at 0x6000-0x7FFF. it lives in memory, or in a .sav file mapped
+    // shared so the kernel writes it back; writes only mark their 256-byte page dirty
+    // and Flush schedules the dirty pages without waiting for the disk.
+    class SaveRAM {
+    private:
+        uint8_t *data;
+        bool fileBacked;
+
+        // one bit per 256-byte page
+        uint32_t dirty;
+    public:
+        static const size_t Size = 0x2000;
+
+        // in memory, filled with 0
+        SaveRAM();
+
+        // mapped from the file, created or extended to Size. in memory, filled with 0,
+        // when the file cannot be mapped (IsFileBacked is false)
+        explicit SaveRAM(const std::string &path);
+
+        // waits for the file to be written back
+        ~SaveRAM();
+        SaveRAM(const SaveRAM &) = delete;
+        SaveRAM &operator=(const SaveRAM &) = delete;
+
+        // offset from 0x6000
+        uint8_t Read(uint16_t offset) const {
+            return data[offset & (Size - 1)];
+        }
+
+        void Write(uint16_t offset, uint8_t value) {
+            offset &= Size - 1;
+            data[offset] = value;
+            dirty |= uint32_t(1) << (offset >> 8);
+        }
+
+        // pages written since the last Flush / Sync
+        uint32_t Dirty() const { return dirty; }
+
+        bool IsFileBacked() const { return fileBacked; }
+
+        // start writing the dirty pages back to the file (msync MS_ASYNC) and return at once
+        void Flush();
+
+        // write the dirty pages back and wait for the disk
+        void Sync();
+
+        // Size bytes, for snapshots
+        const uint8_t *Data() const { return data; }
+
+        // copy a snapshot of Size bytes back; every page becomes dirty
+        void Restore(const uint8_t *snapshot);
+
+        // fill with 0; every page becomes dirty
+        void Clear();
+    };
+}
+
+#endif
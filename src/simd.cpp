@@ -0,0 +1,429 @@
+/*
+ * SIMD kernels and their runtime dispatch.
+ *
+ * every variant lives in this translation unit and is compiled for its instruction set with
+ * a target attribute, so a single binary runs everywhere and Simd() binds the best variants
+ * for the host on first use.
+ */
+
+#include <cstring>
+
+#include "simd.hpp"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define NESTAKE_SIMD_X86_64
+#include <immintrin.h>
+#endif
+
+namespace nestake {
+    // HashBytes: 16 lanes of 32 bits over 64-byte chunks, folded with FNV-1a at the end
+    const size_t hashLanes = 16;
+    const uint32_t hashPrime = 0x9E3779B1;
+    const uint64_t fnvOffset = 0xCBF29CE484222325ULL;
+    const uint64_t fnvPrime = 0x100000001B3ULL;
+
+    static uint64_t hashFold(const uint32_t *lanes, const uint8_t *tail, size_t tailSize, size_t size) {
+        uint64_t h = fnvOffset ^ uint64_t(size);
+        for (size_t i = 0; i < hashLanes; ++i) {
+            h = (h ^ lanes[i]) * fnvPrime;
+        }
+        for (size_t i = 0; i < tailSize; ++i) {
+            h = (h ^ tail[i]) * fnvPrime;
+        }
+        return h;
+    }
+
+    static void hashInit(uint32_t *lanes) {
+        for (size_t i = 0; i < hashLanes; ++i) {
+            lanes[i] = hashPrime * uint32_t(i + 1);
+        }
+    }
+
+    static uint8_t avg8(uint8_t a, uint8_t b) {
+        return uint8_t((unsigned(a) + unsigned(b) + 1) >> 1);
+    }
+
+    static uint32_t avgRGBA(uint32_t a, uint32_t b) {
+        uint32_t r = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            r |= uint32_t(avg8(uint8_t(a >> shift), uint8_t(b >> shift))) << shift;
+        }
+        return r;
+    }
+
+    // scalar
+
+    static uint64_t hashBytesScalar(const uint8_t *data, size_t size) {
+        uint32_t lanes[hashLanes];
+        hashInit(lanes);
+        size_t chunks = size / (hashLanes * 4);
+        for (size_t c = 0; c < chunks; ++c) {
+            for (size_t i = 0; i < hashLanes; ++i) {
+                uint32_t w;
+                std::memcpy(&w, data + c * hashLanes * 4 + i * 4, 4);
+                uint32_t h = (lanes[i] ^ w) * hashPrime;
+                lanes[i] = h ^ (h >> 15);
+            }
+        }
+        size_t done = chunks * hashLanes * 4;
+        return hashFold(lanes, data + done, size - done, size);
+    }
+
+    static void paletteToRGBAScalar(const uint8_t *indices, size_t n, const uint32_t *palette, uint32_t *out) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = palette[indices[i] & 0x3F];
+        }
+    }
+
+    static void downsample2xScalar(const uint32_t *src, size_t width, size_t height, uint32_t *dst) {
+        for (size_t y = 0; y < height / 2; ++y) {
+            const uint32_t *r0 = src + 2 * y * width;
+            const uint32_t *r1 = r0 + width;
+            for (size_t x = 0; x < width / 2; ++x) {
+                uint32_t left = avgRGBA(r0[2 * x], r1[2 * x]);
+                uint32_t right = avgRGBA(r0[2 * x + 1], r1[2 * x + 1]);
+                dst[y * (width / 2) + x] = avgRGBA(left, right);
+            }
+        }
+    }
+
+    static bool composeLineScalar(const uint8_t *bg, const uint8_t *sprites, uint8_t *out, size_t n) {
+        // masks instead of branches, so that the compiler can vectorize it as well
+        uint8_t hit = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t b = bg[i], s = sprites[i];
+            uint8_t bgOpaque = uint8_t(-uint8_t((b & 3) != 0));
+            uint8_t spriteOpaque = uint8_t(-uint8_t((s & 3) != 0));
+            uint8_t front = uint8_t(-uint8_t((s & SpriteBehind) == 0));
+            uint8_t useSprite = spriteOpaque & (front | uint8_t(~bgOpaque));
+            out[i] = uint8_t((useSprite & s & 0x1F) | (uint8_t(~useSprite) & bgOpaque & b));
+            hit |= bgOpaque & spriteOpaque & s & SpriteZero;
+        }
+        return hit != 0;
+    }
+
+    static bool updateBytesScalar(const uint8_t *src, uint8_t *dst, size_t n) {
+        uint8_t diff = 0;
+        for (size_t i = 0; i < n; ++i) {
+            diff |= src[i] ^ dst[i];
+            dst[i] = src[i];
+        }
+        return diff != 0;
+    }
+
+#ifdef NESTAKE_SIMD_X86_64
+
+    // SSE2
+
+    // 32-bit lane multiply (SSE2 only has 32x32->64 on the even lanes)
+    __attribute__((target("sse2")))
+    static inline __m128i mullo32SSE2(__m128i a, __m128i b) {
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    __attribute__((target("sse2")))
+    static uint64_t hashBytesSSE2(const uint8_t *data, size_t size) {
+        uint32_t lanes[hashLanes];
+        hashInit(lanes);
+        __m128i h[4];
+        for (int i = 0; i < 4; ++i) {
+            h[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes) + i);
+        }
+        const __m128i prime = _mm_set1_epi32(int32_t(hashPrime));
+        size_t chunks = size / (hashLanes * 4);
+        for (size_t c = 0; c < chunks; ++c) {
+            const __m128i *p = reinterpret_cast<const __m128i *>(data + c * hashLanes * 4);
+            for (int i = 0; i < 4; ++i) {
+                __m128i v = mullo32SSE2(_mm_xor_si128(h[i], _mm_loadu_si128(p + i)), prime);
+                h[i] = _mm_xor_si128(v, _mm_srli_epi32(v, 15));
+            }
+        }
+        for (int i = 0; i < 4; ++i) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes) + i, h[i]);
+        }
+        size_t done = chunks * hashLanes * 4;
+        return hashFold(lanes, data + done, size - done, size);
+    }
+
+    __attribute__((target("sse2")))
+    static void downsample2xSSE2(const uint32_t *src, size_t width, size_t height, uint32_t *dst) {
+        size_t half = width / 2;
+        for (size_t y = 0; y < height / 2; ++y) {
+            const uint32_t *r0 = src + 2 * y * width;
+            const uint32_t *r1 = r0 + width;
+            uint32_t *out = dst + y * half;
+            size_t x = 0;
+            // 8 source pixels -> 4
+            for (; x + 4 <= half; x += 4) {
+                __m128i a = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + 2 * x)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + 2 * x)));
+                __m128i b = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + 2 * x + 4)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + 2 * x + 4)));
+                __m128 left = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 right = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x),
+                                 _mm_avg_epu8(_mm_castps_si128(left), _mm_castps_si128(right)));
+            }
+            for (; x < half; ++x) {
+                out[x] = avgRGBA(avgRGBA(r0[2 * x], r1[2 * x]), avgRGBA(r0[2 * x + 1], r1[2 * x + 1]));
+            }
+        }
+    }
+
+    __attribute__((target("sse2")))
+    static bool composeLineSSE2(const uint8_t *bg, const uint8_t *sprites, uint8_t *out, size_t n) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i pixel = _mm_set1_epi8(3);
+        const __m128i behind = _mm_set1_epi8(SpriteBehind);
+        const __m128i color = _mm_set1_epi8(0x1F);
+        const __m128i spriteZero = _mm_set1_epi8(SpriteZero);
+        __m128i hit = zero;
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bg + i));
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sprites + i));
+            __m128i bgOpaque = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_and_si128(b, pixel), zero), _mm_set1_epi8(-1));
+            __m128i spriteOpaque = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_and_si128(s, pixel), zero), _mm_set1_epi8(-1));
+            __m128i front = _mm_cmpeq_epi8(_mm_and_si128(s, behind), zero);
+            __m128i useSprite = _mm_and_si128(spriteOpaque, _mm_or_si128(front, _mm_andnot_si128(bgOpaque, _mm_set1_epi8(-1))));
+            __m128i v = _mm_or_si128(_mm_and_si128(useSprite, _mm_and_si128(s, color)),
+                                     _mm_andnot_si128(useSprite, _mm_and_si128(bgOpaque, b)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+            hit = _mm_or_si128(hit, _mm_and_si128(_mm_and_si128(bgOpaque, spriteOpaque), _mm_and_si128(s, spriteZero)));
+        }
+        bool tail = composeLineScalar(bg + i, sprites + i, out + i, n - i);
+        return tail || _mm_movemask_epi8(_mm_cmpeq_epi8(hit, zero)) != 0xFFFF;
+    }
+
+    __attribute__((target("sse2")))
+    static bool updateBytesSSE2(const uint8_t *src, uint8_t *dst, size_t n) {
+        __m128i diff = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+            diff = _mm_or_si128(diff, _mm_xor_si128(a, b));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), a);
+        }
+        bool tail = updateBytesScalar(src + i, dst + i, n - i);
+        return tail || _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF;
+    }
+
+    // AVX2
+
+    __attribute__((target("avx2")))
+    static uint64_t hashBytesAVX2(const uint8_t *data, size_t size) {
+        uint32_t lanes[hashLanes];
+        hashInit(lanes);
+        __m256i h0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes));
+        __m256i h1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes) + 1);
+        const __m256i prime = _mm256_set1_epi32(int32_t(hashPrime));
+        size_t chunks = size / (hashLanes * 4);
+        for (size_t c = 0; c < chunks; ++c) {
+            const __m256i *p = reinterpret_cast<const __m256i *>(data + c * hashLanes * 4);
+            __m256i v0 = _mm256_mullo_epi32(_mm256_xor_si256(h0, _mm256_loadu_si256(p)), prime);
+            __m256i v1 = _mm256_mullo_epi32(_mm256_xor_si256(h1, _mm256_loadu_si256(p + 1)), prime);
+            h0 = _mm256_xor_si256(v0, _mm256_srli_epi32(v0, 15));
+            h1 = _mm256_xor_si256(v1, _mm256_srli_epi32(v1, 15));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), h0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes) + 1, h1);
+        size_t done = chunks * hashLanes * 4;
+        return hashFold(lanes, data + done, size - done, size);
+    }
+
+    __attribute__((target("avx2")))
+    static void paletteToRGBAAVX2(const uint8_t *indices, size_t n, const uint32_t *palette, uint32_t *out) {
+        const __m256i mask = _mm256_set1_epi32(0x3F);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + i));
+            __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(bytes), mask);
+            __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int *>(palette), index, 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), colors);
+        }
+        paletteToRGBAScalar(indices + i, n - i, palette, out + i);
+    }
+
+    __attribute__((target("avx2")))
+    static void downsample2xAVX2(const uint32_t *src, size_t width, size_t height, uint32_t *dst) {
+        size_t half = width / 2;
+        for (size_t y = 0; y < height / 2; ++y) {
+            const uint32_t *r0 = src + 2 * y * width;
+            const uint32_t *r1 = r0 + width;
+            uint32_t *out = dst + y * half;
+            size_t x = 0;
+            // 16 source pixels -> 8
+            for (; x + 8 <= half; x += 8) {
+                __m256i a = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(r0 + 2 * x)),
+                                            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(r1 + 2 * x)));
+                __m256i b = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(r0 + 2 * x + 8)),
+                                            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(r1 + 2 * x + 8)));
+                // per 128-bit lane: a0 a2 b0 b2 | a4 a6 b4 b6, then restore the order across lanes
+                __m256 left = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+                __m256 right = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+                __m256i v = _mm256_avg_epu8(_mm256_castps_si256(left), _mm256_castps_si256(right));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+            for (; x < half; ++x) {
+                out[x] = avgRGBA(avgRGBA(r0[2 * x], r1[2 * x]), avgRGBA(r0[2 * x + 1], r1[2 * x + 1]));
+            }
+        }
+    }
+
+    __attribute__((target("avx2")))
+    static bool composeLineAVX2(const uint8_t *bg, const uint8_t *sprites, uint8_t *out, size_t n) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi8(-1);
+        const __m256i pixel = _mm256_set1_epi8(3);
+        const __m256i behind = _mm256_set1_epi8(SpriteBehind);
+        const __m256i color = _mm256_set1_epi8(0x1F);
+        const __m256i spriteZero = _mm256_set1_epi8(SpriteZero);
+        __m256i hit = zero;
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bg + i));
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sprites + i));
+            __m256i bgOpaque = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_and_si256(b, pixel), zero), ones);
+            __m256i spriteOpaque = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_and_si256(s, pixel), zero), ones);
+            __m256i front = _mm256_cmpeq_epi8(_mm256_and_si256(s, behind), zero);
+            __m256i useSprite = _mm256_and_si256(spriteOpaque, _mm256_or_si256(front, _mm256_xor_si256(bgOpaque, ones)));
+            // blendv picks the sprite byte where useSprite is set
+            __m256i v = _mm256_blendv_epi8(_mm256_and_si256(bgOpaque, b), _mm256_and_si256(s, color), useSprite);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+            hit = _mm256_or_si256(hit, _mm256_and_si256(_mm256_and_si256(bgOpaque, spriteOpaque),
+                                                        _mm256_and_si256(s, spriteZero)));
+        }
+        bool tail = composeLineScalar(bg + i, sprites + i, out + i, n - i);
+        return tail || !_mm256_testz_si256(hit, hit);
+    }
+
+    __attribute__((target("avx2")))
+    static bool updateBytesAVX2(const uint8_t *src, uint8_t *dst, size_t n) {
+        __m256i diff = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(a, b));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), a);
+        }
+        bool tail = updateBytesScalar(src + i, dst + i, n - i);
+        return tail || !_mm256_testz_si256(diff, diff);
+    }
+
+    // AVX-512 (F + BW)
+
+    __attribute__((target("avx512f")))
+    static uint64_t hashBytesAVX512(const uint8_t *data, size_t size) {
+        uint32_t lanes[hashLanes];
+        hashInit(lanes);
+        __m512i h = _mm512_loadu_si512(lanes);
+        const __m512i prime = _mm512_set1_epi32(int32_t(hashPrime));
+        size_t chunks = size / (hashLanes * 4);
+        for (size_t c = 0; c < chunks; ++c) {
+            __m512i v = _mm512_mullo_epi32(_mm512_xor_si512(h, _mm512_loadu_si512(data + c * hashLanes * 4)), prime);
+            h = _mm512_xor_si512(v, _mm512_srli_epi32(v, 15));
+        }
+        _mm512_storeu_si512(lanes, h);
+        size_t done = chunks * hashLanes * 4;
+        return hashFold(lanes, data + done, size - done, size);
+    }
+
+    __attribute__((target("avx512f")))
+    static void paletteToRGBAAVX512(const uint8_t *indices, size_t n, const uint32_t *palette, uint32_t *out) {
+        // the 64 colors sit in four registers, no memory gather needed
+        const __m512i t0 = _mm512_loadu_si512(palette);
+        const __m512i t1 = _mm512_loadu_si512(palette + 16);
+        const __m512i t2 = _mm512_loadu_si512(palette + 32);
+        const __m512i t3 = _mm512_loadu_si512(palette + 48);
+        const __m512i high = _mm512_set1_epi32(0x20);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512i index = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i)));
+            __m512i lo = _mm512_permutex2var_epi32(t0, index, t1);
+            __m512i hi = _mm512_permutex2var_epi32(t2, index, t3);
+            __mmask16 useHigh = _mm512_test_epi32_mask(index, high);
+            _mm512_storeu_si512(out + i, _mm512_mask_blend_epi32(useHigh, lo, hi));
+        }
+        paletteToRGBAScalar(indices + i, n - i, palette, out + i);
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    static void downsample2xAVX512(const uint32_t *src, size_t width, size_t height, uint32_t *dst) {
+        size_t half = width / 2;
+        const __m512i evens = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+        const __m512i odds = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+        for (size_t y = 0; y < height / 2; ++y) {
+            const uint32_t *r0 = src + 2 * y * width;
+            const uint32_t *r1 = r0 + width;
+            uint32_t *out = dst + y * half;
+            size_t x = 0;
+            // 32 source pixels -> 16
+            for (; x + 16 <= half; x += 16) {
+                __m512i a = _mm512_avg_epu8(_mm512_loadu_si512(r0 + 2 * x), _mm512_loadu_si512(r1 + 2 * x));
+                __m512i b = _mm512_avg_epu8(_mm512_loadu_si512(r0 + 2 * x + 16), _mm512_loadu_si512(r1 + 2 * x + 16));
+                __m512i left = _mm512_permutex2var_epi32(a, evens, b);
+                __m512i right = _mm512_permutex2var_epi32(a, odds, b);
+                _mm512_storeu_si512(out + x, _mm512_avg_epu8(left, right));
+            }
+            for (; x < half; ++x) {
+                out[x] = avgRGBA(avgRGBA(r0[2 * x], r1[2 * x]), avgRGBA(r0[2 * x + 1], r1[2 * x + 1]));
+            }
+        }
+    }
+#endif
+
+    SimdLevel DetectSimdLevel() {
+#ifdef NESTAKE_SIMD_X86_64
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            return SimdAVX512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdAVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return SimdSSE2;
+        }
+#endif
+        return SimdScalar;
+    }
+
+    SimdKernels SimdKernelsFor(SimdLevel level) {
+        SimdKernels k = {SimdScalar, hashBytesScalar, paletteToRGBAScalar, downsample2xScalar, composeLineScalar,
+                         updateBytesScalar};
+#ifdef NESTAKE_SIMD_X86_64
+        if (level >= SimdSSE2) {
+            k.Level = SimdSSE2;
+            k.HashBytes = hashBytesSSE2;
+            k.Downsample2x = downsample2xSSE2;
+            k.ComposeLine = composeLineSSE2;
+            k.UpdateBytes = updateBytesSSE2;
+        }
+        if (level >= SimdAVX2) {
+            k.Level = SimdAVX2;
+            k.HashBytes = hashBytesAVX2;
+            k.PaletteToRGBA = paletteToRGBAAVX2;
+            k.Downsample2x = downsample2xAVX2;
+            k.ComposeLine = composeLineAVX2;
+            k.UpdateBytes = updateBytesAVX2;
+        }
+        if (level >= SimdAVX512) {
+            k.Level = SimdAVX512;
+            k.HashBytes = hashBytesAVX512;
+            k.PaletteToRGBA = paletteToRGBAAVX512;
+            k.Downsample2x = downsample2xAVX512;
+        }
+#endif
+        return k;
+    }
+
+    const SimdKernels &Simd() {
+        static const SimdKernels kernels = SimdKernelsFor(DetectSimdLevel());
+        return kernels;
+    }
+}
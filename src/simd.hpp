@@ -0,0 +1,55 @@
+#ifndef NESTAKE_SIMD
+#define NESTAKE_SIMD
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace nestake {
+
+    // instruction set levels with compiled kernel variants (each level implies the previous ones)
+    enum SimdLevel {
+        SimdScalar = 0,
+        SimdSSE2,
+        SimdAVX2,
+        SimdAVX512,
+    };
+
+    // wide kernels; every variant gives exactly the result of the scalar one
+    struct SimdKernels {
+        SimdLevel Level;
+
+        // 64-bit hash of a byte buffer (e.g. a save state or RAM)
+        uint64_t (*HashBytes)(const uint8_t *data, size_t size);
+
+        // out[i] = palette[indices[i] & 0x3F] for n pixels (palette of 64 RGBA colors)
+        void (*PaletteToRGBA)(const uint8_t *indices, size_t n, const uint32_t *palette, uint32_t *out);
+
+        // halve an RGBA image (even width and height): each byte is avg(avg(a, c), avg(b, d)) of the
+        // 2x2 block ab/cd, where avg(x, y) = (x + y + 1) >> 1
+        void (*Downsample2x)(const uint32_t *src, size_t width, size_t height, uint32_t *dst);
+
+        // composite a line of background and sprite pixels into palette indices (0-31).
+        // bg: palette index 0-15, transparent when its low 2 bits are 0.
+        // sprites: palette index 16-31 in the low 5 bits, SpriteBehind / SpriteZero flags, 0 when empty.
+        // returns whether an opaque sprite-0 pixel lies over an opaque background pixel
+        bool (*ComposeLine)(const uint8_t *bg, const uint8_t *sprites, uint8_t *out, size_t n);
+
+        // copy n bytes from src to dst in the same pass as comparing them; whether any byte differed
+        bool (*UpdateBytes)(const uint8_t *src, uint8_t *dst, size_t n);
+    };
+
+    // flags of the sprite pixels given to ComposeLine
+    const uint8_t SpriteBehind = 0x20;
+    const uint8_t SpriteZero = 0x40;
+
+    // best level supported by this host (cpuid)
+    SimdLevel DetectSimdLevel();
+
+    // best variants compiled for the level or below
+    SimdKernels SimdKernelsFor(SimdLevel level);
+
+    // kernels bound once to DetectSimdLevel()
+    const SimdKernels &Simd();
+}
+
+#endif
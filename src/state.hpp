@@ -0,0 +1,61 @@
+#ifndef NESTAKE_STATE
+#define NESTAKE_STATE
+
+#include <stdint.h>
+
+namespace nestake {
+
+    // mutable state of a console as plain data (see BasicConsole::Save / Reset).
+    // the cartridge, its decoded PRG-ROM and compiled code are not part of it.
+    // the layout has no implicit padding since it is also the record of state libraries (statelib.hpp)
+    struct ConsoleState {
+        // cpu
+        uint64_t Cycles;
+        int32_t Stall;
+        uint16_t PC;
+        uint8_t SP;
+        uint8_t A;
+        uint8_t X;
+        uint8_t Y;
+        uint8_t P;
+        uint8_t Interrupt;
+        uint8_t Reserved0[4];
+
+        // PPU
+        uint64_t PPUCycle;
+        uint64_t ScanLine;
+        uint64_t Frame;
+        uint16_t V;
+        uint16_t T;
+        uint8_t FineX;
+        uint8_t W;
+        uint8_t F;
+        uint8_t Control;
+        uint8_t Mask;
+
+        // sprite 0 hit (bit 0) and sprite overflow (bit 1)
+        uint8_t Status;
+        uint8_t OAMAddress;
+        uint8_t BufferedData;
+
+        // nmiOccurred (bit 0), nmiOutput (bit 1), nmiPrevious (bit 2)
+        uint8_t NMI;
+        uint8_t NMIDelay;
+
+        // mapper: MirrorMode and the CHR offsets of the 8 pattern pages
+        uint8_t Mirror;
+        uint8_t Reserved1;
+        uint32_t CHRPages[8];
+
+        // memories
+        uint8_t RAM[2048];
+        uint8_t NameTables[2048];
+        uint8_t OAM[256];
+        uint8_t Palette[32];
+
+        // battery-backed SRAM (0 for cartridges without a battery)
+        uint8_t SRAM[0x2000];
+    };
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "console.hpp"
+#include "statelib.hpp"
+
+namespace nestake {
+
+    static_assert(sizeof(ConsoleState) % 8 == 0, "state records must stay 8-byte aligned");
+
+    static const uint32_t libraryVersion = 1;
+
+    // FNV-1a
+    static uint64_t hashState(const ConsoleState &state) {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(&state);
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < sizeof(state); ++i) {
+            h = (h ^ p[i]) * 1099511628211ULL;
+        }
+        return h;
+    }
+
+    size_t StateLibraryBuilder::Add(const ConsoleState &state) {
+        ConsoleState record = state;
+        std::memset(record.Reserved0, 0, sizeof(record.Reserved0));
+        record.Reserved1 = 0;
+
+        const uint64_t h = hashState(record);
+        uint32_t index = uint32_t(records.size());
+        auto range = byHash.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (std::memcmp(&records[it->second], &record, sizeof(record)) == 0) {
+                index = it->second;
+                break;
+            }
+        }
+        if (index == records.size()) {
+            records.push_back(record);
+            byHash.insert(std::make_pair(h, index));
+        }
+        entries.push_back(index);
+        return entries.size() - 1;
+    }
+
+    bool StateLibraryBuilder::Write(const std::string &path) const {
+        FILE *out = std::fopen(path.c_str(), "wb");
+        if (out == nullptr) {
+            return false;
+        }
+        StateLibraryHeader h = {{'N', 'E', 'S', 'S', 'L', 'I', 'B', 0}, libraryVersion,
+                                uint32_t(sizeof(ConsoleState)), entries.size(), records.size()};
+        const uint64_t first = sizeof(h) + entries.size()*sizeof(uint64_t);
+        std::vector<uint64_t> offsets(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            offsets[i] = first + uint64_t(entries[i])*sizeof(ConsoleState);
+        }
+        bool written = std::fwrite(&h, sizeof(h), 1, out) == 1 &&
+            std::fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out) == offsets.size() &&
+            std::fwrite(records.data(), sizeof(ConsoleState), records.size(), out) == records.size();
+        written = std::fclose(out) == 0 && written;
+        if (!written) {
+            std::remove(path.c_str());
+        }
+        return written;
+    }
+
+    StateLibrary::StateLibrary(const std::string &path):
+        data(nullptr), size(0), offsets(nullptr), entries(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(StateLibraryHeader)) {
+            close(fd);
+            return;
+        }
+        void *p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            return;
+        }
+        data = static_cast<const uint8_t *>(p);
+        size = size_t(st.st_size);
+
+        const StateLibraryHeader &h = *reinterpret_cast<const StateLibraryHeader *>(data);
+        // sizes are divided rather than multiplied, so crafted counts can't overflow
+        bool valid = std::memcmp(h.Magic, "NESSLIB", 8) == 0 && h.Version == libraryVersion &&
+                     h.RecordSize == sizeof(ConsoleState) &&
+                     h.Entries <= (size - sizeof(h)) / sizeof(uint64_t);
+        const uint64_t first = valid ? sizeof(h) + h.Entries*sizeof(uint64_t) : size;
+        valid = valid && h.Records <= (size - first) / sizeof(ConsoleState);
+        offsets = reinterpret_cast<const uint64_t *>(data + sizeof(h));
+        for (uint64_t i = 0; valid && i < h.Entries; ++i) {
+            valid = offsets[i] >= first && (offsets[i] - first) / sizeof(ConsoleState) < h.Records &&
+                    (offsets[i] - first) % sizeof(ConsoleState) == 0;
+        }
+        if (!valid) {
+            munmap(const_cast<uint8_t *>(data), size);
+            data = nullptr;
+            size = 0;
+            offsets = nullptr;
+            return;
+        }
+        entries = h.Entries;
+    }
+
+    StateLibrary::~StateLibrary() {
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t *>(data), size);
+        }
+    }
+
+    const ConsoleState &StateLibrary::At(size_t entry) const {
+        if (entry >= entries) {
+            throw std::out_of_range("state library entry " + std::to_string(entry) + " of " + std::to_string(entries));
+        }
+        return *reinterpret_cast<const ConsoleState *>(data + offsets[entry]);
+    }
+
+    void StateLibrary::Load(size_t entry, Console &console) const {
+        ResetOptions options;
+        options.State = &At(entry);
+        console.Reset(options);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef NESTAKE_STATELIB
+#define NESTAKE_STATELIB
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "state.hpp"
+
+namespace nestake {
+    class Console;
+
+    // header at the beginning of a state library file, followed by the offset table
+    // (one uint64_t file offset per entry) then the ConsoleState records.
+    // identical states are stored once, so several entries can share a record
+    struct StateLibraryHeader {
+        // "NESSLIB"
+        char Magic[8];
+        uint32_t Version;
+
+        // sizeof(ConsoleState)
+        uint32_t RecordSize;
+        uint64_t Entries;
+        uint64_t Records;
+    };
+
+    // collects states and writes a library file
+    class StateLibraryBuilder {
+    private:
+        std::vector<ConsoleState> records;
+
+        // record of every entry
+        std::vector<uint32_t> entries;
+
+        // records by hash of their bytes
+        std::unordered_multimap<uint64_t, uint32_t> byHash;
+    public:
+        // append a state; returns its entry number
+        size_t Add(const ConsoleState &state);
+
+        size_t Entries() const { return entries.size(); }
+
+        // number of distinct states
+        size_t Records() const { return records.size(); }
+
+        // false if the file cannot be created or written, leaving no partial file behind
+        bool Write(const std::string &path) const;
+    };
+
+    // state library mapped read-only, so the processes opening the same file share its pages
+    class StateLibrary {
+    private:
+        const uint8_t *data;
+        size_t size;
+        const uint64_t *offsets;
+        uint64_t entries;
+    public:
+        // IsOpen() is false if the file can't be mapped or isn't a state library
+        explicit StateLibrary(const std::string &path);
+        ~StateLibrary();
+        StateLibrary(const StateLibrary &) = delete;
+        StateLibrary &operator=(const StateLibrary &) = delete;
+
+        bool IsOpen() const { return data != nullptr; }
+
+        size_t Entries() const { return size_t(entries); }
+
+        // state of the entry, inside the mapping; throws std::out_of_range past Entries()
+        const ConsoleState &At(size_t entry) const;
+
+        // reset the console to the state of the entry, copied straight from the mapping
+        void Load(size_t entry, Console &console) const;
+    };
+}
+
+#endif
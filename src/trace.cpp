@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cpu.hpp"
+#include "trace.hpp"
+
+namespace nestake {
+
+    static const char traceMagic[8] = {'N', 'E', 'S', 'T', 'R', 'A', 'C', 'E'};
+    static const uint32_t traceVersion = 1;
+
+    static_assert(sizeof(TraceHeader) == 32, "trace header layout");
+    static_assert(sizeof(TraceRecord) == 24, "trace record layout");
+
+    TraceBuffer::TraceBuffer(const std::string &path, size_t capacity) {
+        uint64_t n = 1;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        mask = n - 1;
+        mappedSize = sizeof(TraceHeader) + size_t(n) * sizeof(TraceRecord);
+
+        void *p = MAP_FAILED;
+        if (!path.empty()) {
+            int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd >= 0) {
+                if (ftruncate(fd, off_t(mappedSize)) == 0) {
+                    p = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                }
+                close(fd);
+            }
+        }
+        fileBacked = p != MAP_FAILED;
+        if (!fileBacked) {
+            p = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        header = static_cast<TraceHeader *>(p);
+        records = reinterpret_cast<TraceRecord *>(header + 1);
+        memcpy(header->Magic, traceMagic, sizeof(traceMagic));
+        header->Version = traceVersion;
+        header->RecordSize = sizeof(TraceRecord);
+        header->Capacity = n;
+        header->Head = 0;
+    }
+
+    TraceBuffer::~TraceBuffer() {
+        munmap(header, mappedSize);
+    }
+
+    size_t TraceBuffer::Size() const {
+        return size_t(header->Head < header->Capacity ? header->Head : header->Capacity);
+    }
+
+    const TraceRecord &TraceBuffer::At(size_t i) const {
+        return records[(header->Head - Size() + i) & mask];
+    }
+
+    // operand in assembler syntax
+    static std::string formatOperand(const DecodedInstruction &d, uint16_t pc) {
+        char buf[16];
+        switch (d.AddressingMode) {
+            case Absolute: snprintf(buf, sizeof(buf), "$%04X", d.Operand); break;
+            case AbsoluteX: snprintf(buf, sizeof(buf), "$%04X,X", d.Operand); break;
+            case AbsoluteY: snprintf(buf, sizeof(buf), "$%04X,Y", d.Operand); break;
+            case Accumulator: snprintf(buf, sizeof(buf), "A"); break;
+            case Immediate: snprintf(buf, sizeof(buf), "#$%02X", d.Operand); break;
+            case IndexedIndirect: snprintf(buf, sizeof(buf), "($%02X,X)", d.Operand); break;
+            case Indirect: snprintf(buf, sizeof(buf), "($%04X)", d.Operand); break;
+            case IndirectIndexed: snprintf(buf, sizeof(buf), "($%02X),Y", d.Operand); break;
+            case Relative:
+                snprintf(buf, sizeof(buf), "$%04X", uint16_t(pc + 2 + int8_t(d.Operand)));
+                break;
+            case ZeroPage: snprintf(buf, sizeof(buf), "$%02X", d.Operand); break;
+            case ZeroPageX: snprintf(buf, sizeof(buf), "$%02X,X", d.Operand); break;
+            case ZeroPageY: snprintf(buf, sizeof(buf), "$%02X,Y", d.Operand); break;
+            default: buf[0] = 0;
+        }
+        return buf;
+    }
+
+    std::string FormatTrace(const TraceRecord &r, Cpu &cpu) {
+        DecodedInstruction d = cpu.Decode(r.Opcode, r.Operand);
+        uint8_t size = d.InstructionSizes > 0 ? d.InstructionSizes : uint8_t(1);
+
+        // "C000  4C F5 C5  JMP $C5F5"
+        char bytes[16];
+        int n = snprintf(bytes, sizeof(bytes), "%02X", r.Opcode);
+        for (uint8_t i = 1; i < size; ++i) {
+            n += snprintf(bytes + n, sizeof(bytes) - n, " %02X", (r.Operand >> (8 * (i - 1))) & 0xFF);
+        }
+        std::string assembly = cpu.InstructionName(r.Opcode);
+        std::string operand = formatOperand(d, r.PC);
+        if (!operand.empty()) {
+            assembly += " " + operand;
+        }
+
+        char line[128];
+        snprintf(line, sizeof(line), "%04X  %-8s  %-30s  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu",
+                 r.PC, bytes, assembly.c_str(), r.A, r.X, r.Y, r.P, r.SP, (unsigned long long) r.Cycles);
+        return line;
+    }
+
+    bool RenderTrace(const std::string &path, std::ostream &out, Cpu &cpu) {
+        FILE *f = std::fopen(path.c_str(), "rb");
+        if (f == nullptr) {
+            return false;
+        }
+
+        TraceHeader h;
+        if (std::fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.Magic, traceMagic, sizeof(traceMagic)) != 0 ||
+            h.Version != traceVersion || h.RecordSize != sizeof(TraceRecord) || h.Capacity == 0) {
+            fclose(f);
+            return false;
+        }
+
+        // oldest record first
+        uint64_t size = h.Head < h.Capacity ? h.Head : h.Capacity;
+        for (uint64_t i = 0; i < size; ++i) {
+            uint64_t slot = (h.Head - size + i) & (h.Capacity - 1);
+            TraceRecord r;
+            if (fseek(f, long(sizeof(h) + slot * sizeof(r)), SEEK_SET) != 0 || std::fread(&r, sizeof(r), 1, f) != 1) {
+                fclose(f);
+                return false;
+            }
+            out << FormatTrace(r, cpu) << "\n";
+        }
+        fclose(f);
+        return true;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef NESTAKE_TRACE_BUFFER
+#define NESTAKE_TRACE_BUFFER
+
+#include <cstddef>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+
+namespace nestake {
+    class Cpu;
+
+    // cpu state at the beginning of an instruction
+    struct TraceRecord {
+        uint64_t Cycles;
+        uint16_t PC;
+
+        // raw operand bytes (little endian)
+        uint16_t Operand;
+        uint8_t Opcode;
+        uint8_t A;
+        uint8_t X;
+        uint8_t Y;
+        uint8_t P;
+        uint8_t SP;
+        uint8_t reserved[6];
+    };
+
+    // header at the beginning of a trace file
+    struct TraceHeader {
+        // "NESTRACE"
+        char Magic[8];
+        uint32_t Version;
+        uint32_t RecordSize;
+
+        // number of records of the ring (power of two)
+        uint64_t Capacity;
+
+        // number of records ever appended; the ring holds the last min(Head, Capacity) of them
+        uint64_t Head;
+    };
+
+    // ring buffer of trace records, memory-mapped onto a file so that
+    // the trace survives a crash and can be read while the emulator is running.
+    // Cpu only appends to it when nestake is built with NESTAKE_TRACE.
+    class TraceBuffer {
+    private:
+        TraceHeader *header;
+        TraceRecord *records;
+        size_t mappedSize;
+        uint64_t mask;
+        bool fileBacked;
+    public:
+        // capacity is rounded up to a power of two. an empty path, or a file that cannot be
+        // mapped (see IsFileBacked), maps anonymous memory; throws std::bad_alloc if that fails too
+        TraceBuffer(const std::string &path, size_t capacity);
+        ~TraceBuffer();
+        TraceBuffer(const TraceBuffer &) = delete;
+        TraceBuffer &operator=(const TraceBuffer &) = delete;
+
+        void Append(const TraceRecord &r) {
+            records[header->Head & mask] = r;
+            ++header->Head;
+        }
+
+        // number of records held by the ring
+        size_t Size() const;
+        size_t Capacity() const { return size_t(header->Capacity); }
+
+        // whether the records go to the file
+        bool IsFileBacked() const { return fileBacked; }
+
+        // i-th oldest record held by the ring
+        const TraceRecord &At(size_t i) const;
+    };
+
+    // render a record as a nestest-style log line (without the trailing newline)
+    std::string FormatTrace(const TraceRecord &r, Cpu &cpu);
+
+    // render every record of a trace file; false if the file is not a trace
+    bool RenderTrace(const std::string &path, std::ostream &out, Cpu &cpu);
+}
+
+#endif
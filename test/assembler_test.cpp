@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "assembler.cpp"
+
+#include <stdexcept>
+
+#include "ines.hpp"
+
+TEST(AssemblerTest, Modes) {
+    nestake::Assembler as;
+    std::vector<uint8_t> code = as.Assemble(
+        "PTR = $10\n"
+        "start: LDA #$05      ; immediate\n"
+        "       STA PTR       ; known constant: zero page\n"
+        "       LDX PTR,Y\n"
+        "       STA $0300,X\n"
+        "       LDA (PTR),Y\n"
+        "       ORA (PTR,X)\n"
+        "       ASL\n"
+        "       ROR A\n"
+        "       JMP (target)\n"
+        "target: JMP start\n", 0x8000);
+
+    const std::vector<uint8_t> expected = {
+        0xA9, 0x05,
+        0x85, 0x10,
+        0xB6, 0x10,
+        0x9D, 0x00, 0x03,
+        0xB1, 0x10,
+        0x01, 0x10,
+        0x0A,
+        0x6A,
+        0x6C, 0x12, 0x80,
+        0x4C, 0x00, 0x80,
+    };
+    EXPECT_EQ(expected, code);
+    EXPECT_EQ(0x8000, as.Label("start"));
+    EXPECT_EQ(0x8012, as.Label("target"));
+    EXPECT_EQ(0x10, as.Label("PTR"));
+}
+
+TEST(AssemblerTest, Branches) {
+    nestake::Assembler as;
+    std::vector<uint8_t> code = as.Assemble(
+        "loop: DEX\n"
+        "      BNE loop\n"
+        "      BEQ done\n"
+        "      NOP\n"
+        "done: RTS\n", 0x0200);
+    const std::vector<uint8_t> expected = {0xCA, 0xD0, 0xFD, 0xF0, 0x01, 0xEA, 0x60};
+    EXPECT_EQ(expected, code);
+
+    std::string far = "loop: NOP\n";
+    for (int i = 0; i < 130; ++i) {
+        far += "NOP\n";
+    }
+    far += "BNE loop\n";
+    EXPECT_THROW(as.Assemble(far, 0x0200), std::runtime_error);
+    EXPECT_THROW(as.Assemble("LDA undefined\n", 0x0200), std::runtime_error);
+    EXPECT_THROW(as.Assemble("STA #$01\n", 0x0200), std::runtime_error);
+    EXPECT_THROW(as.Assemble("FOO\n", 0x0200), std::runtime_error);
+}
+
+TEST(AssemblerTest, Directives) {
+    nestake::Assembler as;
+    std::vector<uint8_t> code = as.Assemble(
+        "reset: SEI\n"
+        "       .byte <reset, >reset, 10, %101\n"
+        "       .org $C008\n"
+        "       .word reset, *\n", 0xC000);
+    const std::vector<uint8_t> expected = {
+        0x78, 0x00, 0xC0, 0x0A, 0x05, 0xFF, 0xFF, 0xFF, 0x00, 0xC0, 0x08, 0xC0,
+    };
+    EXPECT_EQ(expected, code);
+}
+
+TEST(AssemblerTest, Cartridge) {
+    nestake::Assembler as;
+    std::vector<uint8_t> prg = as.Assemble(
+        "reset: LDX #$03\n"
+        "loop:  DEX\n"
+        "       BNE loop\n"
+        "idle:  JMP idle\n"
+        "       .org $FFFA\n"
+        "       .word reset, reset, reset\n", 0xC000);
+    EXPECT_EQ(0x4000, prg.size());
+
+    nestake::Cartridge cart(nestake::MakeINES(prg, std::vector<uint8_t>(), 1, 1));
+    EXPECT_EQ(0x4000, cart.PRG.size());
+    EXPECT_EQ(0x2000, cart.CHR.size());
+    EXPECT_EQ(1, cart.Mapper);
+    EXPECT_EQ(1, cart.Mirror);
+    EXPECT_EQ(0xA2, cart.PRG[0]);
+    EXPECT_EQ(0xC0, cart.PRG[0x3FFD]);
+}
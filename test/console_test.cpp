@@ -12,3 +12,297 @@ TEST(ConsoleTest, Step) {
     std::shared_ptr<nestake::Console> console(std::make_shared<nestake::Console>(cpu, cart));
     console->Step();
 }
+
+TEST(ConsoleTest, BasicConsole) {
+    const std::string path = "../../resources/sample.nes";
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    std::shared_ptr<nestake::Cpu> cpu(std::make_shared<nestake::Cpu>(mem));
+    nestake::Console reference(cpu, std::make_shared<nestake::Cartridge>(path));
+    nestake::BasicConsole<nestake::NROM> basic(std::make_shared<nestake::Cartridge>(path));
+    nestake::Console erased(std::make_shared<nestake::Cartridge>(path));
+
+    for (int i = 0; i < 200; ++i) {
+        reference.Step();
+        basic.Step();
+        erased.Step();
+        ASSERT_EQ(cpu->PC, basic.CPU.PC) << "step " << i;
+        ASSERT_EQ(cpu->Cycles, basic.CPU.Cycles) << "step " << i;
+        ASSERT_EQ(cpu->PC, erased.Processor().PC) << "step " << i;
+    }
+    EXPECT_EQ(cpu->A, basic.CPU.A);
+    EXPECT_TRUE(mem->RAM == basic.Bus.RAM);
+}
+
+TEST(ConsoleTest, CNROM) {
+    // LDA #$01 / STA $8000 / JMP $8005
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    const uint8_t code[] = {0xA9, 0x01, 0x8D, 0x00, 0x80, 0x4C, 0x05, 0x80};
+    std::copy(code, code + sizeof(code), prg.begin());
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0x80;
+    std::vector<uint8_t> chr(0x4000);
+    for (size_t i = 0; i < chr.size(); ++i) {
+        chr[i] = uint8_t(i / 0x2000);
+    }
+    std::shared_ptr<nestake::Cartridge> cart(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr, nestake::CNROM::ID)));
+
+    nestake::BasicConsole<nestake::CNROM> console(cart);
+    EXPECT_EQ(0x8000, console.CPU.PC);
+    EXPECT_EQ(0, console.PPU.Memory().Read(0x1000));
+    console.Step();
+    console.Step();
+    EXPECT_EQ(1, console.PPU.Memory().Read(0x0000));
+    EXPECT_EQ(1, console.PPU.Memory().Read(0x1FFF));
+}
+
+TEST(ConsoleTest, UnsupportedMapper) {
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    std::shared_ptr<nestake::Cartridge> cart(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>(), 255)));
+    EXPECT_THROW(nestake::Console console(cart), std::runtime_error);
+}
+
+TEST(ConsoleTest, ResetFromState) {
+    const std::string path = "../../resources/sample.nes";
+    nestake::Console console(std::make_shared<nestake::Cartridge>(path));
+    for (int i = 0; i < 100; ++i) {
+        console.Step();
+    }
+    nestake::ConsoleState saved;
+    std::memset(&saved, 0, sizeof(saved));
+    console.Save(saved);
+    for (int i = 0; i < 100; ++i) {
+        console.Step();
+    }
+    const uint16_t pc = console.Processor().PC;
+    const uint64_t cycles = console.Processor().Cycles;
+
+    nestake::ResetOptions options;
+    options.State = &saved;
+    console.Reset(options);
+    EXPECT_EQ(saved.PC, console.Processor().PC);
+    EXPECT_EQ(saved.Cycles, console.Processor().Cycles);
+    for (int i = 0; i < 100; ++i) {
+        console.Step();
+    }
+    EXPECT_EQ(pc, console.Processor().PC);
+    EXPECT_EQ(cycles, console.Processor().Cycles);
+}
+
+TEST(ConsoleTest, ResetToPowerOn) {
+    // LDA #$01 / STA $8000 / STA $0010 / JMP $8008
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    const uint8_t code[] = {0xA9, 0x01, 0x8D, 0x00, 0x80, 0x8D, 0x10, 0x00, 0x4C, 0x08, 0x80};
+    std::copy(code, code + sizeof(code), prg.begin());
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0x80;
+    std::vector<uint8_t> chr(0x4000);
+    for (size_t i = 0; i < chr.size(); ++i) {
+        chr[i] = uint8_t(i / 0x2000);
+    }
+    std::shared_ptr<nestake::Cartridge> cart(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr, nestake::CNROM::ID)));
+
+    nestake::BasicConsole<nestake::CNROM> fresh(cart);
+    nestake::BasicConsole<nestake::CNROM> console(cart);
+    for (int i = 0; i < 10; ++i) {
+        console.Step();
+    }
+    EXPECT_EQ(1, console.Bus.RAM[0x10]);
+    EXPECT_EQ(1, console.PPU.Memory().Read(0x0000));
+
+    console.Reset();
+    nestake::ConsoleState expected, actual;
+    std::memset(&expected, 0, sizeof(expected));
+    std::memset(&actual, 0, sizeof(actual));
+    fresh.Save(expected);
+    console.Save(actual);
+    EXPECT_EQ(0, std::memcmp(&expected, &actual, sizeof(expected)));
+    EXPECT_EQ(0, console.PPU.Memory().Read(0x0000));
+}
+
+TEST(ConsoleTest, Pool) {
+    nestake::ConsolePool pool(std::make_shared<nestake::Cartridge>("../../resources/sample.nes"), 1);
+    EXPECT_EQ(1u, pool.Available());
+
+    std::unique_ptr<nestake::Console> console = pool.Acquire();
+    EXPECT_EQ(0u, pool.Available());
+    const nestake::Console *first = console.get();
+    const uint16_t start = console->Processor().PC;
+    for (int i = 0; i < 50; ++i) {
+        console->Step();
+    }
+    pool.Release(std::move(console));
+    EXPECT_EQ(1u, pool.Available());
+
+    console = pool.Acquire();
+    EXPECT_EQ(first, console.get());
+    EXPECT_EQ(start, console->Processor().PC);
+    EXPECT_EQ(0u, console->Processor().Cycles);
+
+    // an empty pool builds a new console
+    std::unique_ptr<nestake::Console> other = pool.Acquire();
+    EXPECT_NE(first, other.get());
+}
+
+// LDA #$42 / STA $6010 / LDX $6010 / STX $0000 / JMP $800B
+static std::shared_ptr<nestake::Cartridge> batteryCartridge() {
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    const uint8_t code[] = {0xA9, 0x42, 0x8D, 0x10, 0x60, 0xAE, 0x10, 0x60, 0x8E, 0x00, 0x00, 0x4C, 0x0B, 0x80};
+    std::copy(code, code + sizeof(code), prg.begin());
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0x80;
+    return std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>(), 0, 0, true));
+}
+
+TEST(ConsoleTest, BatterySRAM) {
+    std::shared_ptr<nestake::Cartridge> cart = batteryCartridge();
+    nestake::Console console(cart);
+    nestake::SaveRAM &sram = *console.Processor().mem->SRAM;
+    EXPECT_FALSE(sram.IsFileBacked());
+    for (int i = 0; i < 5; ++i) {
+        console.Step();
+    }
+    EXPECT_EQ(0x42, sram.Read(0x0010));
+    EXPECT_EQ(0x42, console.Processor().mem->RAM[0]);
+    EXPECT_EQ(1u, sram.Dirty());
+
+    // the SRAM is part of a snapshot
+    std::unique_ptr<nestake::ConsoleState> state(new nestake::ConsoleState());
+    console.Save(*state);
+    EXPECT_EQ(0x42, state->SRAM[0x0010]);
+
+    // powering on clears in-memory SRAM, a snapshot brings it back
+    console.Reset();
+    EXPECT_EQ(0x00, sram.Read(0x0010));
+    nestake::ResetOptions options;
+    options.State = state.get();
+    console.Reset(options);
+    EXPECT_EQ(0x42, sram.Read(0x0010));
+
+    // with a save file the SRAM is flushed at episode boundaries and survives a power-on
+    std::remove("console_test.sav");
+    EXPECT_FALSE(console.MapSaveFile("console_test_missing_dir/console_test.sav"));
+    EXPECT_EQ(&sram, console.Processor().mem->SRAM.get());
+    ASSERT_TRUE(console.MapSaveFile("console_test.sav"));
+    console.Reset();
+    for (int i = 0; i < 5; ++i) {
+        console.Step();
+    }
+    console.Reset();
+    EXPECT_EQ(0u, console.Processor().mem->SRAM->Dirty());
+    EXPECT_EQ(0x42, console.Processor().mem->SRAM->Read(0x0010));
+    nestake::SaveRAM reopened("console_test.sav");
+    EXPECT_EQ(0x42, reopened.Read(0x0010));
+    std::remove("console_test.sav");
+}
+
+TEST(ConsoleTest, SRAMPerConsole) {
+    // two consoles on one cartridge keep their own SRAM
+    std::shared_ptr<nestake::Cartridge> cart = batteryCartridge();
+    nestake::Console a(cart);
+    nestake::BasicConsole<nestake::NROM> b(cart);
+    for (int i = 0; i < 5; ++i) {
+        a.Step();
+    }
+    EXPECT_EQ(0x42, a.Processor().mem->SRAM->Read(0x0010));
+    ASSERT_NE(nullptr, b.Bus.SRAM);
+    EXPECT_EQ(0x00, b.Bus.SRAM->Read(0x0010));
+    EXPECT_EQ(0x00, b.Bus.Read(0x6010));
+
+    b.Bus.Write(0x6020, 0x17);
+    EXPECT_EQ(0x00, a.Processor().mem->Read(0x6020));
+}
+
+TEST(ConsoleTest, PPUClock) {
+    // JMP $8000, NMI handler at $9000: INC $0020 / RTI
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    const uint8_t loop[] = {0x4C, 0x00, 0x80};
+    const uint8_t handler[] = {0xEE, 0x20, 0x00, 0x40};
+    std::copy(loop, loop + sizeof(loop), prg.begin());
+    std::copy(handler, handler + sizeof(handler), prg.begin() + 0x1000);
+    prg[0x3FFA] = 0x00;
+    prg[0x3FFB] = 0x90;
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0x80;
+    nestake::BasicConsole<nestake::NROM> console(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>())));
+
+    // the PPU runs 3 dots per cpu cycle
+    const uint64_t start = console.CPU.Cycles;
+    const uint64_t position = console.PPU.Frame*nestake::DotsPerFrame +
+                              console.PPU.ScanLine*nestake::DotsPerLine + console.PPU.Cycle;
+    for (int i = 0; i < 1000; ++i) {
+        console.Step();
+    }
+    EXPECT_EQ(position + 3*(console.CPU.Cycles - start), console.PPU.Frame*nestake::DotsPerFrame +
+                                                         console.PPU.ScanLine*nestake::DotsPerLine + console.PPU.Cycle);
+
+    // one NMI per frame once enabled
+    console.PPU.writeControl(0x80);
+    const uint64_t frame = console.PPU.Frame;
+    while (console.PPU.Frame < frame + 3) {
+        console.Step();
+    }
+    EXPECT_EQ(3, console.Bus.RAM[0x20]);
+}
+
+TEST(ConsoleTest, NMILatency) {
+    // 40 NOPs / JMP $8000 (one block of 81 cycles), NMI handler at $9000: INC $0020 / RTI
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    const uint8_t loop[] = {0x4C, 0x00, 0x80};
+    const uint8_t handler[] = {0xEE, 0x20, 0x00, 0x40};
+    std::copy(loop, loop + sizeof(loop), prg.begin() + 40);
+    std::copy(handler, handler + sizeof(handler), prg.begin() + 0x1000);
+    prg[0x3FFA] = 0x00;
+    prg[0x3FFB] = 0x90;
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0x80;
+    nestake::BasicConsole<nestake::NROM> console(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>())));
+    console.CPU.IsJITMode = true;
+    console.PPU.writeControl(0x80);
+
+    // vblank is seen after at most one instruction, as in the interpreter, although the
+    // compiled loop is longer than the time left to vblank
+    const uint64_t frame = console.PPU.Frame;
+    while (console.PPU.Frame < frame + 5) {
+        bool vblank = console.PPU.nmiOccurred;
+        console.Step();
+        if (!vblank && console.PPU.nmiOccurred) {
+            uint64_t position = console.PPU.ScanLine*nestake::DotsPerLine + console.PPU.Cycle;
+            EXPECT_LT(position - (241*nestake::DotsPerLine + 1), 3*7);
+        }
+    }
+    EXPECT_EQ(5, console.Bus.RAM[0x20]);
+}
+
+TEST(ConsoleTest, IdleLoopNMILatency) {
+    // JMP $8000 (fused into three iterations), NMI handler at $9000: INC $0020 / RTI
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    const uint8_t loop[] = {0x4C, 0x00, 0x80};
+    const uint8_t handler[] = {0xEE, 0x20, 0x00, 0x40};
+    std::copy(loop, loop + sizeof(loop), prg.begin());
+    std::copy(handler, handler + sizeof(handler), prg.begin() + 0x1000);
+    prg[0x3FFA] = 0x00;
+    prg[0x3FFB] = 0x90;
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0x80;
+    nestake::BasicConsole<nestake::NROM> console(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>())));
+    ASSERT_TRUE(console.CPU.IsFusionMode);
+    console.PPU.writeControl(0x80);
+
+    // the fused iterations stop before vblank, which is then seen after a single JMP
+    const uint64_t frame = console.PPU.Frame;
+    while (console.PPU.Frame < frame + 5) {
+        bool vblank = console.PPU.nmiOccurred;
+        console.Step();
+        if (!vblank && console.PPU.nmiOccurred) {
+            uint64_t position = console.PPU.ScanLine*nestake::DotsPerLine + console.PPU.Cycle;
+            EXPECT_LT(position - (241*nestake::DotsPerLine + 1), 3*3);
+        }
+    }
+    EXPECT_EQ(5, console.Bus.RAM[0x20]);
+}
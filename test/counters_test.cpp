@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include "counters.cpp"
+
+#include <thread>
+#include <vector>
+
+#include "console.hpp"
+
+namespace {
+    std::shared_ptr<nestake::Console> newConsole(bool jit) {
+        const std::string path = "../../resources/sample.nes";
+        std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+        std::shared_ptr<nestake::Cpu> cpu(std::make_shared<nestake::Cpu>(mem));
+        cpu->IsJITMode = jit;
+        std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+        return std::make_shared<nestake::Console>(cpu, cart);
+    }
+}
+
+TEST(CountersTest, Snapshot) {
+    nestake::CounterSnapshot a = {};
+    a.Cycles = 10;
+    a.SchedulerEvents = 3;
+    nestake::CounterSnapshot b = a;
+    b += a;
+    EXPECT_EQ(20, b.Cycles);
+    EXPECT_EQ(6, b.SchedulerEvents);
+    EXPECT_EQ(10, (b - a).Cycles);
+}
+
+TEST(CountersTest, Console) {
+    // fused pairs and compiled blocks count all of their instructions
+    for (int jit = 0; jit < 2; ++jit) {
+        std::shared_ptr<nestake::Console> console = newConsole(jit == 1);
+        std::shared_ptr<nestake::Console> reference = newConsole(false);
+        reference->Processor().IsFusionMode = false;
+        for (int i = 0; i < 300; ++i) {
+            console->Step();
+        }
+        nestake::CounterSnapshot s = console->Counters();
+        EXPECT_EQ(300, s.SchedulerEvents);
+        EXPECT_LE(300, s.Instructions);
+        EXPECT_LT(0, s.Cycles);
+        EXPECT_LT(0, s.CPUNanoseconds);
+        EXPECT_EQ(0, s.DMAStallCycles);
+
+        // a reference stepping one instruction at a time agrees once it catches up
+        while (reference->Counters().Cycles < s.Cycles) {
+            reference->Step();
+        }
+        EXPECT_EQ(s.Cycles, reference->Counters().Cycles);
+        EXPECT_EQ(s.Instructions, reference->Counters().Instructions);
+    }
+}
+
+TEST(CountersTest, Aggregate) {
+    nestake::GlobalCounters().Clear();
+
+    const int threads = 4;
+    const int steps = 200;
+    std::vector<uint64_t> cycles(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([t, &cycles]() {
+            std::shared_ptr<nestake::Console> console = newConsole(false);
+            for (int i = 0; i < steps; ++i) {
+                console->Step();
+                if (i % 50 == 0) {
+                    console->PublishCounters();
+                }
+            }
+            cycles[t] = console->Counters().Cycles;
+            // the rest is published when the console goes away
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+
+    nestake::CounterSnapshot total = nestake::GlobalCounters().Snapshot();
+    EXPECT_EQ(uint64_t(threads * steps), total.SchedulerEvents);
+    EXPECT_EQ(cycles[0] * threads, total.Cycles);
+}
+
+TEST(CountersTest, Reset) {
+    nestake::GlobalCounters().Clear();
+    std::shared_ptr<nestake::Console> console = newConsole(false);
+    for (int i = 0; i < 300; ++i) {
+        console->Step();
+    }
+    console->PublishCounters();
+    const uint64_t cycles = nestake::GlobalCounters().Snapshot().Cycles;
+    const uint64_t instructions = console->Counters().Instructions;
+
+    // Reset rewinds the cpu, not the work it did
+    console->Reset();
+    EXPECT_EQ(cycles, console->Counters().Cycles);
+    for (int i = 0; i < 10; ++i) {
+        console->Step();
+    }
+    console->PublishCounters();
+    nestake::CounterSnapshot total = nestake::GlobalCounters().Snapshot();
+    EXPECT_LT(cycles, total.Cycles);
+    EXPECT_EQ(cycles + console->Processor().Cycles, total.Cycles);
+    EXPECT_EQ(instructions + 10, console->Counters().Instructions);
+    EXPECT_EQ(310u, total.SchedulerEvents);
+}
+
+TEST(CountersTest, Frames) {
+    // the PPU of a BasicConsole counts frames and is timed apart from the cpu
+    nestake::Console console(std::make_shared<nestake::Cartridge>("../../resources/sample.nes"));
+    nestake::PPU &ppu = *console.Processor().mem->PPU;
+    const uint64_t frame = ppu.Frame;
+    while (ppu.Frame < frame + 2) {
+        console.Step();
+    }
+    nestake::CounterSnapshot s = console.Counters();
+    EXPECT_EQ(2, s.Frames);
+    EXPECT_LT(0, s.CPUNanoseconds);
+    EXPECT_LT(0, s.PPUNanoseconds);
+    EXPECT_EQ(0, s.APUNanoseconds);
+    EXPECT_EQ(0, s.MapperNanoseconds);
+
+    // Reset rewinds PPU::Frame, not the frames counted
+    console.Reset();
+    EXPECT_EQ(2, console.Counters().Frames);
+    while (ppu.Frame < 1) {
+        console.Step();
+    }
+    EXPECT_EQ(3, console.Counters().Frames);
+}
@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "cpu.cpp"
+#include "ppu.hpp"
 
 #include <iostream>
 
@@ -28,14 +29,14 @@ TEST(CPUTest, compare) {
     std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
     nestake::Cpu cpu = nestake::Cpu(mem);
     cpu.compare(0x0000, 0x0000);
-    EXPECT_EQ(1, cpu.C);
-    EXPECT_EQ(1, cpu.Z);
-    EXPECT_EQ(0, cpu.N);
+    EXPECT_EQ(1, cpu.flagC());
+    EXPECT_EQ(1, cpu.flagZ());
+    EXPECT_EQ(0, cpu.flagN());
 
     cpu.compare(0x0000, 0x0001);
-    EXPECT_EQ(0, cpu.C);
-    EXPECT_EQ(0, cpu.Z);
-    EXPECT_EQ(1, cpu.N);
+    EXPECT_EQ(0, cpu.flagC());
+    EXPECT_EQ(0, cpu.flagZ());
+    EXPECT_EQ(1, cpu.flagN());
 
 }
 
@@ -100,14 +101,14 @@ TEST(CPUTest, PULL16) {
 TEST(CPUTest, GetFlag) {
     std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
     nestake::Cpu cpu = nestake::Cpu(mem);
-    cpu.C = 1;
-    cpu.Z = 0;
-    cpu.I = 0;
-    cpu.D = 1;
-    cpu.B = 0;
-    cpu.U = 0;
-    cpu.V = 0;
-    cpu.N = 1;
+    cpu.setFlagC(1);
+    cpu.setFlagZ(0);
+    cpu.setFlagI(0);
+    cpu.setFlagD(1);
+    cpu.setFlagB(0);
+    cpu.setFlagU(0);
+    cpu.setFlagV(0);
+    cpu.setFlagN(1);
     uint8_t actual = cpu.getFlag();
     EXPECT_EQ(0b10001001, actual);
 }
@@ -117,14 +118,14 @@ TEST(CPUTest, SetFlags) {
     std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
     nestake::Cpu cpu = nestake::Cpu(mem);
     cpu.setFlags(0b10001001);
-    EXPECT_EQ(1, cpu.C);
-    EXPECT_EQ(0, cpu.Z);
-    EXPECT_EQ(0, cpu.I);
-    EXPECT_EQ(1, cpu.D);
-    EXPECT_EQ(0, cpu.B);
-    EXPECT_EQ(0, cpu.U);
-    EXPECT_EQ(0, cpu.V);
-    EXPECT_EQ(1, cpu.N);
+    EXPECT_EQ(1, cpu.flagC());
+    EXPECT_EQ(0, cpu.flagZ());
+    EXPECT_EQ(0, cpu.flagI());
+    EXPECT_EQ(1, cpu.flagD());
+    EXPECT_EQ(0, cpu.flagB());
+    EXPECT_EQ(0, cpu.flagU());
+    EXPECT_EQ(0, cpu.flagV());
+    EXPECT_EQ(1, cpu.flagN());
 }
 
 TEST(CPUTest, ADC) {
@@ -133,43 +134,43 @@ TEST(CPUTest, ADC) {
 
     // Neither overflow nor carry case
     cpu.A = 0;
-    cpu.C = 0;
+    cpu.setFlagC(0);
     mem->RAM[0x0000] = 1;
     cpu.ExecADC(0x0000, false);
 
     EXPECT_EQ(1, cpu.A);
-    EXPECT_EQ(0, cpu.Z);
-    EXPECT_EQ(1, cpu.N);
+    EXPECT_EQ(0, cpu.flagZ());
+    EXPECT_EQ(1, cpu.flagN());
 
     // NOT overflow BUT carry
     cpu.A = 1;
-    cpu.C = 0;
+    cpu.setFlagC(0);
     mem->RAM[0x0000] = 0xFF;
     cpu.ExecADC(0x0000, false);
 
     EXPECT_EQ(0x00, cpu.A);
-    EXPECT_EQ(1, cpu.C);
-    EXPECT_EQ(0, cpu.V);
+    EXPECT_EQ(1, cpu.flagC());
+    EXPECT_EQ(0, cpu.flagV());
 
     // NOT carry BUT overflow
     cpu.A = 0b01000000;
-    cpu.C = 0;
+    cpu.setFlagC(0);
     mem->RAM[0x0000] = 0b01000000;
     cpu.ExecADC(0x0000, false);
 
     EXPECT_EQ(0b10000000, cpu.A);
-    EXPECT_EQ(0, cpu.C);
-    EXPECT_EQ(1, cpu.V);
+    EXPECT_EQ(0, cpu.flagC());
+    EXPECT_EQ(1, cpu.flagV());
 
     // overflow AND carry
     cpu.A = 0b10000000;
-    cpu.C = 0;
+    cpu.setFlagC(0);
     mem->RAM[0x0000] = 0b10000000;
     cpu.ExecADC(0x0000, false);
 
     EXPECT_EQ(0, cpu.A);
-    EXPECT_EQ(1, cpu.C);
-    EXPECT_EQ(1, cpu.V);
+    EXPECT_EQ(1, cpu.flagC());
+    EXPECT_EQ(1, cpu.flagV());
 }
 
 TEST(CPUTest, AND) {
@@ -180,8 +181,8 @@ TEST(CPUTest, AND) {
 
     cpu.ExecAND(0x0000, false);
     EXPECT_EQ(0b10000000, cpu.A);
-    EXPECT_EQ(0, cpu.Z);
-    EXPECT_EQ(1, cpu.N);
+    EXPECT_EQ(0, cpu.flagZ());
+    EXPECT_EQ(1, cpu.flagN());
 }
 
 TEST(CPUTest, ASL) {
@@ -190,24 +191,24 @@ TEST(CPUTest, ASL) {
 
     // accumulator mode
     cpu.A = 0b10000001;
-    cpu.C = 0b00000000;
+    cpu.setFlagC(0b00000000);
 
     cpu.ExecASL(0, true);
     EXPECT_EQ(0b00000010, cpu.A);
-    EXPECT_EQ(1, cpu.C);
+    EXPECT_EQ(1, cpu.flagC());
 
     // non accumulator mode
     mem->RAM[0] = 0b10000001;
 
     cpu.ExecASL(0, false);
     EXPECT_EQ(0b00000010, mem->RAM[0]);
-    EXPECT_EQ(1, cpu.C);
+    EXPECT_EQ(1, cpu.flagC());
 }
 
 TEST(CPUTest, BCC) {
     std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
     nestake::Cpu cpu = nestake::Cpu(mem);
-    cpu.C = 0;
+    cpu.setFlagC(0);
     cpu.Cycles = 0;
 
     // page crossing
@@ -227,9 +228,9 @@ TEST(CPUTest, BIT) {
     cpu.A = 0b00000001;
     mem->RAM[0] = 0b11000000;
     cpu.ExecBIT(0, false);
-    EXPECT_EQ(1, cpu.Z);
-    EXPECT_EQ(1, cpu.N);
-    EXPECT_EQ(1, cpu.V);
+    EXPECT_EQ(1, cpu.flagZ());
+    EXPECT_EQ(1, cpu.flagN());
+    EXPECT_EQ(1, cpu.flagV());
 }
 
 TEST(CPUTest, CMP) {
@@ -238,9 +239,9 @@ TEST(CPUTest, CMP) {
     cpu.A = 1;
     mem->RAM[0] = 0;
     cpu.ExecCMP(0, false);
-    EXPECT_EQ(1, cpu.C);
-    EXPECT_EQ(0, cpu.Z);
-    EXPECT_EQ(1, cpu.N);
+    EXPECT_EQ(1, cpu.flagC());
+    EXPECT_EQ(0, cpu.flagZ());
+    EXPECT_EQ(1, cpu.flagN());
 
 }
 
@@ -251,8 +252,8 @@ TEST(CPUTest, DEC) {
 
     cpu.ExecDEC(0, false);
     EXPECT_EQ(0, mem->RAM[0]);
-    EXPECT_EQ(1, cpu.Z);
-    EXPECT_EQ(0, cpu.N);
+    EXPECT_EQ(1, cpu.flagZ());
+    EXPECT_EQ(0, cpu.flagN());
 }
 
 TEST(CPUTest, DEX) {
@@ -262,8 +263,8 @@ TEST(CPUTest, DEX) {
 
     cpu.ExecDEX(0, false);
     EXPECT_EQ(99, cpu.X);
-    EXPECT_EQ(1, cpu.N);
-    EXPECT_EQ(0, cpu.Z);
+    EXPECT_EQ(1, cpu.flagN());
+    EXPECT_EQ(0, cpu.flagZ());
 }
 
 TEST(CPUTest, EOR) {
@@ -274,8 +275,8 @@ TEST(CPUTest, EOR) {
 
     cpu.ExecEOR(0, false);
     EXPECT_EQ(0b00001001, cpu.A);
-    EXPECT_EQ(1, cpu.N);
-    EXPECT_EQ(0, cpu.Z);
+    EXPECT_EQ(1, cpu.flagN());
+    EXPECT_EQ(0, cpu.flagZ());
 }
 
 TEST(CPUTest, INC) {
@@ -285,8 +286,8 @@ TEST(CPUTest, INC) {
 
     cpu.ExecINC(0, false);
     EXPECT_EQ(2, mem->RAM[0]);
-    EXPECT_EQ(0, cpu.Z);
-    EXPECT_EQ(1, cpu.N);
+    EXPECT_EQ(0, cpu.flagZ());
+    EXPECT_EQ(1, cpu.flagN());
 }
 
 TEST(CPUTest, JSR) {
@@ -313,13 +314,13 @@ TEST(CPUTest, LSR) {
     //  accumulator mode
     cpu.A = 0b00000011;
     cpu.ExecLSR(0, true);
-    EXPECT_EQ(1, cpu.C);
+    EXPECT_EQ(1, cpu.flagC());
     EXPECT_EQ(0b00000001, cpu.A);
 
     //  non accumulator mode
     mem->RAM[0] = 0b00000011;
     cpu.ExecLSR(0, false);
-    EXPECT_EQ(1, cpu.C);
+    EXPECT_EQ(1, cpu.flagC());
     EXPECT_EQ(0b00000001, mem->RAM[0]);
 }
 
@@ -337,14 +338,14 @@ TEST(CPUTest, ORA) {
 TEST(CPUTest, PHP) {
     std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
     nestake::Cpu cpu = nestake::Cpu(mem);
-    cpu.C = 1;
-    cpu.Z = 0;
-    cpu.I = 0;
-    cpu.D = 1;
-    cpu.B = 0;
-    cpu.U = 0;
-    cpu.V = 0;
-    cpu.N = 1;
+    cpu.setFlagC(1);
+    cpu.setFlagZ(0);
+    cpu.setFlagI(0);
+    cpu.setFlagD(1);
+    cpu.setFlagB(0);
+    cpu.setFlagU(0);
+    cpu.setFlagV(0);
+    cpu.setFlagN(1);
     EXPECT_EQ(0b10001001, cpu.getFlag());
 
     cpu.SP = 100;
@@ -369,13 +370,13 @@ TEST(CPUTest, ROL) {
 
     // accumulator mode
     cpu.A = 0b01111110;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     cpu.ExecROL(0, true);
     EXPECT_EQ(0b11111101, cpu.A);
 
     // non accumulator mode
     mem->RAM[0] = 0b01111110;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     cpu.ExecROL(0, false);
     EXPECT_EQ(0b11111101, mem->RAM[0]);
 }
@@ -386,13 +387,13 @@ TEST(CPUTest, ROR) {
 
     // accumulator mode
     cpu.A = 0b01111110;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     cpu.ExecROR(0, true);
     EXPECT_EQ(0b10111111, cpu.A);
 
     // non accumulator mode
     mem->RAM[0] = 0b01111110;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     cpu.ExecROR(0, false);
     EXPECT_EQ(0b10111111, mem->RAM[0]);
 }
@@ -425,41 +426,223 @@ TEST(CPUTest, SBC) {
 
     // Neither overflow nor carry case
     cpu.A = 1;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     mem->RAM[0x0000] = 1;
     cpu.ExecSBC(0x0000, false);
 
     EXPECT_EQ(0, cpu.A);
-    EXPECT_EQ(1, cpu.C);
-    EXPECT_EQ(0, cpu.V);
+    EXPECT_EQ(1, cpu.flagC());
+    EXPECT_EQ(0, cpu.flagV());
 
     // NOT overflow BUT carry
     cpu.A = 1;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     mem->RAM[0x0000] = 2;
     cpu.ExecSBC(0x0000, false);
 
     EXPECT_EQ(0xFF, cpu.A);
-    EXPECT_EQ(0, cpu.C);
-    EXPECT_EQ(0, cpu.V);
+    EXPECT_EQ(0, cpu.flagC());
+    EXPECT_EQ(0, cpu.flagV());
 
     // NOT carry BUT overflow
     cpu.A = 0b10000000;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     mem->RAM[0x0000] = 1;
     cpu.ExecSBC(0x0000, false);
 
     EXPECT_EQ(0b01111111, cpu.A);
-    EXPECT_EQ(1, cpu.C);
-    EXPECT_EQ(1, cpu.V);
+    EXPECT_EQ(1, cpu.flagC());
+    EXPECT_EQ(1, cpu.flagV());
 
     // overflow AND carry
     cpu.A = 0b10000000;
-    cpu.C = 1;
+    cpu.setFlagC(1);
     mem->RAM[0x0000] = 0b10000001;
     cpu.ExecSBC(0x0000, false);
 
     EXPECT_EQ(0xFF, cpu.A);
-    EXPECT_EQ(0, cpu.C);
-    EXPECT_EQ(0, cpu.V);
-}
\ No newline at end of file
+    EXPECT_EQ(0, cpu.flagC());
+    EXPECT_EQ(0, cpu.flagV());
+}
+TEST(CPUTest, LoadCartridge) {
+    const std::string path = "../../resources/sample.nes";
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+
+    // reset vector of sample.nes
+    EXPECT_EQ(0x8000, cpu.PC);
+    ASSERT_TRUE(cart->Blocks != nullptr);
+    EXPECT_EQ(cart->PRG.size(), cart->Blocks->Instructions.size());
+
+    // 0x8000: SEI / LDX #$FF / TXS
+    const nestake::DecodedInstruction &sei = cart->Blocks->At(0);
+    EXPECT_EQ(0x78, sei.Opcode);
+    EXPECT_EQ(1, sei.InstructionSizes);
+    const nestake::DecodedInstruction &ldx = cart->Blocks->At(1);
+    EXPECT_EQ(0xA2, ldx.Opcode);
+    EXPECT_EQ(0xFF, ldx.Operand);
+    EXPECT_EQ(sei.BlockLength, ldx.BlockLength + 1);
+    EXPECT_EQ(sei.BlockCycles, ldx.BlockCycles + sei.InstructionCycle);
+
+    // the decoded PRG-ROM is shared by the second cpu
+    std::shared_ptr<nestake::CPUMemory> mem2(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu2 = nestake::Cpu(mem2);
+    std::shared_ptr<nestake::BlockCache> blocks = cart->Blocks;
+    cpu2.LoadCartridge(cart);
+    EXPECT_EQ(blocks, cart->Blocks);
+
+    cpu.Step();
+    cpu.Step();
+    EXPECT_EQ(1, cpu.flagI());
+    EXPECT_EQ(0xFF, cpu.X);
+    EXPECT_EQ(0x8003, cpu.PC);
+    EXPECT_EQ(4, cpu.Cycles);
+}
+
+TEST(CPUTest, StepFromRAM) {
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+
+    // LDA #$05 / STA $10 / INC $10
+    const uint8_t code[] = {0xA9, 0x05, 0x85, 0x10, 0xE6, 0x10};
+    for (size_t i = 0; i < sizeof(code); ++i) {
+        mem->RAM[0x200 + i] = code[i];
+    }
+    cpu.PC = 0x200;
+    EXPECT_EQ(2, cpu.Step());
+    EXPECT_EQ(3, cpu.Step());
+    EXPECT_EQ(5, cpu.Step());
+    EXPECT_EQ(0x206, cpu.PC);
+    EXPECT_EQ(6, mem->RAM[0x10]);
+}
+
+TEST(CPUTest, LazyFlags) {
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+
+    cpu.setZN(0);
+    EXPECT_EQ(1, cpu.flagZ());
+    EXPECT_EQ(0, cpu.flagN());
+
+    // BIT sets Z and N independently
+    cpu.A = 0;
+    mem->RAM[0] = 0b10000000;
+    cpu.ExecBIT(0, false);
+    EXPECT_EQ(1, cpu.flagZ());
+    EXPECT_EQ(1, cpu.flagN());
+    EXPECT_EQ(0b10000010, cpu.getFlag() & 0b10000010);
+
+    cpu.setFlags(0b00000000);
+    EXPECT_EQ(0, cpu.flagZ());
+    EXPECT_EQ(0, cpu.flagN());
+}
+
+TEST(CPUTest, CycleAccurate) {
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.IsCycleAccurate = true;
+
+    // LDA #$05 / STA $10 / INC $10 / LDX #$01 / LDA $0F,X / TAY
+    const uint8_t code[] = {0xA9, 0x05, 0x85, 0x10, 0xE6, 0x10, 0xA2, 0x01, 0xB5, 0x0F, 0xA8};
+    for (size_t i = 0; i < sizeof(code); ++i) {
+        mem->RAM[0x200 + i] = code[i];
+    }
+    cpu.PC = 0x200;
+    EXPECT_EQ(2, cpu.Step());
+    EXPECT_EQ(3, cpu.Step());
+    EXPECT_EQ(5, cpu.Step());
+    EXPECT_EQ(2, cpu.Step());
+    EXPECT_EQ(4, cpu.Step());
+    EXPECT_EQ(2, cpu.Step());
+    EXPECT_EQ(6, mem->RAM[0x10]);
+    EXPECT_EQ(6, cpu.Y);
+    EXPECT_EQ(0x20B, cpu.PC);
+
+    // both policies agree on sample.nes
+    const std::string path = "../../resources/sample.nes";
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+    std::shared_ptr<nestake::CPUMemory> fastMem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu fast = nestake::Cpu(fastMem);
+    fast.IsFusionMode = false;
+    fast.LoadCartridge(cart);
+    std::shared_ptr<nestake::CPUMemory> accurateMem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu accurate = nestake::Cpu(accurateMem);
+    accurate.IsCycleAccurate = true;
+    accurate.LoadCartridge(cart);
+    for (int i = 0; i < 500; ++i) {
+        ASSERT_EQ(fast.Step(), accurate.Step());
+        ASSERT_EQ(fast.PC, accurate.PC);
+    }
+    EXPECT_EQ(fast.A, accurate.A);
+    EXPECT_EQ(fast.X, accurate.X);
+    EXPECT_EQ(fast.Y, accurate.Y);
+    EXPECT_EQ(fast.SP, accurate.SP);
+    EXPECT_EQ(fast.getFlag(), accurate.getFlag());
+    EXPECT_EQ(fast.Cycles, accurate.Cycles);
+}
+
+TEST(CPUTest, OAMDMA) {
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    mem->PPU = std::make_shared<nestake::PPU>();
+    for (int i = 0; i < 256; ++i) {
+        mem->RAM[0x300 + i] = uint8_t(i);
+    }
+
+    // LDA #$03 / STA $4014 / NOP / STA $4014
+    const uint8_t code[] = {0xA9, 0x03, 0x8D, 0x14, 0x40, 0xEA, 0x8D, 0x14, 0x40};
+    for (size_t i = 0; i < sizeof(code); ++i) {
+        mem->RAM[0x200 + i] = code[i];
+    }
+    cpu.PC = 0x200;
+    cpu.Cycles = 0;
+    mem->PPU->oamAddress = 0x10;
+    cpu.Step();
+    cpu.Step();
+
+    // copied from OAMADDR on, wrapping around
+    EXPECT_EQ(0x00, mem->PPU->oamData[0x10]);
+    EXPECT_EQ(0xEF, mem->PPU->oamData[0xFF]);
+    EXPECT_EQ(0xF0, mem->PPU->oamData[0x00]);
+    EXPECT_EQ(0x10, mem->PPU->oamAddress);
+
+    // the write ended on an even cycle (6)
+    EXPECT_EQ(513, cpu.Stall);
+    while (cpu.Stall > 0) {
+        cpu.Step();
+    }
+    EXPECT_EQ(0x205, cpu.PC);
+
+    // one cycle later, the second write ends on an odd cycle (13)
+    cpu.Cycles += 1;
+    cpu.Step();
+    cpu.Step();
+    EXPECT_EQ(514, cpu.Stall);
+}
+
+TEST(CPUTest, OAMDMAFromPRG) {
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    for (int i = 0; i < 256; ++i) {
+        prg[0x0100 + i] = uint8_t(255 - i);
+    }
+    std::shared_ptr<nestake::Cartridge> cart(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>())));
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+    mem->PPU = std::make_shared<nestake::PPU>();
+
+    // $C100 mirrors PRG offset $0100 of a 16KB cartridge
+    mem->Write(0x4014, 0xC1);
+    EXPECT_EQ(0xFF, mem->PPU->oamData[0]);
+    EXPECT_EQ(0x00, mem->PPU->oamData[255]);
+
+    // no PPU: ignored
+    mem->PPU.reset();
+    cpu.Stall = 0;
+    mem->Write(0x4014, 0xC1);
+    EXPECT_EQ(0, cpu.Stall);
+}
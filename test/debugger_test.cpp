@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "debugger.cpp"
+
+#include "console.hpp"
+
+namespace {
+    // LDA #$03 / STA $0010 / LDX $0010 / STA $0011 / JMP $800B
+    std::shared_ptr<nestake::Cartridge> program() {
+        std::vector<uint8_t> prg(0x4000, 0xEA);
+        const uint8_t code[] = {0xA9, 0x03, 0x8D, 0x10, 0x00, 0xAE, 0x10, 0x00, 0x8D, 0x11, 0x00, 0x4C, 0x0B, 0x80};
+        std::copy(code, code + sizeof(code), prg.begin());
+        prg[0x3FFC] = 0x00;
+        prg[0x3FFD] = 0x80;
+        return std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>()));
+    }
+
+    // steps until the debugger stops; number of steps or -1
+    int runUntilStopped(nestake::BasicConsole<nestake::NROM> &console, const nestake::Debugger &debugger) {
+        for (int i = 0; i < 20; ++i) {
+            console.Step();
+            if (debugger.Stopped()) {
+                return i + 1;
+            }
+        }
+        return -1;
+    }
+
+    bool equals3(void *, const nestake::DebugEvent &event) {
+        return event.Value == 3;
+    }
+}
+
+TEST(DebuggerTest, Traps) {
+    nestake::Debugger debugger;
+    EXPECT_EQ(0, debugger.Traps()[0x80]);
+    debugger.AddBreakpoint(0x8005);
+    debugger.AddWatchpoint(0x00F0, 0x01FF, nestake::TrapWrite);
+    EXPECT_EQ(nestake::TrapExecute, debugger.Traps()[0x80]);
+    EXPECT_EQ(nestake::TrapWrite, debugger.Traps()[0x00]);
+    EXPECT_EQ(nestake::TrapWrite, debugger.Traps()[0x01]);
+    EXPECT_EQ(0, debugger.Traps()[0x02]);
+    debugger.Clear();
+    EXPECT_EQ(0, debugger.Traps()[0x00]);
+}
+
+TEST(DebuggerTest, Breakpoint) {
+    nestake::BasicConsole<nestake::NROM> console(program());
+    std::shared_ptr<nestake::Debugger> debugger(std::make_shared<nestake::Debugger>());
+    debugger->AddBreakpoint(0x8005);
+    console.Bus.Attach(debugger);
+
+    EXPECT_EQ(3, runUntilStopped(console, *debugger));
+    EXPECT_EQ(nestake::TrapExecute, debugger->Event().Kind);
+    EXPECT_EQ(0x8005, debugger->Event().Address);
+    // stopped before LDX
+    EXPECT_EQ(0x8005, console.CPU.PC);
+    EXPECT_EQ(0, console.CPU.X);
+
+    debugger->Resume();
+    EXPECT_LT(0u, console.Step());
+    EXPECT_EQ(3, console.CPU.X);
+    EXPECT_FALSE(debugger->Stopped());
+}
+
+TEST(DebuggerTest, Watchpoint) {
+    nestake::BasicConsole<nestake::NROM> console(program());
+    std::shared_ptr<nestake::Debugger> debugger(std::make_shared<nestake::Debugger>());
+    debugger->AddWatchpoint(0x0011, 0x0011, nestake::TrapWrite);
+    console.Bus.Attach(debugger);
+
+    // STA $0010 is in the trapped page but not watched
+    EXPECT_EQ(4, runUntilStopped(console, *debugger));
+    EXPECT_EQ(nestake::TrapWrite, debugger->Event().Kind);
+    EXPECT_EQ(0x0011, debugger->Event().Address);
+    EXPECT_EQ(3, debugger->Event().Value);
+    EXPECT_EQ(console.CPU.Cycles, debugger->Event().Cycles);
+    EXPECT_EQ(3, console.Bus.RAM[0x11]);
+}
+
+TEST(DebuggerTest, Condition) {
+    nestake::BasicConsole<nestake::NROM> console(program());
+    std::shared_ptr<nestake::Debugger> debugger(std::make_shared<nestake::Debugger>());
+    debugger->AddWatchpoint(0x0010, 0x0010, nestake::TrapRead, equals3);
+    console.Bus.Attach(debugger);
+    EXPECT_EQ(3, runUntilStopped(console, *debugger));
+    EXPECT_EQ(nestake::TrapRead, debugger->Event().Kind);
+
+    // detached consoles don't stop
+    nestake::BasicConsole<nestake::NROM> other(program());
+    other.Bus.Attach(debugger);
+    other.Bus.Attach(nullptr);
+    debugger->Resume();
+    EXPECT_EQ(-1, runUntilStopped(other, *debugger));
+}
@@ -0,0 +1,246 @@
+#ifndef NESTAKE_TEST_DIFFERENTIAL
+#define NESTAKE_TEST_DIFFERENTIAL
+
+// differential testing of the cpu engines: random programs and states are run by the plain
+// decode-and-ExecXXX interpreter (the oracle) and by an optimized engine, and their registers,
+// flags, cycles and RAM are compared whenever both reach the same cycle.
+// shared by the seeded gtest (differential_test.cpp) and the libFuzzer target (fuzz/cpu_fuzzer.cpp).
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cpu.hpp"
+#include "ines.hpp"
+#include "memory.hpp"
+#include "ppu.hpp"
+
+namespace differential {
+    // where the generated program is placed (16KB NROM, mirrored at $8000)
+    const uint16_t origin = 0xC000;
+
+    // engine under test, configured on a fresh cpu before the cartridge is loaded
+    typedef std::function<void(nestake::Cpu &)> Engine;
+
+    // deterministic byte source: a seeded xorshift, or the fuzzer input followed by zeros
+    class Source {
+    private:
+        uint64_t state;
+        const uint8_t *data;
+        size_t size;
+        size_t pos;
+    public:
+        explicit Source(uint64_t seed): state(seed * 0x9E3779B97F4A7C15ULL + 1), data(nullptr), size(0), pos(0) {}
+        Source(const uint8_t *data, size_t size): state(0), data(data), size(size), pos(0) {}
+
+        uint8_t Byte() {
+            if (data != nullptr) {
+                return pos < size ? data[pos++] : uint8_t(0);
+            }
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return uint8_t(state >> 24);
+        }
+
+        uint16_t Word() {
+            uint16_t lo = Byte();
+            return uint16_t(lo | (Byte() << 8));
+        }
+    };
+
+    // random operand biased towards RAM, with some PRG-ROM and I/O addresses
+    inline uint16_t randomAddress(Source &src, uint16_t programSize) {
+        uint8_t kind = src.Byte() % 10;
+        if (kind < 7) {
+            return src.Word() % 0x0800;
+        } else if (kind < 9) {
+            return uint16_t(origin + src.Word() % programSize);
+        }
+        return uint16_t(0x2000 + src.Word() % 0x2020);
+    }
+
+    // emit the instruction at prg[pc], returns its size
+    inline uint8_t put(nestake::Cpu &cpu, std::vector<uint8_t> &prg, size_t pc, uint8_t op, uint16_t operand) {
+        prg[pc] = op;
+        prg[pc + 1] = uint8_t(operand & 0xFF);
+        prg[pc + 2] = uint8_t(operand >> 8);
+        return cpu.Decode(op, 0).InstructionSizes;
+    }
+
+    // random operand of the instruction
+    inline uint16_t randomOperand(Source &src, const nestake::DecodedInstruction &d, uint16_t programSize) {
+        if (d.ID == nestake::JMP || d.ID == nestake::JSR) {
+            return d.AddressingMode == nestake::Indirect ? uint16_t(src.Word() % 0x07FF)
+                                                         : uint16_t(origin + src.Word() % programSize);
+        } else if (d.AddressingMode == nestake::Absolute || d.AddressingMode == nestake::AbsoluteX ||
+                   d.AddressingMode == nestake::AbsoluteY) {
+            return randomAddress(src, programSize);
+        }
+        return src.Byte();
+    }
+
+    // PRG-ROM of random supported instructions whose jumps stay inside the program.
+    // a third of it are idioms the optimized engines specialize: counted loops
+    // (hot blocks, DEX/BNE-like pairs), the other fused pairs and OAM DMA (a bus write
+    // whose stall depends on the cycle it happens on).
+    inline std::vector<uint8_t> generateProgram(Source &src, nestake::Cpu &cpu, uint16_t programSize) {
+        std::vector<uint8_t> supported, straight;
+        for (int op = 0; op < 0x100; ++op) {
+            nestake::DecodedInstruction d = cpu.Decode(uint8_t(op), 0);
+            // BRK and RTI read vectors and the stack, which only makes the programs end sooner
+            if (d.Executor == nullptr || d.ID == nestake::BRK || d.ID == nestake::RTI) {
+                continue;
+            }
+            supported.push_back(uint8_t(op));
+            if (d.AddressingMode != nestake::Relative && d.ID != nestake::JMP && d.ID != nestake::JSR &&
+                d.ID != nestake::RTS && d.ID != nestake::TXS && d.ID != nestake::PHA && d.ID != nestake::PHP &&
+                d.ID != nestake::PLA && d.ID != nestake::PLP) {
+                straight.push_back(uint8_t(op));
+            }
+        }
+
+        // counter update and loop branch: DEX/DEY/INX/INY then BNE
+        const uint8_t counters[] = {0xCA, 0x88, 0xE8, 0xC8};
+        // first instructions of the other fused pairs (LDA abs / STA abs, INC zp / LDA zp, CMP #imm / BEQ, BNE)
+        const uint8_t pairs[][2] = {{0xAD, 0x8D}, {0xE6, 0xA5}, {0xC9, 0xF0}, {0xC9, 0xD0}};
+
+        std::vector<uint8_t> prg(0x4000, 0xEA);
+        size_t pc = 0;
+        while (pc + 16 <= programSize) {
+            uint8_t kind = src.Byte() % 9;
+            if (kind == 0) {
+                // LDX/LDY #n, up to 3 straight-line instructions, counter, BNE back to the body
+                uint8_t counter = counters[src.Byte() % 4];
+                bool x = counter == 0xCA || counter == 0xE8;
+                pc += put(cpu, prg, pc, x ? 0xA2 : 0xA0, uint16_t(1 + src.Byte() % 40));
+                size_t body = pc;
+                for (int n = src.Byte() % 4; n > 0; --n) {
+                    uint8_t op = straight[src.Byte() % straight.size()];
+                    pc += put(cpu, prg, pc, op, randomOperand(src, cpu.Decode(op, 0), programSize));
+                }
+                pc += put(cpu, prg, pc, counter, 0);
+                pc += put(cpu, prg, pc, 0xD0, uint16_t(uint8_t(int(body) - int(pc + 2))));
+            } else if (kind == 1) {
+                const uint8_t *pair = pairs[src.Byte() % 4];
+                for (int n = 0; n < 2; ++n) {
+                    nestake::DecodedInstruction d = cpu.Decode(pair[n], 0);
+                    uint16_t operand = d.AddressingMode == nestake::Relative ? src.Byte() % 8
+                                                                             : randomOperand(src, d, programSize);
+                    pc += put(cpu, prg, pc, pair[n], operand);
+                }
+            } else if (kind == 2) {
+                // LDA zp; STA $4014
+                pc += put(cpu, prg, pc, 0xA5, src.Byte());
+                pc += put(cpu, prg, pc, 0x8D, 0x4014);
+            } else {
+                uint8_t op = supported[src.Byte() % supported.size()];
+                pc += put(cpu, prg, pc, op, randomOperand(src, cpu.Decode(op, 0), programSize));
+            }
+        }
+
+        // every vector restarts the program
+        prg[0x3FFA] = prg[0x3FFC] = prg[0x3FFE] = origin & 0xFF;
+        prg[0x3FFB] = prg[0x3FFD] = prg[0x3FFF] = origin >> 8;
+        return prg;
+    }
+
+    inline std::string describe(const nestake::Cpu &a, const nestake::Cpu &b) {
+        nestake::Cpu &x = const_cast<nestake::Cpu &>(a);
+        nestake::Cpu &y = const_cast<nestake::Cpu &>(b);
+        std::ostringstream out;
+        out << std::hex << "oracle PC:" << a.PC << " A:" << int(a.A) << " X:" << int(a.X) << " Y:" << int(a.Y)
+            << " P:" << int(x.getFlag()) << " SP:" << int(a.SP) << std::dec << " CYC:" << a.Cycles
+            << " STALL:" << a.Stall << " / engine" << std::hex << " PC:" << b.PC << " A:" << int(b.A)
+            << " X:" << int(b.X) << " Y:" << int(b.Y) << " P:" << int(y.getFlag()) << " SP:" << int(b.SP)
+            << std::dec << " CYC:" << b.Cycles << " STALL:" << b.Stall;
+        return out.str();
+    }
+
+    // first divergence between the oracle and the engine running `prg` from a random state
+    // within `steps` engine steps ("" if none)
+    inline std::string Compare(Source &src, const std::vector<uint8_t> &prg, const Engine &engine, int steps) {
+        std::shared_ptr<nestake::CPUMemory> oracleMem(std::make_shared<nestake::CPUMemory>());
+        nestake::Cpu oracle(oracleMem);
+        std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+        nestake::Cpu cpu(mem);
+        engine(cpu);
+
+        // OAM DMA only stalls the cpu with a PPU on the bus
+        oracleMem->PPU = std::make_shared<nestake::PPU>();
+        mem->PPU = std::make_shared<nestake::PPU>();
+
+        std::shared_ptr<nestake::Cartridge> cart(
+            std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>())));
+
+        // the oracle has no block cache, so it decodes every instruction from the bus
+        oracleMem->Cart = cart;
+        cpu.LoadCartridge(cart);
+        oracle.PC = cpu.PC;
+        oracle.Cycles = cpu.Cycles;
+
+        // random state
+        for (size_t i = 0; i < mem->RAM.size(); ++i) {
+            mem->RAM[i] = oracleMem->RAM[i] = src.Byte();
+        }
+        cpu.A = oracle.A = src.Byte();
+        cpu.X = oracle.X = src.Byte();
+        cpu.Y = oracle.Y = src.Byte();
+        cpu.SP = oracle.SP = src.Byte();
+        uint8_t flags = src.Byte();
+        cpu.setFlags(flags);
+        oracle.setFlags(flags);
+
+        for (int i = 0; i < steps; ++i) {
+            bool threw = false;
+            try {
+                cpu.Step();
+            } catch (const std::exception &) {
+                threw = true;
+            }
+
+            // a fused pair or a compiled block runs several instructions in one step.
+            // stall steps do not add to Cycles, so the oracle also serves the stall the engine is done with
+            for (int n = 0; n < 1024 && (threw ? oracle.PC != cpu.PC
+                                              : oracle.Cycles < cpu.Cycles || oracle.Stall > cpu.Stall); ++n) {
+                try {
+                    oracle.Step();
+                } catch (const std::exception &) {
+                    return "oracle failed where the engine did not: " + describe(oracle, cpu);
+                }
+            }
+            if (threw) {
+                try {
+                    oracle.Step();
+                } catch (const std::exception &) {
+                    // both stopped on the same unsupported opcode
+                    return "";
+                }
+                return "engine failed where the oracle did not: " + describe(oracle, cpu);
+            }
+
+            if (oracle.PC != cpu.PC || oracle.Cycles != cpu.Cycles || oracle.A != cpu.A || oracle.X != cpu.X ||
+                oracle.Y != cpu.Y || oracle.SP != cpu.SP || oracle.getFlag() != cpu.getFlag() ||
+                oracle.Stall != cpu.Stall) {
+                return "registers differ after step " + std::to_string(i) + ": " + describe(oracle, cpu);
+            }
+            if (std::memcmp(oracleMem->RAM.data(), mem->RAM.data(), mem->RAM.size()) != 0) {
+                return "RAM differs after step " + std::to_string(i) + ": " + describe(oracle, cpu);
+            }
+        }
+        return "";
+    }
+
+    // first divergence on a random program ("" if none)
+    inline std::string Run(Source &src, const Engine &engine, int steps) {
+        nestake::Cpu decoder(std::make_shared<nestake::CPUMemory>());
+        uint16_t programSize = uint16_t(0x40 + src.Byte() % 0x200);
+        std::vector<uint8_t> prg = generateProgram(src, decoder, programSize);
+        return Compare(src, prg, engine, steps);
+    }
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "gtest/gtest.h"
+#include "differential.hpp"
+
+namespace {
+    const int seeds = 200;
+    const int steps = 2000;
+
+    void runSeeds(const differential::Engine &engine) {
+        for (int seed = 0; seed < seeds; ++seed) {
+            differential::Source src((uint64_t(seed)));
+            std::string divergence = differential::Run(src, engine, steps);
+            ASSERT_EQ("", divergence) << "seed " << seed;
+        }
+    }
+}
+
+TEST(DifferentialTest, BlockCache) {
+    runSeeds([](nestake::Cpu &cpu) {
+        cpu.IsFusionMode = false;
+    });
+}
+
+TEST(DifferentialTest, Fusion) {
+    runSeeds([](nestake::Cpu &cpu) {
+        cpu.IsFusionMode = true;
+    });
+}
+
+TEST(DifferentialTest, JIT) {
+    runSeeds([](nestake::Cpu &cpu) {
+        cpu.IsJITMode = true;
+    });
+}
+
+TEST(DifferentialTest, JITOAMDMA) {
+    // the stall depends on the cycle of the write, which the compiled block has to make visible
+    const std::vector<uint8_t> loops[] = {
+        {
+            0xA5, 0x10,       // C000: LDA $10
+            0x8D, 0x14, 0x40, // C002: STA $4014
+            0xE6, 0x20,       // C005: INC $20
+            0x4C, 0x00, 0xC0, // C007: JMP $C000
+        },
+        {
+            // blocks long enough to be compiled
+            0xA5, 0x10,       // C000: LDA $10
+            0xA2, 0x00,       // C002: LDX #$00
+            0x8D, 0x14, 0x40, // C004: STA $4014
+            0xE6, 0x20,       // C007: INC $20
+            0xE8,             // C009: INX
+            0x4C, 0x00, 0xC0, // C00A: JMP $C000
+        },
+    };
+    for (const std::vector<uint8_t> &loop : loops) {
+        std::vector<uint8_t> prg(0x4000, 0xEA);
+        std::copy(loop.begin(), loop.end(), prg.begin());
+        prg[0x3FFA] = prg[0x3FFC] = prg[0x3FFE] = differential::origin & 0xFF;
+        prg[0x3FFB] = prg[0x3FFD] = prg[0x3FFF] = differential::origin >> 8;
+
+        for (int seed = 0; seed < 4; ++seed) {
+            differential::Source src((uint64_t(seed)));
+            std::string divergence = differential::Compare(src, prg, [](nestake::Cpu &cpu) {
+                cpu.IsJITMode = true;
+            }, 20000);
+            ASSERT_EQ("", divergence) << "seed " << seed;
+        }
+    }
+}
+
+TEST(DifferentialTest, CycleAccurate) {
+    runSeeds([](nestake::Cpu &cpu) {
+        cpu.IsCycleAccurate = true;
+    });
+}
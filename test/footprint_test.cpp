@@ -0,0 +1,86 @@
+#include <cstdlib>
+#include <new>
+
+#include "gtest/gtest.h"
+#include "console.hpp"
+
+// every allocation of the process goes through these
+namespace {
+    size_t allocations = 0;
+    size_t allocatedBytes = 0;
+}
+
+void *operator new(size_t size) {
+    ++allocations;
+    allocatedBytes += size;
+    void *p = std::malloc(size > 0 ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+// budget of mutable state per headless console
+static const size_t consoleBudget = 16*1024;
+
+TEST(FootprintTest, Size) {
+    EXPECT_LE(sizeof(nestake::BasicConsole<nestake::NROM>), consoleBudget);
+    EXPECT_LE(sizeof(nestake::Cpu), 256u);
+
+    // the sizes go to the test report (--gtest_output=xml)
+    RecordProperty("BasicConsole", int(sizeof(nestake::BasicConsole<nestake::NROM>)));
+    RecordProperty("Cpu", int(sizeof(nestake::Cpu)));
+    RecordProperty("PPU", int(sizeof(nestake::PPU)));
+    RecordProperty("CPUMemory", int(sizeof(nestake::CPUMemory)));
+}
+
+TEST(FootprintTest, Allocations) {
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>("../../resources/sample.nes"));
+    // the first console decodes PRG-ROM and builds the shared tables
+    std::make_shared<nestake::BasicConsole<nestake::NROM>>(cart);
+
+    size_t before = allocations;
+    size_t bytesBefore = allocatedBytes;
+    std::shared_ptr<nestake::BasicConsole<nestake::NROM>> console =
+        std::make_shared<nestake::BasicConsole<nestake::NROM>>(cart);
+    EXPECT_EQ(1u, allocations - before);
+    EXPECT_LT(allocatedBytes - bytesBefore, consoleBudget);
+
+    // running headless allocates nothing, and no framebuffer
+    before = allocations;
+    for (int i = 0; i < 10000; ++i) {
+        console->Step();
+    }
+    EXPECT_EQ(0u, allocations - before);
+    EXPECT_TRUE(console->PPU.currentImage.empty());
+
+    console->PPU.RenderFrame();
+    EXPECT_EQ(256u*240, console->PPU.currentImage.size());
+
+    // restarting in place keeps every allocation
+    nestake::ConsoleState state;
+    console->Save(state);
+    before = allocations;
+    console->Reset();
+    nestake::ResetOptions options;
+    options.State = &state;
+    console->Reset(options);
+    EXPECT_EQ(0u, allocations - before);
+}
+
+TEST(FootprintTest, Fleet) {
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>("../../resources/sample.nes"));
+    std::make_shared<nestake::BasicConsole<nestake::NROM>>(cart);
+
+    size_t bytesBefore = allocatedBytes;
+    std::vector<std::shared_ptr<nestake::BasicConsole<nestake::NROM>>> fleet;
+    fleet.reserve(1000);
+    for (int i = 0; i < 1000; ++i) {
+        fleet.push_back(std::make_shared<nestake::BasicConsole<nestake::NROM>>(cart));
+    }
+    EXPECT_LT(allocatedBytes - bytesBefore, 1000*consoleBudget);
+}
@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "framediff.cpp"
+
+#include "ppu.hpp"
+
+// CHR: tile 1 is solid (pixel 3)
+static std::shared_ptr<nestake::Cartridge> patterns() {
+    std::vector<uint8_t> chr(0x2000, 0);
+    for (int row = 0; row < 16; ++row) {
+        chr[16 + row] = 0xFF;
+    }
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    return std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr));
+}
+
+static void setup(nestake::PPU &ppu) {
+    ppu.LoadCartridge(patterns());
+    for (int i = 0; i < 64; ++i) {
+        ppu.oamData[i*4] = 0xF0;
+    }
+    ppu.WritePalette(0x00, 0x0F);
+    ppu.WritePalette(0x03, 0x16);
+    ppu.writeMask(0x1E);
+}
+
+TEST(FrameDiffTest, ChangedLines) {
+    nestake::PPU ppu;
+    setup(ppu);
+    ppu.Diffs = std::make_shared<nestake::FrameDiffStream>();
+
+    // the frame before the first one is all 0: every line of the first frame changed
+    ppu.RenderFrame();
+    const nestake::FrameDiff &diff = ppu.Diffs->Last();
+    EXPECT_EQ(0u, diff.Frame);
+    EXPECT_EQ(240u, diff.Lines.size());
+    EXPECT_EQ(240u*256, diff.Pixels.size());
+    EXPECT_EQ(0x0F, diff.Pixels[0]);
+
+    ppu.RenderFrame();
+    EXPECT_EQ(1u, diff.Frame);
+    EXPECT_TRUE(diff.Lines.empty());
+
+    // a palette change redraws every scanline, but only those showing the color differ
+    ppu.nameTableData[5*32 + 7] = 1;
+    ppu.RenderFrame();
+    ppu.WritePalette(0x03, 0x17);
+    ppu.RenderFrame();
+    EXPECT_EQ(3u, diff.Frame);
+    ASSERT_EQ(8u, diff.Lines.size());
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(40 + i, diff.Lines[i]);
+        EXPECT_EQ(0x17, diff.Pixels[i*256 + 7*8]);
+    }
+    EXPECT_EQ(0x17, ppu.Diffs->Frame()[40*256 + 7*8]);
+}
+
+TEST(FrameDiffTest, ApplyFromFile) {
+    std::string path = testing::TempDir() + "nestake_framediff_test.bin";
+    nestake::PPU ppu;
+    setup(ppu);
+    ppu.Diffs = std::make_shared<nestake::FrameDiffStream>(path);
+    for (int frame = 0; frame < 10; ++frame) {
+        ppu.nameTableData[frame*32 + frame] = 1;
+        ppu.oamData[0] = uint8_t(frame*20);
+        ppu.RenderFrame();
+    }
+    std::vector<uint8_t> expected(ppu.Diffs->Frame(), ppu.Diffs->Frame() + 256*240);
+    uint64_t written = ppu.Diffs->BytesWritten();
+    ppu.Diffs.reset();
+
+    // far smaller than the 10 frames
+    EXPECT_LT(written, 10u*256*240 / 4);
+
+    nestake::FrameDiffReader reader(path);
+    ASSERT_TRUE(reader.IsOpen());
+    std::vector<uint8_t> frame(256*240, 0);
+    nestake::FrameDiff diff;
+    uint64_t frames = 0;
+    while (reader.Next(diff)) {
+        EXPECT_EQ(frames, diff.Frame);
+        EXPECT_TRUE(nestake::ApplyFrameDiff(diff, frame.data()));
+        ++frames;
+    }
+    EXPECT_FALSE(reader.IsCorrupt());
+    EXPECT_EQ(10u, frames);
+    EXPECT_EQ(expected, frame);
+    std::remove(path.c_str());
+
+    nestake::FrameDiffReader missing(path);
+    EXPECT_FALSE(missing.IsOpen());
+}
+
+TEST(FrameDiffTest, OpenError) {
+    // the caller sees the failure, and the diffs are still kept in memory
+    nestake::FrameDiffStream stream(testing::TempDir() + "nestake_missing_dir/diffs.bin");
+    EXPECT_FALSE(stream.IsOpen());
+    std::vector<uint8_t> line(256, 7);
+    stream.Line(3, line.data());
+    stream.EndFrame();
+    EXPECT_EQ(1u, stream.Last().Lines.size());
+    EXPECT_EQ(0u, stream.BytesWritten());
+    EXPECT_FALSE(nestake::FrameDiffStream().IsOpen());
+}
+
+TEST(FrameDiffTest, Corrupt) {
+    std::string path = testing::TempDir() + "nestake_framediff_corrupt.bin";
+    {
+        nestake::FrameDiffStream stream(path);
+        std::vector<uint8_t> line(256, 7);
+        stream.Line(3, line.data());
+        stream.EndFrame();
+    }
+    // the header is 16 bytes, then frame (8), number of lines (4) and the line index
+    FILE *f = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(nullptr, f);
+    std::fseek(f, 16 + 8 + 4, SEEK_SET);
+    std::fputc(250, f);
+    std::fclose(f);
+
+    nestake::FrameDiffReader reader(path);
+    ASSERT_TRUE(reader.IsOpen());
+    nestake::FrameDiff diff;
+    EXPECT_FALSE(reader.Next(diff));
+    EXPECT_TRUE(reader.IsCorrupt());
+    std::remove(path.c_str());
+
+    // truncated records are reported as well
+    {
+        nestake::FrameDiffStream stream(path);
+        std::vector<uint8_t> line(256, 7);
+        stream.Line(3, line.data());
+        stream.EndFrame();
+    }
+    ASSERT_EQ(0, truncate(path.c_str(), 16 + 8 + 4 + 1 + 100));
+    nestake::FrameDiffReader truncated(path);
+    EXPECT_FALSE(truncated.Next(diff));
+    EXPECT_TRUE(truncated.IsCorrupt());
+    std::remove(path.c_str());
+
+    // diffs built in memory are checked too
+    std::vector<uint8_t> frame(256*240, 0);
+    diff.Frame = 0;
+    diff.Lines.assign(1, 240);
+    diff.Pixels.assign(256, 1);
+    EXPECT_FALSE(nestake::ApplyFrameDiff(diff, frame.data()));
+    diff.Lines.assign(1, 239);
+    diff.Pixels.assign(100, 1);
+    EXPECT_FALSE(nestake::ApplyFrameDiff(diff, frame.data()));
+    EXPECT_EQ(std::vector<uint8_t>(256*240, 0), frame);
+}
@@ -0,0 +1,167 @@
+#include "gtest/gtest.h"
+#include "fusion.cpp"
+
+#include <iostream>
+#include <sstream>
+
+TEST(FusionTest, FusedPairOf) {
+    const std::string path = "../../resources/sample.nes";
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+
+    // 0x8020: INX / DEY / BNE $801A
+    EXPECT_EQ(nestake::fuseNone, cart->Blocks->At(0x20).Fusion);
+    EXPECT_EQ(nestake::fuseDEYBNE, cart->Blocks->At(0x21).Fusion);
+
+    // the branch itself ends the basic block
+    EXPECT_EQ(nestake::fuseNone, cart->Blocks->At(0x22).Fusion);
+}
+
+TEST(FusionTest, MatchUnfused) {
+    const std::string path = "../../resources/sample.nes";
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+
+    std::shared_ptr<nestake::CPUMemory> refMem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu ref = nestake::Cpu(refMem);
+    ref.LoadCartridge(cart);
+    ref.IsFusionMode = false;
+
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+
+    // the main loop of sample.nes
+    int refSteps = 0, steps = 0;
+    for (; ref.PC != 0x804E; ++refSteps) {
+        ref.Step();
+    }
+    for (; cpu.PC != 0x804E; ++steps) {
+        cpu.Step();
+    }
+
+    EXPECT_EQ(refSteps - 29, steps);
+    EXPECT_EQ(ref.Cycles, cpu.Cycles);
+    EXPECT_EQ(ref.A, cpu.A);
+    EXPECT_EQ(ref.X, cpu.X);
+    EXPECT_EQ(ref.Y, cpu.Y);
+    EXPECT_EQ(ref.getFlag(), cpu.getFlag());
+}
+
+TEST(FusionTest, PairCounter) {
+    const std::string path = "../../resources/sample.nes";
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+    cpu.Pairs = std::make_shared<nestake::PairCounter>();
+
+    while (cpu.PC != 0x804E) {
+        cpu.Step();
+    }
+
+    // both copy loops of sample.nes run 16 + 13 times
+    EXPECT_EQ(29, cpu.Pairs->Get(0x88, 0xD0));
+    EXPECT_EQ(29, cpu.Pairs->Get(0xBD, 0x8D));
+    EXPECT_EQ(27, cpu.Pairs->Get(0xD0, 0xBD));
+
+    std::vector<nestake::PairCounter::Pair> hottest = cpu.Pairs->Hottest(3);
+    ASSERT_EQ(3, hottest.size());
+    EXPECT_EQ(29, hottest[0].Count);
+    EXPECT_EQ(29, hottest[2].Count);
+
+    // ties keep the opcode order
+    EXPECT_EQ(0x88, hottest[0].First);
+    EXPECT_EQ(0xD0, hottest[0].Second);
+
+    std::ostringstream report;
+    cpu.Pairs->Report(report, cpu, 1);
+    EXPECT_EQ("DEY(88) -> BNE(D0): 29\n", report.str());
+}
+
+namespace {
+    // 16KB PRG-ROM starting with the code at $8000
+    std::shared_ptr<nestake::Cartridge> program(const std::vector<uint8_t> &code) {
+        std::vector<uint8_t> prg(0x4000, 0xEA);
+        std::copy(code.begin(), code.end(), prg.begin());
+        prg[0x3FFC] = 0x00;
+        prg[0x3FFD] = 0x80;
+        return std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>()));
+    }
+
+    // run the program with and without fusion for the same cycles and compare the states
+    void expectMatchUnfused(const std::vector<uint8_t> &code, uint64_t cycles) {
+        std::shared_ptr<nestake::Cartridge> cart = program(code);
+        nestake::Cpu ref = nestake::Cpu(std::make_shared<nestake::CPUMemory>());
+        ref.LoadCartridge(cart);
+        ref.IsFusionMode = false;
+        nestake::Cpu cpu = nestake::Cpu(std::make_shared<nestake::CPUMemory>());
+        cpu.LoadCartridge(cart);
+
+        // stop on the instruction boundaries both of them reach
+        int refSteps = 0, steps = 0;
+        while (ref.Cycles < cycles || cpu.Cycles != ref.Cycles) {
+            if (cpu.Cycles < ref.Cycles) {
+                cpu.Step();
+                ++steps;
+            } else {
+                ref.Step();
+                ++refSteps;
+            }
+        }
+        EXPECT_LT(steps, refSteps);
+        EXPECT_EQ(ref.PC, cpu.PC);
+        EXPECT_EQ(ref.A, cpu.A);
+        EXPECT_EQ(ref.X, cpu.X);
+        EXPECT_EQ(ref.Y, cpu.Y);
+        EXPECT_EQ(ref.getFlag(), cpu.getFlag());
+        EXPECT_EQ(ref.mem->RAM, cpu.mem->RAM);
+    }
+}
+
+TEST(FusionTest, FusedLength) {
+    // LDA $10 / ADC #$03 / STA $10 / TXA / AND #$07 / BEQ +0 / JMP $800C:
+    // only the idle loop is fused, the others are not in the profiled set
+    std::shared_ptr<nestake::Cartridge> cart = program({
+        0xA5, 0x10, 0x69, 0x03, 0x85, 0x10, 0x8A, 0x29, 0x07, 0xF0, 0x00, 0x4C, 0x0B, 0x80,
+    });
+    nestake::Cpu cpu = nestake::Cpu(std::make_shared<nestake::CPUMemory>());
+    cpu.LoadCartridge(cart);
+    EXPECT_EQ(nestake::fuseNone, cart->Blocks->At(0x00).Fusion);
+    EXPECT_EQ(nestake::fuseNone, cart->Blocks->At(0x06).Fusion);
+    EXPECT_EQ(nestake::fuseJMPSelf, cart->Blocks->At(0x0B).Fusion);
+    EXPECT_EQ(3, nestake::FusedLength(nestake::fuseJMPSelf));
+    EXPECT_EQ(2, nestake::FusedLength(nestake::fuseDEYBNE));
+    EXPECT_EQ(1, nestake::FusedLength(nestake::fuseNone));
+}
+
+TEST(FusionTest, Pairs) {
+    // copy through ($00),Y with a page crossing pointer, then poll $6000 with BIT / BPL:
+    // LDA #$F0 / STA $00 / LDA #$02 / STA $01 / LDY #$00 / LDA ($00),Y / STA $0300,Y / INY / BNE -8 /
+    // INC $02 / BIT $0002 / BPL -5 / JMP $8000
+    expectMatchUnfused({
+        0xA9, 0xF0, 0x8D, 0x00, 0x00, 0xA9, 0x02, 0x8D, 0x01, 0x00, 0xA0, 0x00,
+        0xB1, 0x00, 0x99, 0x00, 0x03, 0xC8, 0xD0, 0xF8,
+        0xE6, 0x02, 0x2C, 0x02, 0x00, 0x10, 0xF9, 0x4C, 0x00, 0x80,
+    }, 50000);
+}
+
+TEST(FusionTest, IdleLoop) {
+    // JMP $8000
+    std::shared_ptr<nestake::Cartridge> cart = program({0x4C, 0x00, 0x80});
+    nestake::Cpu cpu = nestake::Cpu(std::make_shared<nestake::CPUMemory>());
+    cpu.LoadCartridge(cart);
+    const uint64_t start = cpu.Cycles;
+    EXPECT_EQ(9u, cpu.Step());
+    EXPECT_EQ(0x8000, cpu.PC);
+
+    // single iterations near the deadline, and through the mirror at $C000
+    cpu.CycleDeadline = cpu.Cycles + 8;
+    EXPECT_EQ(3u, cpu.Step());
+    cpu.CycleDeadline = UINT64_MAX;
+    cpu.PC = 0xC000;
+    EXPECT_EQ(3u, cpu.Step());
+    EXPECT_EQ(0x8000, cpu.PC);
+    EXPECT_EQ(start + 15, cpu.Cycles);
+}
@@ -0,0 +1,25 @@
+// libFuzzer target: the input drives the program and state generation of differential.hpp,
+// and every optimized engine is compared with the oracle.
+//   cmake -DCMAKE_CXX_COMPILER=clang++ -DNESTAKE_FUZZ=ON .. && make cpu_fuzzer && ./test/cpu_fuzzer
+
+#include <cstdlib>
+
+#include "differential.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    const differential::Engine engines[] = {
+        [](nestake::Cpu &cpu) { cpu.IsFusionMode = false; },
+        [](nestake::Cpu &cpu) { cpu.IsFusionMode = true; },
+        [](nestake::Cpu &cpu) { cpu.IsJITMode = true; },
+        [](nestake::Cpu &cpu) { cpu.IsCycleAccurate = true; },
+    };
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); ++i) {
+        differential::Source src(data, size);
+        std::string divergence = differential::Run(src, engines[i], 500);
+        if (!divergence.empty()) {
+            fprintf(stderr, "engine %zu: %s\n", i, divergence.c_str());
+            abort();
+        }
+    }
+    return 0;
+}
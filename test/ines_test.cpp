@@ -7,3 +7,54 @@ TEST(INESTEST, Initialization) {
     std::string path = "../../resources/sample.nes";
     nestake::Cartridge c = nestake::Cartridge{path};
 }
+
+TEST(INESTEST, Size) {
+    std::string path = "../../resources/sample.nes";
+    nestake::Cartridge c = nestake::Cartridge{path};
+    EXPECT_EQ(0x8000, c.PRG.size());
+    EXPECT_EQ(0x2000, c.CHR.size());
+    EXPECT_EQ(0x78, c.PRG[0]);
+}
+
+TEST(INESTEST, MakeINES) {
+    std::string path = "../../resources/sample.nes";
+    nestake::Cartridge c = nestake::Cartridge{path};
+    nestake::Cartridge copy(nestake::MakeINES(c.PRG, c.CHR, c.Mapper, c.Mirror));
+    EXPECT_EQ(c.PRG, copy.PRG);
+    EXPECT_EQ(c.CHR, copy.CHR);
+    EXPECT_EQ(c.Mapper, copy.Mapper);
+    EXPECT_EQ(c.Mirror, copy.Mirror);
+
+    // padded to whole units
+    nestake::Cartridge small(nestake::MakeINES(std::vector<uint8_t>(3, 0xEA), std::vector<uint8_t>()));
+    EXPECT_EQ(0x4000, small.PRG.size());
+    EXPECT_EQ(0xEA, small.PRG[2]);
+    EXPECT_EQ(0xFF, small.PRG[3]);
+    EXPECT_EQ(0x2000, small.CHR.size());
+}
+
+TEST(INESTEST, Battery) {
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    nestake::Cartridge plain(nestake::MakeINES(prg, std::vector<uint8_t>()));
+    EXPECT_FALSE(plain.Battery);
+    EXPECT_EQ("", plain.SavePath);
+
+    nestake::Cartridge image(nestake::MakeINES(prg, std::vector<uint8_t>(), 0, 0, true));
+    EXPECT_TRUE(image.Battery);
+    EXPECT_EQ("", image.SavePath);
+
+    // the save file of a ROM file is named after it, but nothing is mapped by the cartridge
+    std::vector<uint8_t> rom = nestake::MakeINES(prg, std::vector<uint8_t>(), 0, 0, true);
+    FILE *f = std::fopen("battery_test.nes", "wb");
+    ASSERT_NE(nullptr, f);
+    std::fwrite(rom.data(), 1, rom.size(), f);
+    std::fclose(f);
+    std::remove("battery_test.sav");
+    {
+        nestake::Cartridge c("battery_test.nes");
+        EXPECT_TRUE(c.Battery);
+        EXPECT_EQ("battery_test.sav", c.SavePath);
+    }
+    EXPECT_EQ(nullptr, std::fopen("battery_test.sav", "rb"));
+    std::remove("battery_test.nes");
+}
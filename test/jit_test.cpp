@@ -0,0 +1,200 @@
+#include "gtest/gtest.h"
+#include "jit.cpp"
+#include "ppu.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+namespace {
+    // write a 16KB NROM image running `code` from 0x8000
+    std::shared_ptr<nestake::Cartridge> makeCartridge(const std::vector<uint8_t> &code) {
+        std::vector<uint8_t> rom(16 + 0x4000 + 0x2000, 0);
+        const uint8_t header[] = {0x4e, 0x45, 0x53, 0x1a, 1, 1};
+        std::copy(header, header + sizeof(header), rom.begin());
+        std::copy(code.begin(), code.end(), rom.begin() + 16);
+        rom[16 + 0x3FFC] = 0x00;
+        rom[16 + 0x3FFD] = 0x80;
+
+        const std::string path = "jit_test.nes";
+        FILE *f = std::fopen(path.c_str(), "wb");
+        std::fwrite(rom.data(), 1, rom.size(), f);
+        std::fclose(f);
+        std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+        std::remove(path.c_str());
+        return cart;
+    }
+
+    const std::vector<uint8_t> program = {
+        0xA2, 0x10,       // 8000: LDX #$10
+        0xA9, 0x00,       // 8002: LDA #$00
+        0x8D, 0x00, 0x02, // 8004: STA $0200
+        0xE6, 0x10,       // 8007: INC $10
+        0x8A,             // 8009: TXA
+        0x49, 0x5A,       // 800A: EOR #$5A
+        0x85, 0x11,       // 800C: STA $11
+        0xA4, 0x11,       // 800E: LDY $11
+        0xCA,             // 8010: DEX
+        0xD0, 0xF1,       // 8011: BNE $8004
+        0x8D, 0x00, 0x20, // 8013: STA $2000
+        0xAD, 0x00, 0x80, // 8016: LDA $8000
+        0xC9, 0xA2,       // 8019: CMP #$A2
+        0x38,             // 801B: SEC
+        0xC6, 0x12,       // 801C: DEC $12
+        0xD0, 0xE4,       // 801E: BNE $8004
+        0x4C, 0x22, 0x80, // 8020: JMP $8022
+        0x4C, 0x22, 0x80, // 8022: JMP $8022
+    };
+}
+
+TEST(JITTest, Run) {
+    if (!nestake::Jit::IsSupported()) {
+        return;
+    }
+    std::shared_ptr<nestake::Cartridge> cart = makeCartridge(program);
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+
+    nestake::Jit jit(cpu);
+    for (int i = 1; i < nestake::Jit::HotThreshold; ++i) {
+        EXPECT_FALSE(jit.Run(cpu, *cart->Blocks, 0));
+    }
+
+    // LDX #$10 ... BNE is compiled as a single block
+    EXPECT_TRUE(jit.Run(cpu, *cart->Blocks, 0));
+    EXPECT_EQ(1, jit.CompiledBlocks());
+    EXPECT_EQ(0x8004, cpu.PC);
+    EXPECT_EQ(0x0F, cpu.X);
+    EXPECT_EQ(0x5A ^ 0x10, cpu.A);
+    EXPECT_EQ(0x5A ^ 0x10, cpu.Y);
+    EXPECT_EQ(0x5A ^ 0x10, mem->RAM[0x11]);
+    EXPECT_EQ(1, mem->RAM[0x10]);
+    EXPECT_EQ(0, cpu.flagZ());
+
+    // 2+2+4+5+2+2+3+3+2+2 (+1 taken branch)
+    EXPECT_EQ(28, cpu.Cycles);
+
+    // the block would run past the deadline
+    cpu.PC = 0x8000;
+    cpu.CycleDeadline = cpu.Cycles + 10;
+    EXPECT_FALSE(jit.Run(cpu, *cart->Blocks, 0));
+}
+
+TEST(JITTest, Entries) {
+    if (!nestake::Jit::IsSupported()) {
+        return;
+    }
+    std::shared_ptr<nestake::Cartridge> cart = makeCartridge(program);
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+
+    // hits of the entry survive the growth of the table by thousands of other entries
+    nestake::Jit jit(cpu);
+    for (int i = 1; i < nestake::Jit::HotThreshold; ++i) {
+        EXPECT_FALSE(jit.Run(cpu, *cart->Blocks, 0));
+    }
+    for (uint32_t offset = 0x1000; offset < 0x3000; ++offset) {
+        EXPECT_FALSE(jit.Run(cpu, *cart->Blocks, offset));
+    }
+    EXPECT_EQ(0, jit.CompiledBlocks());
+
+    EXPECT_TRUE(jit.Run(cpu, *cart->Blocks, 0));
+    EXPECT_EQ(1, jit.CompiledBlocks());
+    EXPECT_EQ(0x8004, cpu.PC);
+}
+
+TEST(JITTest, WriteXorExecute) {
+    if (!nestake::Jit::IsSupported()) {
+        return;
+    }
+    std::shared_ptr<nestake::Cartridge> cart = makeCartridge(program);
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+    cpu.IsJITMode = true;
+    while (cpu.PC != 0x8022) {
+        cpu.Step();
+    }
+    EXPECT_LT(0, cpu.Cycles);
+
+    // no mapping of the process is both writable and executable
+    FILE *maps = std::fopen("/proc/self/maps", "r");
+    ASSERT_NE(nullptr, maps);
+    char line[512];
+    while (std::fgets(line, sizeof(line), maps) != nullptr) {
+        EXPECT_EQ(nullptr, std::strstr(line, " rwx")) << line;
+    }
+    std::fclose(maps);
+}
+
+TEST(JITTest, MatchInterpreter) {
+    std::shared_ptr<nestake::Cartridge> cart = makeCartridge(program);
+
+    std::shared_ptr<nestake::CPUMemory> refMem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu ref = nestake::Cpu(refMem);
+    ref.LoadCartridge(cart);
+
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu = nestake::Cpu(mem);
+    cpu.LoadCartridge(cart);
+    cpu.IsJITMode = true;
+
+    while (ref.PC != 0x8022) {
+        ref.Step();
+    }
+    while (cpu.PC != 0x8022) {
+        cpu.Step();
+    }
+
+    EXPECT_EQ(ref.Cycles, cpu.Cycles);
+    EXPECT_EQ(ref.A, cpu.A);
+    EXPECT_EQ(ref.X, cpu.X);
+    EXPECT_EQ(ref.Y, cpu.Y);
+    EXPECT_EQ(ref.SP, cpu.SP);
+    EXPECT_EQ(ref.getFlag(), cpu.getFlag());
+    EXPECT_EQ(refMem->RAM, mem->RAM);
+}
+
+TEST(JITTest, OAMDMA) {
+    // the stall of OAM DMA depends on the cycle of the write, which happens within a block
+    const std::vector<uint8_t> loops[] = {
+        {
+            0xA5, 0x10,       // 8000: LDA $10
+            0x8D, 0x14, 0x40, // 8002: STA $4014
+            0xE6, 0x20,       // 8005: INC $20
+            0x4C, 0x00, 0x80, // 8007: JMP $8000
+        },
+        {
+            // blocks long enough to be compiled
+            0xA5, 0x10,       // 8000: LDA $10
+            0xA2, 0x00,       // 8002: LDX #$00
+            0x8D, 0x14, 0x40, // 8004: STA $4014
+            0xE6, 0x20,       // 8007: INC $20
+            0xE8,             // 8009: INX
+            0x4C, 0x00, 0x80, // 800A: JMP $8000
+        },
+    };
+    for (const std::vector<uint8_t> &loop : loops) {
+        std::shared_ptr<nestake::Cartridge> cart = makeCartridge(loop);
+
+        uint64_t cycles[2] = {};
+        std::shared_ptr<nestake::CPUMemory> mems[2];
+        for (int jit = 0; jit < 2; ++jit) {
+            mems[jit] = std::make_shared<nestake::CPUMemory>();
+            mems[jit]->PPU = std::make_shared<nestake::PPU>();
+            nestake::Cpu cpu = nestake::Cpu(mems[jit]);
+            cpu.LoadCartridge(cart);
+            cpu.IsJITMode = jit == 1;
+
+            // stall steps count, the loop ends at its head
+            while (cycles[jit] < 200000 || cpu.PC != 0x8000) {
+                cycles[jit] += cpu.Step();
+            }
+        }
+
+        EXPECT_EQ(cycles[0], cycles[1]);
+        EXPECT_EQ(mems[0]->RAM[0x20], mems[1]->RAM[0x20]);
+    }
+}
@@ -0,0 +1,85 @@
+#include "gtest/gtest.h"
+#include "perfmap.cpp"
+
+#include <fstream>
+
+#include "assembler.hpp"
+#include "cpu.hpp"
+#include "ines.hpp"
+#include "jit.hpp"
+
+TEST(PerfMapTest, Symbols) {
+    const std::string path = "perfmap_test.nl";
+    {
+        std::ofstream out(path);
+        out << "$C000#Reset#entry point\n";
+        out << "C010 MainLoop\n";
+        out << "01:8000 BankedRoutine\n";
+        out << "garbage\n";
+    }
+
+    nestake::PerfMap map("/dev/null");
+    EXPECT_FALSE(map.LoadSymbols("does_not_exist.nl"));
+    ASSERT_TRUE(map.LoadSymbols(path));
+    std::remove(path.c_str());
+
+    EXPECT_EQ("Reset", map.Symbol(0, 0xC000));
+    EXPECT_EQ("Reset+0x4", map.Symbol(0, 0xC004));
+    EXPECT_EQ("MainLoop+0x20", map.Symbol(0, 0xC030));
+    EXPECT_EQ("BankedRoutine", map.Symbol(1, 0x8000));
+    EXPECT_EQ("", map.Symbol(0, 0x8000));
+    EXPECT_EQ("", map.Symbol(2, 0x9000));
+}
+
+TEST(PerfMapTest, CompiledBlocks) {
+    if (!nestake::Jit::IsSupported()) {
+        return;
+    }
+
+    nestake::Assembler as;
+    std::vector<uint8_t> prg = as.Assemble(
+        "reset: LDX #$40\n"
+        "loop:  INC $10\n"
+        "       DEX\n"
+        "       BNE loop\n"
+        "idle:  JMP idle\n"
+        "       .org $FFFC\n"
+        "       .word reset, reset\n", 0xC000);
+    std::shared_ptr<nestake::Cartridge> cart(
+        std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>())));
+
+    const std::string symbolPath = "perfmap_test.sym";
+    {
+        std::ofstream out(symbolPath);
+        out << "C002 Loop\n";
+    }
+    const std::string mapPath = "perfmap_test.map";
+    std::remove(mapPath.c_str());
+
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu(mem);
+    cpu.IsJITMode = true;
+    cpu.Perf = std::make_shared<nestake::PerfMap>(mapPath);
+    ASSERT_TRUE(cpu.Perf->LoadSymbols(symbolPath));
+    std::remove(symbolPath.c_str());
+    cpu.LoadCartridge(cart);
+    for (int i = 0; i < 200; ++i) {
+        cpu.Step();
+    }
+    cpu.Perf.reset();
+
+    std::ifstream in(mapPath);
+    std::string line;
+    ASSERT_TRUE(static_cast<bool>(std::getline(in, line)));
+    std::remove(mapPath.c_str());
+
+    // "<start> <size> nestake 00:C002 INC DEX BNE (Loop)"
+    std::istringstream fields(line);
+    std::string start, size;
+    fields >> start >> size;
+    EXPECT_NE(0, std::strtoul(start.c_str(), nullptr, 16));
+    EXPECT_NE(0, std::strtoul(size.c_str(), nullptr, 16));
+    std::string name;
+    std::getline(fields, name);
+    EXPECT_EQ(" nestake 00:C002 INC DEX BNE (Loop)", name);
+}
@@ -1 +1,362 @@
 #include "gtest/gtest.h"
+#include "ppu.cpp"
+
+// CHR: tile 1 is solid (pixel 3), tile 2 has its left half set (pixel 1)
+static std::shared_ptr<nestake::Cartridge> patterns() {
+    std::vector<uint8_t> chr(0x2000, 0);
+    for (int row = 0; row < 8; ++row) {
+        chr[16 + row] = 0xFF;
+        chr[16 + 8 + row] = 0xFF;
+        chr[32 + row] = 0xF0;
+    }
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    return std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr));
+}
+
+static void sprite(nestake::PPU &ppu, int i, uint8_t y, uint8_t tile, uint8_t attributes, uint8_t x) {
+    ppu.oamData[i*4] = y;
+    ppu.oamData[i*4 + 1] = tile;
+    ppu.oamData[i*4 + 2] = attributes;
+    ppu.oamData[i*4 + 3] = x;
+}
+
+static bool sameColor(const nestake::color &a, const nestake::color &b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+TEST(PPUTest, EvaluateSprites) {
+    nestake::PPU ppu;
+    ppu.LoadCartridge(patterns());
+    for (int i = 0; i < 64; ++i) {
+        sprite(ppu, i, 0xF0, 0, 0, 0);
+    }
+    for (int i = 0; i < 10; ++i) {
+        sprite(ppu, i + 3, 19, 2, 0, uint8_t(i*8));
+    }
+    // sprites are visible on the lines after their y
+    ppu.EvaluateSprites(19);
+    EXPECT_EQ(0, ppu.lineSpriteCount);
+    EXPECT_EQ(0, ppu.flagSpriteOverflow);
+
+    ppu.EvaluateSprites(20);
+    ASSERT_EQ(8, ppu.lineSpriteCount);
+    EXPECT_EQ(1, ppu.flagSpriteOverflow);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(i + 3, ppu.lineSprites[i].Index);
+        EXPECT_EQ(i*8, ppu.lineSprites[i].X);
+        // bit 0 is the leftmost pixel
+        EXPECT_EQ(0x0F, ppu.lineSprites[i].Low);
+        EXPECT_EQ(0x00, ppu.lineSprites[i].High);
+    }
+
+    // flipped horizontally
+    ppu.flagSpriteOverflow = 0;
+    sprite(ppu, 3, 19, 2, 0x40, 0);
+    ppu.EvaluateSprites(27);
+    ASSERT_EQ(8, ppu.lineSpriteCount);
+    EXPECT_EQ(0xF0, ppu.lineSprites[0].Low);
+    ppu.EvaluateSprites(28);
+    EXPECT_EQ(0, ppu.lineSpriteCount);
+}
+
+TEST(PPUTest, EvaluateSprites8x16) {
+    nestake::PPU ppu;
+    ppu.LoadCartridge(patterns());
+    for (int i = 0; i < 64; ++i) {
+        sprite(ppu, i, 0xF0, 0, 0, 0);
+    }
+    ppu.writeControl(0x20);
+    // tile 1 selects the 0x1000 table, which is empty: the top half is tile 0x1000 / 16 + 0
+    sprite(ppu, 0, 9, 1, 0, 0);
+    sprite(ppu, 1, 9, 2, 0, 8);
+    ppu.EvaluateSprites(10 + 15);
+    ASSERT_EQ(2, ppu.lineSpriteCount);
+    EXPECT_EQ(0x00, ppu.lineSprites[0].Low);
+    // bottom half of tile 2 is tile 3 (empty)
+    EXPECT_EQ(0x00, ppu.lineSprites[1].Low);
+    ppu.EvaluateSprites(10);
+    EXPECT_EQ(0x0F, ppu.lineSprites[1].Low);
+
+    // flipped vertically, the bottom half (tile 1) comes first
+    sprite(ppu, 1, 9, 0, 0x80, 8);
+    ppu.EvaluateSprites(10);
+    EXPECT_EQ(0xFF, ppu.lineSprites[1].Low);
+    EXPECT_EQ(0xFF, ppu.lineSprites[1].High);
+    ppu.EvaluateSprites(10 + 15);
+    EXPECT_EQ(0x00, ppu.lineSprites[1].Low);
+}
+
+TEST(PPUTest, RenderScanline) {
+    nestake::PPU ppu;
+    ppu.LoadCartridge(patterns());
+    for (int i = 0; i < 64; ++i) {
+        sprite(ppu, i, 0xF0, 0, 0, 0);
+    }
+    ppu.WritePalette(0x00, 0x0F);
+    ppu.WritePalette(0x03, 0x16); // background palette 0, pixel 3
+    ppu.WritePalette(0x11, 0x2A); // sprite palette 0, pixel 1
+    nestake::color universal = {0x00, 0x00, 0x00};
+    nestake::color background = {0xB5, 0x31, 0x20};
+    nestake::color front = {0x5C, 0xE4, 0x30};
+
+    // solid tiles on the right half of the first name table
+    for (int i = 0; i < 30*32; ++i) {
+        ppu.nameTableData[i] = (i % 32) >= 16 ? 1 : 0;
+    }
+    sprite(ppu, 0, 9, 2, 0x00, 100);  // sprite 0 over the empty background
+    sprite(ppu, 1, 9, 2, 0x00, 200);  // in front of the background
+    sprite(ppu, 2, 9, 2, 0x20, 208);  // behind the background
+    ppu.writeMask(0x1E);
+    ppu.RenderScanline(10);
+
+    const nestake::color *line = &ppu.renderingImage[10*256];
+    EXPECT_TRUE(sameColor(universal, line[0]));
+    EXPECT_TRUE(sameColor(front, line[100]));
+    EXPECT_TRUE(sameColor(universal, line[104]));
+    EXPECT_TRUE(sameColor(background, line[128]));
+    EXPECT_TRUE(sameColor(front, line[200]));
+    EXPECT_TRUE(sameColor(background, line[204]));
+    EXPECT_TRUE(sameColor(background, line[208]));
+    EXPECT_EQ(0, ppu.flagSpriteZeroHit);
+
+    // scrolled by 4 pixels, sprite 0 hits the background
+    ppu.x = 4;
+    sprite(ppu, 0, 9, 2, 0x00, 124);
+    ppu.RenderScanline(10);
+    EXPECT_TRUE(sameColor(universal, line[123]));
+    EXPECT_TRUE(sameColor(front, line[124]));
+    EXPECT_TRUE(sameColor(background, line[128]));
+    EXPECT_EQ(1, ppu.flagSpriteZeroHit);
+}
+
+TEST(PPUTest, RenderScanlineLeftColumn) {
+    nestake::PPU ppu;
+    ppu.LoadCartridge(patterns());
+    for (int i = 0; i < 64; ++i) {
+        sprite(ppu, i, 0xF0, 0, 0, 0);
+    }
+    ppu.WritePalette(0x03, 0x16);
+    ppu.WritePalette(0x11, 0x2A);
+    nestake::color universal = {0x66, 0x66, 0x66};
+    nestake::color background = {0xB5, 0x31, 0x20};
+    nestake::color front = {0x5C, 0xE4, 0x30};
+    ppu.nameTableData.fill(1);
+    for (int i = 0x3C0; i < 0x400; ++i) {
+        ppu.nameTableData[i] = 0;
+    }
+    sprite(ppu, 0, 0, 2, 0x00, 0);
+
+    // background and sprites hidden in the left 8 pixels: no sprite 0 hit there
+    ppu.writeMask(0x18);
+    ppu.RenderScanline(1);
+    const nestake::color *line = &ppu.renderingImage[256];
+    EXPECT_TRUE(sameColor(universal, line[0]));
+    EXPECT_TRUE(sameColor(background, line[8]));
+    EXPECT_EQ(0, ppu.flagSpriteZeroHit);
+
+    ppu.writeMask(0x1C);
+    ppu.RenderScanline(1);
+    EXPECT_TRUE(sameColor(front, line[0]));
+    EXPECT_TRUE(sameColor(universal, line[4]));
+    EXPECT_EQ(0, ppu.flagSpriteZeroHit);
+
+    ppu.writeMask(0x1E);
+    ppu.RenderScanline(1);
+    EXPECT_TRUE(sameColor(background, line[4]));
+    EXPECT_EQ(1, ppu.flagSpriteZeroHit);
+}
+
+TEST(PPUTest, RenderFrameDirtyLines) {
+    nestake::PPU ppu;
+    ppu.LoadCartridge(patterns());
+    for (int i = 0; i < 64; ++i) {
+        sprite(ppu, i, 0xF0, 0, 0, 0);
+    }
+    ppu.WritePalette(0x03, 0x16);
+    ppu.WritePalette(0x11, 0x2A);
+    ppu.writeMask(0x1E);
+    sprite(ppu, 0, 49, 2, 0x00, 128);
+    for (int i = 0; i < 30*32; ++i) {
+        ppu.nameTableData[i] = (i % 32) >= 16 ? 1 : 0;
+    }
+
+    ppu.RenderFrame();
+    ASSERT_EQ(1u, ppu.DirtyLines.size());
+    EXPECT_EQ(0, ppu.DirtyLines[0].First);
+    EXPECT_EQ(240, ppu.DirtyLines[0].End);
+    EXPECT_EQ(1, ppu.flagSpriteZeroHit);
+    std::vector<nestake::color> first(ppu.currentImage.begin(), ppu.currentImage.end());
+
+    // nothing changed: no scanline drawn, the status flags are kept
+    ppu.RenderFrame();
+    EXPECT_TRUE(ppu.DirtyLines.empty());
+    EXPECT_EQ(1, ppu.flagSpriteZeroHit);
+
+    // a tile of row 3 and a moved sprite
+    ppu.nameTableData[3*32 + 2] = 1;
+    ppu.oamData[0] = 99;
+    ppu.RenderFrame();
+    ASSERT_EQ(3u, ppu.DirtyLines.size());
+    EXPECT_EQ(24, ppu.DirtyLines[0].First);
+    EXPECT_EQ(32, ppu.DirtyLines[0].End);
+    EXPECT_EQ(50, ppu.DirtyLines[1].First);
+    EXPECT_EQ(58, ppu.DirtyLines[1].End);
+    EXPECT_EQ(100, ppu.DirtyLines[2].First);
+    EXPECT_EQ(108, ppu.DirtyLines[2].End);
+    EXPECT_TRUE(sameColor(ppu.currentImage[24*256 + 16], ppu.currentImage[24*256 + 128]));
+    EXPECT_FALSE(sameColor(first[50*256 + 128], ppu.currentImage[50*256 + 128]));
+    EXPECT_TRUE(sameColor(first[50*256 + 128], ppu.currentImage[100*256 + 128]));
+
+    // an attribute byte covers 4 tile rows
+    ppu.nameTableData[0x3C0 + 9] = 0x55;
+    ppu.RenderFrame();
+    ASSERT_EQ(1u, ppu.DirtyLines.size());
+    EXPECT_EQ(32, ppu.DirtyLines[0].First);
+    EXPECT_EQ(64, ppu.DirtyLines[0].End);
+
+    // reused scanlines match a full redraw
+    std::vector<nestake::color> memoized(ppu.currentImage.begin(), ppu.currentImage.end());
+    ppu.InvalidateFrame();
+    ppu.RenderFrame();
+    EXPECT_EQ(240, ppu.DirtyLines[0].End);
+    for (size_t i = 0; i < memoized.size(); ++i) {
+        ASSERT_TRUE(sameColor(memoized[i], ppu.currentImage[i])) << i;
+    }
+
+    // a different palette, scroll or mask draws everything again
+    ppu.WritePalette(0x03, 0x17);
+    ppu.RenderFrame();
+    ASSERT_EQ(1u, ppu.DirtyLines.size());
+    EXPECT_EQ(240, ppu.DirtyLines[0].End);
+    ppu.x = 1;
+    ppu.RenderFrame();
+    EXPECT_EQ(1u, ppu.DirtyLines.size());
+    ppu.RenderFrame();
+    EXPECT_TRUE(ppu.DirtyLines.empty());
+}
+
+TEST(PPUTest, NameTableMirroring) {
+    nestake::PPU ppu;
+    nestake::PPUMemory &mem = ppu.Memory();
+
+    // horizontal without a cartridge
+    mem.Write(0x2005, 1);
+    mem.Write(0x2805, 2);
+    EXPECT_EQ(1, mem.Read(0x2405));
+    EXPECT_EQ(2, mem.Read(0x2C05));
+    EXPECT_EQ(1, ppu.nameTableData[0x005]);
+    EXPECT_EQ(2, ppu.nameTableData[0x405]);
+    // 0x3000-0x3EFF mirrors 0x2000-0x2EFF
+    EXPECT_EQ(2, mem.Read(0x3805));
+
+    mem.SetMirror(nestake::MirrorVertical);
+    EXPECT_EQ(1, mem.Read(0x2805));
+    EXPECT_EQ(2, mem.Read(0x2405));
+    EXPECT_EQ(2, mem.Read(0x2C05));
+
+    mem.SetMirror(nestake::MirrorSingle1);
+    EXPECT_EQ(2, mem.Read(0x2005));
+    EXPECT_EQ(2, mem.Read(0x2805));
+
+    mem.SetMirror(nestake::MirrorFour);
+    mem.Write(0x2805, 3);
+    mem.Write(0x2C05, 4);
+    EXPECT_EQ(1, mem.Read(0x2005));
+    EXPECT_EQ(2, mem.Read(0x2405));
+    EXPECT_EQ(3, mem.Read(0x2805));
+    EXPECT_EQ(4, mem.Read(0x2C05));
+
+    // from the cartridge
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    std::vector<uint8_t> chr(0x2000, 0);
+    ppu.LoadCartridge(std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr, 0, nestake::MirrorFour)));
+    EXPECT_EQ(nestake::MirrorFour, mem.Mirror());
+    ppu.LoadCartridge(std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr, 0, nestake::MirrorVertical)));
+    EXPECT_EQ(nestake::MirrorVertical, mem.Mirror());
+}
+
+TEST(PPUTest, PatternAndPaletteSpace) {
+    std::vector<uint8_t> prg(0x4000, 0xEA);
+    std::vector<uint8_t> chr(0x4000);
+    for (size_t i = 0; i < chr.size(); ++i) {
+        chr[i] = uint8_t(i >> 10);
+    }
+    nestake::PPU ppu;
+    ppu.LoadCartridge(std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, chr)));
+    nestake::PPUMemory &mem = ppu.Memory();
+    EXPECT_EQ(0, mem.Read(0x0000));
+    EXPECT_EQ(7, mem.Read(0x1FFF));
+
+    // switching a bank rewrites a page
+    uint32_t generation = mem.Generation();
+    mem.MapCHR(7, 0x3C00);
+    EXPECT_EQ(15, mem.Read(0x1FFF));
+    EXPECT_EQ(6, mem.Read(0x1BFF));
+    EXPECT_NE(generation, mem.Generation());
+
+    // palette RAM with its mirrors
+    mem.Write(0x3F10, 0x21);
+    mem.Write(0x3F05, 0x22);
+    EXPECT_EQ(0x21, mem.Read(0x3F00));
+    EXPECT_EQ(0x21, ppu.ReadPalette(0x10));
+    EXPECT_EQ(0x22, mem.Read(0x3F25));
+    EXPECT_EQ(0x22, mem.Read(0x7F05));
+    mem.Write(0x3F15, 0x23);
+    EXPECT_EQ(0x22, mem.Read(0x3F05));
+    EXPECT_EQ(0x23, ppu.paletteData[0x15]);
+}
+
+TEST(PPUTest, RenderFrameAfterMirroring) {
+    nestake::PPU ppu;
+    ppu.LoadCartridge(patterns());
+    for (int i = 0; i < 64; ++i) {
+        sprite(ppu, i, 0xF0, 0, 0, 0);
+    }
+    ppu.WritePalette(0x03, 0x16);
+    ppu.writeMask(0x1E);
+    // second name table solid, shown at the bottom of the screen with horizontal mirroring
+    for (int i = 0x400; i < 0x400 + 30*32; ++i) {
+        ppu.nameTableData[i] = 1;
+    }
+    ppu.t = 0x0800;
+    ppu.RenderFrame();
+    nestake::color solid = ppu.currentImage[0];
+    ppu.RenderFrame();
+    EXPECT_TRUE(ppu.DirtyLines.empty());
+
+    // mirroring change: the first name table (empty) is shown
+    ppu.Memory().SetMirror(nestake::MirrorVertical);
+    ppu.RenderFrame();
+    EXPECT_EQ(240, ppu.DirtyLines[0].End);
+    EXPECT_FALSE(sameColor(solid, ppu.currentImage[0]));
+}
+
+TEST(PPUTest, Tick) {
+    nestake::PPU ppu;
+    ppu.LoadCartridge(patterns());
+    // from dot 340 of line 240 to the start of vblank
+    EXPECT_FALSE(ppu.Tick(2));
+    EXPECT_EQ(241u, ppu.ScanLine);
+    EXPECT_EQ(1u, ppu.Cycle);
+    EXPECT_TRUE(ppu.nmiOccurred);
+
+    ppu.flagSpriteZeroHit = 1;
+    EXPECT_FALSE(ppu.Tick(20*nestake::DotsPerLine));
+    EXPECT_FALSE(ppu.nmiOccurred);
+    EXPECT_EQ(0, ppu.flagSpriteZeroHit);
+    EXPECT_EQ(0u, ppu.Frame);
+
+    // a whole frame in one go raises the NMI once when enabled
+    ppu.writeControl(0x80);
+    EXPECT_TRUE(ppu.Tick(nestake::DotsPerFrame));
+    EXPECT_EQ(1u, ppu.Frame);
+    EXPECT_EQ(261u, ppu.ScanLine);
+    EXPECT_EQ(1u, ppu.Cycle);
+    EXPECT_FALSE(ppu.nmiOccurred);
+
+    // the frame is drawn at the start of vblank when rendering is on
+    EXPECT_TRUE(ppu.currentImage.empty());
+    ppu.writeMask(0x08);
+    ppu.Tick(nestake::DotsPerFrame);
+    EXPECT_FALSE(ppu.currentImage.empty());
+}
@@ -0,0 +1,43 @@
+#include "gtest/gtest.h"
+#include "predicate.cpp"
+
+#include "console.hpp"
+
+namespace {
+    // INC $0010 / JMP $8000
+    std::shared_ptr<nestake::Cartridge> counter() {
+        std::vector<uint8_t> prg(0x4000, 0xEA);
+        const uint8_t code[] = {0xEE, 0x10, 0x00, 0x4C, 0x00, 0x80};
+        std::copy(code, code + sizeof(code), prg.begin());
+        prg[0x3FFC] = 0x00;
+        prg[0x3FFD] = 0x80;
+        return std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>()));
+    }
+}
+
+// without NESTAKE_DEBUGGER RunUntil stops at the same instruction boundaries as with the traps
+TEST(PredicatePlainTest, RAM) {
+    nestake::BasicConsole<nestake::NROM> console(counter());
+    EXPECT_TRUE(console.RunUntil(nestake::Predicate::RAM(0x10, nestake::CompareEqual, 5), 100000));
+    EXPECT_EQ(5, console.Bus.RAM[0x10]);
+    EXPECT_EQ(0x8003, console.CPU.PC);
+}
+
+TEST(PredicatePlainTest, PC) {
+    nestake::Console console(counter());
+    nestake::Predicate p = nestake::Predicate::PC(0x8003) &&
+                           nestake::Predicate::RAM(0x10, nestake::CompareGreaterEqual, 3);
+    EXPECT_TRUE(console.RunUntil(p, 100000));
+    EXPECT_EQ(0x8003, console.Processor().PC);
+    EXPECT_EQ(3, console.Processor().mem->RAM[0x10]);
+}
+
+TEST(PredicatePlainTest, Frames) {
+    nestake::BasicConsole<nestake::NROM> console(counter());
+    const uint64_t frame = console.PPU.Frame;
+    EXPECT_TRUE(console.RunUntil(nestake::Predicate::Frames(2), 1000000));
+    // stopped by the step that started the PPU's second frame
+    EXPECT_EQ(frame + 2, console.PPU.Frame);
+    EXPECT_LT(console.PPU.ScanLine*nestake::DotsPerLine + console.PPU.Cycle, 3*6u);
+    EXPECT_FALSE(console.RunUntil(nestake::Predicate::PC(0x9000), 1000));
+}
@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+#include "predicate.cpp"
+
+#include "console.hpp"
+
+namespace {
+    // INC $0010 / JMP $8000
+    std::shared_ptr<nestake::Cartridge> counter() {
+        std::vector<uint8_t> prg(0x4000, 0xEA);
+        const uint8_t code[] = {0xEE, 0x10, 0x00, 0x4C, 0x00, 0x80};
+        std::copy(code, code + sizeof(code), prg.begin());
+        prg[0x3FFC] = 0x00;
+        prg[0x3FFD] = 0x80;
+        return std::make_shared<nestake::Cartridge>(nestake::MakeINES(prg, std::vector<uint8_t>()));
+    }
+}
+
+TEST(PredicateTest, Holds) {
+    uint8_t ram[0x800] = {};
+    ram[0x10] = 3;
+    using nestake::Predicate;
+    EXPECT_TRUE(Predicate::RAM(0x10, nestake::CompareEqual, 3).Holds(ram, 0x8000, 0));
+    EXPECT_TRUE(Predicate::RAM(0x810, nestake::CompareEqual, 3).Holds(ram, 0x8000, 0));
+    EXPECT_FALSE(Predicate::RAM(0x10, nestake::CompareLess, 3).Holds(ram, 0x8000, 0));
+    EXPECT_TRUE(Predicate::RAM(0x10, nestake::CompareGreaterEqual, 3).Holds(ram, 0x8000, 0));
+
+    Predicate p = (Predicate::PC(0xC000) || Predicate::Frames(10)) && Predicate::RAM(0x10, nestake::CompareEqual, 3);
+    EXPECT_TRUE(p.Holds(ram, 0xC000, 0));
+    EXPECT_TRUE(p.Holds(ram, 0x8000, 10));
+    EXPECT_FALSE(p.Holds(ram, 0x8000, 9));
+    ram[0x10] = 4;
+    EXPECT_FALSE(p.Holds(ram, 0xC000, 10));
+    EXPECT_TRUE(p.CountsFrames());
+    EXPECT_FALSE(Predicate::PC(0xC000).CountsFrames());
+
+    // only the RAM and its mirrors can be compared
+    EXPECT_NO_THROW(Predicate::RAM(0x1FFF, nestake::CompareEqual, 0));
+    EXPECT_THROW(Predicate::RAM(0x2000, nestake::CompareEqual, 0), std::out_of_range);
+    EXPECT_THROW(Predicate::RAM(0x6000, nestake::CompareEqual, 0), std::out_of_range);
+}
+
+TEST(PredicateTest, RAM) {
+    nestake::BasicConsole<nestake::NROM> console(counter());
+    EXPECT_TRUE(console.RunUntil(nestake::Predicate::RAM(0x10, nestake::CompareEqual, 5), 100000));
+    // stopped right after the write
+    EXPECT_EQ(5, console.Bus.RAM[0x10]);
+    EXPECT_EQ(0x8003, console.CPU.PC);
+}
+
+TEST(PredicateTest, PC) {
+    nestake::BasicConsole<nestake::NROM> console(counter());
+    nestake::Predicate p = nestake::Predicate::PC(0x8003) &&
+                           nestake::Predicate::RAM(0x10, nestake::CompareGreaterEqual, 3);
+    EXPECT_TRUE(console.RunUntil(p, 100000));
+    EXPECT_EQ(0x8003, console.CPU.PC);
+    EXPECT_EQ(3, console.Bus.RAM[0x10]);
+}
+
+TEST(PredicateTest, Frames) {
+    nestake::BasicConsole<nestake::NROM> console(counter());
+    const uint64_t frame = console.PPU.Frame;
+    EXPECT_TRUE(console.RunUntil(nestake::Predicate::Frames(2), 1000000));
+    // stopped by the step that started the PPU's second frame
+    EXPECT_EQ(frame + 2, console.PPU.Frame);
+    EXPECT_LT(console.PPU.ScanLine*nestake::DotsPerLine + console.PPU.Cycle, 3*6u);
+}
+
+TEST(PredicateTest, MaxCycles) {
+    nestake::BasicConsole<nestake::NROM> console(counter());
+    const uint64_t start = console.CPU.Cycles;
+    EXPECT_FALSE(console.RunUntil(nestake::Predicate::RAM(0x11, nestake::CompareEqual, 1), 1000));
+    EXPECT_GE(console.CPU.Cycles - start, 1000u);
+    EXPECT_LT(console.CPU.Cycles - start, 1008u);
+}
+
+TEST(PredicateTest, Console) {
+    nestake::Console console(counter());
+    EXPECT_TRUE(console.RunUntil(nestake::Predicate::RAM(0x10, nestake::CompareEqual, 200), 100000));
+    EXPECT_EQ(200, console.Processor().mem->RAM[0x10]);
+    EXPECT_EQ(nullptr, console.Processor().mem->Debug);
+
+    // the traps of an attached debugger are not suspended behind its back
+    std::shared_ptr<nestake::Debugger> debugger(std::make_shared<nestake::Debugger>());
+    console.Processor().mem->Attach(debugger);
+    EXPECT_THROW(console.RunUntil(nestake::Predicate::RAM(0x10, nestake::CompareEqual, 100), 100000), std::logic_error);
+    EXPECT_EQ(debugger, console.Processor().mem->Debug);
+    EXPECT_EQ(200, console.Processor().mem->RAM[0x10]);
+}
+
+TEST(PredicateTest, FramesWithoutPPU) {
+    std::shared_ptr<nestake::Cpu> cpu(std::make_shared<nestake::Cpu>(std::make_shared<nestake::CPUMemory>()));
+    nestake::Console console(cpu, counter());
+    EXPECT_THROW(console.RunUntil(nestake::Predicate::Frames(1), 100000), std::invalid_argument);
+    EXPECT_TRUE(console.RunUntil(nestake::Predicate::RAM(0x10, nestake::CompareEqual, 2), 100000));
+}
+
+TEST(PredicateTest, Throw) {
+    nestake::BasicConsole<nestake::NROM> console(counter());
+    int steps = 0;
+    EXPECT_THROW(nestake::RunUntil(console.CPU, console.Bus, nestake::Predicate::PC(0x9000), 100000, [&]() {
+        if (++steps == 10) {
+            throw std::runtime_error("step");
+        }
+        return console.Step();
+    }), std::runtime_error);
+    // the predicate's traps are not left on the bus
+    EXPECT_EQ(nullptr, console.Bus.Debug);
+    EXPECT_EQ(10, steps);
+}
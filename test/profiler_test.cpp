@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+#include "profiler.cpp"
+
+#include <cstdio>
+#include <sstream>
+
+#include "ines.hpp"
+
+namespace {
+    // run sample.nes with the profiler attached
+    uint64_t runSample(const std::shared_ptr<nestake::Profiler> &profile, int steps) {
+        const std::string path = "../../resources/sample.nes";
+        std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+        std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+        nestake::Cpu cpu(mem);
+        cpu.LoadCartridge(cart);
+        cpu.Profile = profile;
+        for (int i = 0; i < steps; ++i) {
+            cpu.Step();
+        }
+        return cpu.Cycles;
+    }
+}
+
+TEST(ProfilerTest, Exact) {
+    std::shared_ptr<nestake::Profiler> profile(std::make_shared<nestake::Profiler>());
+    uint64_t cycles = runSample(profile, 200);
+
+    // fused pairs count as two instructions
+    EXPECT_LE(200, profile->Instructions());
+    EXPECT_EQ(profile->Instructions(), profile->Samples());
+
+    // 0x8000: SEI / LDX #$FF
+    EXPECT_EQ(1, profile->OpcodeCount(0x78));
+    EXPECT_EQ(2, profile->CyclesAt(0x8000));
+    EXPECT_EQ(2, profile->CyclesAt(0x8001));
+
+    uint64_t opcodes = 0, modes = 0, total = 0;
+    for (int i = 0; i < 0x100; ++i) {
+        opcodes += profile->OpcodeCount(uint8_t(i));
+    }
+    for (int i = 0; i < 0x10; ++i) {
+        modes += profile->ModeCount(uint8_t(i));
+    }
+    for (int i = 0; i < 0x10000; ++i) {
+        total += profile->CyclesAt(uint16_t(i));
+    }
+    EXPECT_EQ(profile->Samples(), opcodes);
+    EXPECT_EQ(profile->Samples(), modes);
+    EXPECT_EQ(cycles, total);
+    EXPECT_LT(0, profile->ModeCount(nestake::Implied));
+}
+
+TEST(ProfilerTest, Sampling) {
+    std::shared_ptr<nestake::Profiler> profile(std::make_shared<nestake::Profiler>(10));
+    runSample(profile, 200);
+    EXPECT_EQ(10, profile->Interval());
+    EXPECT_EQ(profile->Instructions() / 10, profile->Samples());
+
+    profile->Clear();
+    EXPECT_EQ(0, profile->Instructions());
+    EXPECT_EQ(0, profile->Samples());
+    EXPECT_EQ(0, profile->CyclesAt(0x8000));
+}
+
+TEST(ProfilerTest, Export) {
+    nestake::Profiler profile;
+    profile.Record(0x8000, 0x78, nestake::Implied, 2);
+    profile.Record(0x8001, 0xA2, nestake::Immediate, 2);
+    profile.Record(0x8001, 0xA2, nestake::Immediate, 2);
+
+    nestake::Cpu cpu(std::make_shared<nestake::CPUMemory>());
+    std::ostringstream out;
+    profile.Report(out, cpu, 1);
+    EXPECT_EQ("instructions: 3 (3 samples, every 1)\n"
+              "opcodes:\n"
+              "  LDX(A2): 2 (66.7%)\n"
+              "addressing modes:\n"
+              "  Immediate: 2 (66.7%)\n"
+              "  Implied: 1 (33.3%)\n"
+              "cycles by address:\n"
+              "  $8001: 4 (66.7%)\n", out.str());
+
+    const std::string path = "profiler_test.prof";
+    ASSERT_TRUE(profile.Export(path));
+    FILE *f = std::fopen(path.c_str(), "rb");
+    ASSERT_TRUE(f != nullptr);
+    std::fseek(f, 0, SEEK_END);
+    EXPECT_EQ(32 + 8 * (0x100 + 0x10 + 0x10000), std::ftell(f));
+
+    // cycles at $8001
+    uint64_t v = 0;
+    std::fseek(f, 32 + 8 * (0x100 + 0x10 + 0x8001), SEEK_SET);
+    EXPECT_EQ(1, std::fread(&v, sizeof(v), 1, f));
+    EXPECT_EQ(4, v);
+    std::fclose(f);
+    std::remove(path.c_str());
+}
@@ -0,0 +1,62 @@
+#include "gtest/gtest.h"
+#include "saveram.cpp"
+
+#include <vector>
+
+TEST(SaveRAMTest, InMemory) {
+    nestake::SaveRAM sram;
+    EXPECT_FALSE(sram.IsFileBacked());
+    EXPECT_EQ(0, sram.Read(0x1FFF));
+    sram.Write(0x0000, 0x12);
+    sram.Write(0x1FFF, 0x34);
+    EXPECT_EQ(0x12, sram.Read(0x0000));
+    EXPECT_EQ(0x34, sram.Read(0x1FFF));
+    EXPECT_EQ(0x80000001u, sram.Dirty());
+    sram.Flush();
+    EXPECT_EQ(0u, sram.Dirty());
+}
+
+TEST(SaveRAMTest, File) {
+    const std::string path = "saveram_test.sav";
+    std::remove(path.c_str());
+    {
+        nestake::SaveRAM sram(path);
+        EXPECT_TRUE(sram.IsFileBacked());
+        EXPECT_EQ(0, sram.Read(0x0100));
+        sram.Write(0x0100, 0x56);
+        sram.Write(0x1000, 0x78);
+        EXPECT_EQ(0x00010002u, sram.Dirty());
+        sram.Flush();
+        EXPECT_EQ(0u, sram.Dirty());
+    }
+    {
+        nestake::SaveRAM sram(path);
+        EXPECT_EQ(0x56, sram.Read(0x0100));
+        EXPECT_EQ(0x78, sram.Read(0x1000));
+    }
+    FILE *f = std::fopen(path.c_str(), "rb");
+    ASSERT_NE(nullptr, f);
+    std::fseek(f, 0, SEEK_END);
+    EXPECT_EQ(long(nestake::SaveRAM::Size), std::ftell(f));
+    std::fclose(f);
+    std::remove(path.c_str());
+}
+
+TEST(SaveRAMTest, FileError) {
+    // the caller sees the failure and gets in-memory SRAM
+    nestake::SaveRAM sram("saveram_test_missing_dir/saveram_test.sav");
+    EXPECT_FALSE(sram.IsFileBacked());
+    sram.Write(0x0100, 0x56);
+    EXPECT_EQ(0x56, sram.Read(0x0100));
+}
+
+TEST(SaveRAMTest, Snapshot) {
+    nestake::SaveRAM sram;
+    sram.Write(0x0042, 1);
+    std::vector<uint8_t> snapshot(sram.Data(), sram.Data() + nestake::SaveRAM::Size);
+    sram.Write(0x0042, 2);
+    sram.Flush();
+    sram.Restore(snapshot.data());
+    EXPECT_EQ(1, sram.Read(0x0042));
+    EXPECT_EQ(~0u, sram.Dirty());
+}
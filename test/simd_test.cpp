@@ -0,0 +1,151 @@
+#include "gtest/gtest.h"
+#include "simd.cpp"
+
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> randomBytes(size_t n, uint32_t seed) {
+        std::vector<uint8_t> v(n);
+        for (size_t i = 0; i < n; ++i) {
+            seed = seed * 1103515245 + 12345;
+            v[i] = uint8_t(seed >> 16);
+        }
+        return v;
+    }
+
+    std::vector<uint32_t> randomWords(size_t n, uint32_t seed) {
+        std::vector<uint8_t> bytes = randomBytes(n * 4, seed);
+        std::vector<uint32_t> v(n);
+        std::memcpy(v.data(), bytes.data(), bytes.size());
+        return v;
+    }
+
+    // every level this host can run
+    std::vector<nestake::SimdLevel> levels() {
+        std::vector<nestake::SimdLevel> l;
+        for (int i = nestake::SimdScalar; i <= nestake::DetectSimdLevel(); ++i) {
+            l.push_back(nestake::SimdLevel(i));
+        }
+        return l;
+    }
+}
+
+TEST(SimdTest, Dispatch) {
+    EXPECT_EQ(nestake::DetectSimdLevel(), nestake::Simd().Level);
+    EXPECT_EQ(nestake::SimdScalar, nestake::SimdKernelsFor(nestake::SimdScalar).Level);
+    EXPECT_LE(nestake::SimdKernelsFor(nestake::SimdAVX512).Level, nestake::SimdAVX512);
+}
+
+TEST(SimdTest, HashBytes) {
+    nestake::SimdKernels scalar = nestake::SimdKernelsFor(nestake::SimdScalar);
+    const size_t sizes[] = {0, 1, 63, 64, 65, 2048, 2048 + 37};
+    for (nestake::SimdLevel level : levels()) {
+        nestake::SimdKernels k = nestake::SimdKernelsFor(level);
+        for (size_t size : sizes) {
+            std::vector<uint8_t> data = randomBytes(size, uint32_t(size));
+            EXPECT_EQ(scalar.HashBytes(data.data(), size), k.HashBytes(data.data(), size))
+                << "level " << level << " size " << size;
+        }
+    }
+
+    // sensitive to any byte
+    std::vector<uint8_t> data = randomBytes(2048, 1);
+    uint64_t h = nestake::Simd().HashBytes(data.data(), data.size());
+    data[1000] ^= 1;
+    EXPECT_NE(h, nestake::Simd().HashBytes(data.data(), data.size()));
+}
+
+TEST(SimdTest, PaletteToRGBA) {
+    nestake::SimdKernels scalar = nestake::SimdKernelsFor(nestake::SimdScalar);
+    std::vector<uint32_t> palette = randomWords(64, 7);
+    const size_t sizes[] = {0, 5, 16, 256, 256 + 13};
+    for (nestake::SimdLevel level : levels()) {
+        nestake::SimdKernels k = nestake::SimdKernelsFor(level);
+        for (size_t size : sizes) {
+            std::vector<uint8_t> indices = randomBytes(size, uint32_t(size + 3));
+            std::vector<uint32_t> expected(size), actual(size);
+            scalar.PaletteToRGBA(indices.data(), size, palette.data(), expected.data());
+            k.PaletteToRGBA(indices.data(), size, palette.data(), actual.data());
+            EXPECT_EQ(expected, actual) << "level " << level << " size " << size;
+        }
+    }
+}
+
+TEST(SimdTest, Downsample2x) {
+    nestake::SimdKernels scalar = nestake::SimdKernelsFor(nestake::SimdScalar);
+
+    // 2x2 block of one channel: avg(avg(1, 4), avg(2, 7)) = avg(3, 5) = 4
+    const uint32_t block[] = {1, 2, 4, 7};
+    uint32_t out = 0;
+    scalar.Downsample2x(block, 2, 2, &out);
+    EXPECT_EQ(4, out);
+
+    const size_t widths[] = {2, 10, 64, 256, 256 + 6};
+    for (nestake::SimdLevel level : levels()) {
+        nestake::SimdKernels k = nestake::SimdKernelsFor(level);
+        for (size_t width : widths) {
+            size_t height = 6;
+            std::vector<uint32_t> image = randomWords(width * height, uint32_t(width));
+            std::vector<uint32_t> expected(width * height / 4), actual(width * height / 4);
+            scalar.Downsample2x(image.data(), width, height, expected.data());
+            k.Downsample2x(image.data(), width, height, actual.data());
+            EXPECT_EQ(expected, actual) << "level " << level << " width " << width;
+        }
+    }
+}
+
+TEST(SimdTest, ComposeLine) {
+    nestake::SimdKernels scalar = nestake::SimdKernelsFor(nestake::SimdScalar);
+
+    // bg opaque / sprite in front / sprite behind / both transparent / sprite over transparent bg
+    const uint8_t bg[] = {0x05, 0x05, 0x05, 0x04, 0x00};
+    const uint8_t sprites[] = {0x00, 0x11, 0x12 | nestake::SpriteBehind, 0x10, 0x13 | nestake::SpriteBehind};
+    uint8_t out[5];
+    EXPECT_FALSE(scalar.ComposeLine(bg, sprites, out, 5));
+    const uint8_t expected[] = {0x05, 0x11, 0x05, 0x00, 0x13};
+    EXPECT_EQ(0, std::memcmp(expected, out, 5));
+
+    // sprite 0 only hits over an opaque background pixel
+    const uint8_t zero[] = {0x00, 0x11 | nestake::SpriteZero, 0x00, 0x00, 0x00};
+    EXPECT_TRUE(scalar.ComposeLine(bg, zero, out, 5));
+    const uint8_t zeroOverEmpty[] = {0x00, 0x00, 0x00, 0x11 | nestake::SpriteZero, 0x00};
+    EXPECT_FALSE(scalar.ComposeLine(bg, zeroOverEmpty, out, 5));
+
+    const size_t sizes[] = {5, 16, 255, 256};
+    for (nestake::SimdLevel level : levels()) {
+        nestake::SimdKernels k = nestake::SimdKernelsFor(level);
+        for (size_t size : sizes) {
+            for (uint32_t seed = 0; seed < 8; ++seed) {
+                std::vector<uint8_t> b = randomBytes(size, seed);
+                std::vector<uint8_t> s = randomBytes(size, seed + 100);
+                for (size_t i = 0; i < size; ++i) {
+                    b[i] &= 0x0F;
+                    // mostly without sprite 0, so that the hit is not always found
+                    s[i] &= (i == size / 2 && seed % 2) ? 0x7F : 0x3F;
+                }
+                std::vector<uint8_t> expectedLine(size), actualLine(size);
+                bool expectedHit = scalar.ComposeLine(b.data(), s.data(), expectedLine.data(), size);
+                bool actualHit = k.ComposeLine(b.data(), s.data(), actualLine.data(), size);
+                EXPECT_EQ(expectedHit, actualHit) << "level " << level << " size " << size;
+                EXPECT_EQ(expectedLine, actualLine) << "level " << level << " size " << size;
+            }
+        }
+    }
+}
+
+TEST(SimdTest, UpdateBytes) {
+    const size_t sizes[] = {0, 7, 16, 256, 1000};
+    for (nestake::SimdLevel level : levels()) {
+        nestake::SimdKernels k = nestake::SimdKernelsFor(level);
+        for (size_t size : sizes) {
+            std::vector<uint8_t> src = randomBytes(size, uint32_t(size));
+            std::vector<uint8_t> dst = src;
+            EXPECT_FALSE(k.UpdateBytes(src.data(), dst.data(), size)) << "level " << level;
+            for (size_t i = 0; i < size; i += 13) {
+                dst[i] ^= 0x80;
+                EXPECT_TRUE(k.UpdateBytes(src.data(), dst.data(), size)) << "level " << level << " at " << i;
+                EXPECT_EQ(src, dst);
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include "gtest/gtest.h"
+#include "statelib.cpp"
+
+#include <cstdio>
+
+TEST(StateLibraryTest, Dedup) {
+    nestake::ConsoleState a = {}, b = {};
+    a.PC = 0x8000;
+    b.PC = 0xC000;
+    nestake::StateLibraryBuilder builder;
+    EXPECT_EQ(0u, builder.Add(a));
+    EXPECT_EQ(1u, builder.Add(b));
+    // padding bytes don't matter
+    a.Reserved0[0] = 0xFF;
+    EXPECT_EQ(2u, builder.Add(a));
+    EXPECT_EQ(3u, builder.Entries());
+    EXPECT_EQ(2u, builder.Records());
+}
+
+TEST(StateLibraryTest, Load) {
+    const std::string path = "../../resources/sample.nes";
+    const std::string library = "statelib_test.lib";
+    nestake::Console console(std::make_shared<nestake::Cartridge>(path));
+
+    nestake::StateLibraryBuilder builder;
+    std::vector<uint16_t> pcs;
+    std::vector<uint64_t> cycles;
+    for (int i = 0; i < 4; ++i) {
+        nestake::ConsoleState state = {};
+        console.Save(state);
+        builder.Add(state);
+        builder.Add(state);
+        pcs.push_back(console.Processor().PC);
+        cycles.push_back(console.Processor().Cycles);
+        for (int j = 0; j < 50; ++j) {
+            console.Step();
+        }
+    }
+    EXPECT_EQ(8u, builder.Entries());
+    EXPECT_EQ(4u, builder.Records());
+    ASSERT_TRUE(builder.Write(library));
+
+    {
+        nestake::StateLibrary states(library);
+        ASSERT_TRUE(states.IsOpen());
+        ASSERT_EQ(8u, states.Entries());
+        EXPECT_EQ(&states.At(2), &states.At(3));
+        for (size_t k = 0; k < states.Entries(); ++k) {
+            states.Load(k, console);
+            EXPECT_EQ(pcs[k/2], console.Processor().PC);
+            EXPECT_EQ(cycles[k/2], console.Processor().Cycles);
+        }
+    }
+    std::remove(library.c_str());
+}
+
+TEST(StateLibraryTest, NotALibrary) {
+    nestake::StateLibrary missing("statelib_test.missing");
+    EXPECT_FALSE(missing.IsOpen());
+    nestake::StateLibrary rom("../../resources/sample.nes");
+    EXPECT_FALSE(rom.IsOpen());
+
+    // the caller sees a library that cannot be written
+    nestake::StateLibraryBuilder builder;
+    builder.Add(nestake::ConsoleState());
+    EXPECT_FALSE(builder.Write("statelib_test_missing_dir/library"));
+}
+
+TEST(StateLibraryTest, Crafted) {
+    const std::string library = "statelib_test.crafted";
+    // a record count whose size wraps around 64 bits
+    nestake::StateLibraryHeader h = {{'N', 'E', 'S', 'S', 'L', 'I', 'B', 0}, 1,
+                                     uint32_t(sizeof(nestake::ConsoleState)), 1,
+                                     ~uint64_t(0) / sizeof(nestake::ConsoleState) + 1};
+    const uint64_t offset = sizeof(h) + sizeof(uint64_t);
+    nestake::ConsoleState state = {};
+    FILE *f = std::fopen(library.c_str(), "wb");
+    ASSERT_NE(nullptr, f);
+    std::fwrite(&h, sizeof(h), 1, f);
+    std::fwrite(&offset, sizeof(offset), 1, f);
+    std::fwrite(&state, sizeof(state), 1, f);
+    std::fclose(f);
+
+    {
+        nestake::StateLibrary states(library);
+        EXPECT_FALSE(states.IsOpen());
+    }
+    std::remove(library.c_str());
+}
+
+TEST(StateLibraryTest, OutOfRange) {
+    const std::string library = "statelib_test.range";
+    nestake::StateLibraryBuilder builder;
+    nestake::ConsoleState state = {};
+    builder.Add(state);
+    ASSERT_TRUE(builder.Write(library));
+    {
+        nestake::StateLibrary states(library);
+        ASSERT_TRUE(states.IsOpen());
+        EXPECT_NO_THROW(states.At(0));
+        EXPECT_THROW(states.At(1), std::out_of_range);
+        nestake::Console console(std::make_shared<nestake::Cartridge>("../../resources/sample.nes"));
+        EXPECT_THROW(states.Load(1, console), std::out_of_range);
+    }
+    std::remove(library.c_str());
+}
@@ -0,0 +1,89 @@
+#include "gtest/gtest.h"
+#include "trace.cpp"
+
+#include <cstdio>
+#include <sstream>
+
+TEST(TraceTest, Ring) {
+    nestake::TraceBuffer buf("", 3);
+    EXPECT_EQ(4, buf.Capacity());
+    EXPECT_EQ(0, buf.Size());
+
+    for (uint16_t i = 0; i < 6; ++i) {
+        nestake::TraceRecord r = {};
+        r.PC = i;
+        buf.Append(r);
+    }
+
+    // the oldest two are overwritten
+    EXPECT_EQ(4, buf.Size());
+    EXPECT_EQ(2, buf.At(0).PC);
+    EXPECT_EQ(5, buf.At(3).PC);
+    EXPECT_FALSE(buf.IsFileBacked());
+
+    // the caller sees a file that cannot be created, and the ring still records
+    nestake::TraceBuffer unmapped("trace_test_missing_dir/trace_test.trace", 3);
+    EXPECT_FALSE(unmapped.IsFileBacked());
+    nestake::TraceRecord r = {};
+    r.PC = 7;
+    unmapped.Append(r);
+    EXPECT_EQ(7, unmapped.At(0).PC);
+}
+
+TEST(TraceTest, Format) {
+    nestake::Cpu cpu(std::make_shared<nestake::CPUMemory>());
+
+    nestake::TraceRecord r = {};
+    r.Cycles = 7;
+    r.PC = 0xC000;
+    r.Opcode = 0x4C;
+    r.Operand = 0xC5F5;
+    r.P = 0x24;
+    r.SP = 0xFD;
+    EXPECT_EQ("C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7",
+              nestake::FormatTrace(r, cpu));
+
+    // implied, relative
+    r.Opcode = 0xE8;
+    EXPECT_EQ("C000  E8        INX                             A:00 X:00 Y:00 P:24 SP:FD CYC:7",
+              nestake::FormatTrace(r, cpu));
+    r.Opcode = 0xD0;
+    r.Operand = 0xFC;
+    EXPECT_EQ("C000  D0 FC     BNE $BFFE                       A:00 X:00 Y:00 P:24 SP:FD CYC:7",
+              nestake::FormatTrace(r, cpu));
+}
+
+TEST(TraceTest, Step) {
+    const std::string path = "../../resources/sample.nes";
+    std::shared_ptr<nestake::Cartridge> cart(std::make_shared<nestake::Cartridge>(path));
+    std::shared_ptr<nestake::CPUMemory> mem(std::make_shared<nestake::CPUMemory>());
+    nestake::Cpu cpu(mem);
+    cpu.LoadCartridge(cart);
+
+    const std::string tracePath = "trace_test.trace";
+    cpu.Tracer = std::make_shared<nestake::TraceBuffer>(tracePath, 1024);
+    ASSERT_TRUE(cpu.Tracer->IsFileBacked());
+    for (int i = 0; i < 100; ++i) {
+        cpu.Step();
+    }
+
+    // every instruction is recorded even though the loop would be fused otherwise
+    ASSERT_EQ(100, cpu.Tracer->Size());
+    EXPECT_EQ(0x8000, cpu.Tracer->At(0).PC);
+    EXPECT_EQ(0x78, cpu.Tracer->At(0).Opcode);
+    EXPECT_EQ(0x8001, cpu.Tracer->At(1).PC);
+    EXPECT_EQ(2, cpu.Tracer->At(1).Cycles);
+    EXPECT_EQ(0xFF, cpu.Tracer->At(2).X);
+
+    std::ostringstream out;
+    ASSERT_TRUE(nestake::RenderTrace(tracePath, out, cpu));
+    std::istringstream lines(out.str());
+    std::string line;
+    std::getline(lines, line);
+    EXPECT_EQ("8000  78        SEI", line.substr(0, 19));
+    std::getline(lines, line);
+    EXPECT_EQ("8001  A2 FF     LDX #$FF", line.substr(0, 24));
+    std::remove(tracePath.c_str());
+
+    EXPECT_FALSE(nestake::RenderTrace("../../resources/sample.nes", out, cpu));
+}
@@ -0,0 +1,21 @@
+#include <iostream>
+#include <memory>
+
+#include "cpu.hpp"
+#include "trace.hpp"
+
+// render a trace file written by a NESTAKE_TRACE build as a nestest-style log
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <trace file>\n";
+        return 1;
+    }
+
+    // the cpu is only used to disassemble the records
+    nestake::Cpu cpu(std::make_shared<nestake::CPUMemory>());
+    if (!nestake::RenderTrace(argv[1], std::cout, cpu)) {
+        std::cerr << "invalid trace file: " << argv[1] << "\n";
+        return 1;
+    }
+    return 0;
+}